@@ -4,26 +4,89 @@ let generalSettings = {
     interval: 0
 };
 
-const fanNameMapping = {
-    'fan-front': 'Front',
-    'fan-back': 'Back'
-};
+// Maps fan names to the element ID prefix of their controls, filled when the controls are built
+const fanElementIds = {};
+
+// Helper function to create a power slider with its value display
+function createPowerSlider(id, dataAttribute, name) {
+    const slider = document.createElement('input');
+    slider.type = 'range';
+    slider.min = '0';
+    slider.max = '100';
+    slider.value = '0';
+    slider.id = `${id}-power-slider`;
+    slider.dataset[dataAttribute] = name;
+
+    const display = document.createElement('span');
+    display.id = `${id}-power-display`;
+    display.textContent = '0%';
+
+    return [slider, display];
+}
+
+// Function to build one control block per fan and per group from the fan list
+function buildFanControls(fans) {
+    const fanContainer = document.getElementById('fans');
+    const groupContainer = document.getElementById('groups');
+
+    fans.forEach((fan, index) => {
+        const id = `fan-${index}`;
+        fanElementIds[fan.name] = id;
+
+        const container = document.createElement('div');
+        container.className = 'fan-container';
+        container.id = id;
+        container.innerHTML = `
+            <h2></h2>
+            <p>Speed: <span id="${id}-speed">-- RPM</span></p>
+            <p>Power: <span id="${id}-power">--%</span></p>`;
+        container.querySelector('h2').textContent = fan.group ? `Fan ${fan.name} (${fan.group})` : `Fan ${fan.name}`;
+
+        const [slider, display] = createPowerSlider(id, 'fanName', fan.name);
+        slider.className = 'fan-power-slider';
+        container.append(slider, display);
+        fanContainer.appendChild(container);
+    });
+
+    // Groups control all their fans as one unit
+    const groups = [...new Set(fans.map(fan => fan.group).filter(group => group))];
+    groups.forEach((group, index) => {
+        const id = `group-${index}`;
+
+        const container = document.createElement('div');
+        container.className = 'fan-container';
+        container.id = id;
+        const title = document.createElement('h2');
+        title.textContent = `Group ${group}`;
+        container.appendChild(title);
+
+        const [slider, display] = createPowerSlider(id, 'groupName', group);
+        slider.className = 'group-power-slider';
+        container.append(slider, display);
+        groupContainer.appendChild(container);
+    });
+}
 
 // Helper function to update the fan data display (speed, power, and sliders)
-function updateFanData(fanName, fanData, updateSlider = false) {
+function updateFanData(fanData, updateSlider = false) {
+    const id = fanElementIds[fanData.name];
+    if (!id) {
+        return;
+    }
+
     // Update fan speed and power
-    document.getElementById(`${fanName}-speed`).textContent = `${fanData.speed} RPM`;
-    document.getElementById(`${fanName}-power`).textContent = `${fanData.power}%`;
+    document.getElementById(`${id}-speed`).textContent = `${fanData.speed} RPM`;
+    document.getElementById(`${id}-power`).textContent = `${fanData.power}%`;
 
     // Update the slider and display power percentage if required
     if (updateSlider) {
-        const fanSlider = document.getElementById(`${fanName}-power-slider`);
+        const fanSlider = document.getElementById(`${id}-power-slider`);
         fanSlider.value = fanData.power;  // Set the slider to the current value
-        document.getElementById(`${fanName}-power-display`).textContent = `${fanData.power}%`;
+        document.getElementById(`${id}-power-display`).textContent = `${fanData.power}%`;
     }
 }
 
-// Function to fetch and display fan data (Fan 1 and Fan 2)
+// Function to fetch and display the data of all fans
 async function fetchFanData(updateSliders = false) {
     try {
         // Fetch data for Fans
@@ -31,10 +94,14 @@ async function fetchFanData(updateSliders = false) {
 
         // Handle the response
         const fanData = await response.json();
+
+        // Build the controls on the first fetch
+        if (Object.keys(fanElementIds).length === 0) {
+            buildFanControls(fanData);
+        }
         
         // Update the fan data displays and sliders
-        updateFanData('fan-front', fanData[0], updateSliders);
-        updateFanData('fan-back', fanData[1], updateSliders);
+        fanData.forEach(fan => updateFanData(fan, updateSliders));
 
     } catch (error) {
         console.error('Error fetching fan data:', error);
@@ -89,9 +156,9 @@ async function setGeneralConfig() {
     }
 }
 
-// Function to update fan power (Front or Back)
-async function setFanPower(fanName, power) {
-    const endpoint = `/fan?name=${fanNameMapping[fanName]}`;
+// Function to update the power of a single fan, or of all fans of a group
+async function setFanPower(fanName, power, isGroup = false) {
+    const endpoint = `/fan?${isGroup ? 'group' : 'name'}=${encodeURIComponent(fanName)}`;
     const body = JSON.stringify({ power: power });
 
     try {
@@ -105,8 +172,10 @@ async function setFanPower(fanName, power) {
             throw new Error(`Error setting power for Fan ${fanName}`);
         }
 
-        // Update the power display
-        document.getElementById(`${fanName}-power`).textContent = `${power}%`;
+        // Update the power display, group members follow through the event stream
+        if (!isGroup) {
+            document.getElementById(`${fanElementIds[fanName]}-power`).textContent = `${power}%`;
+        }
 
         console.log(`Fan ${fanName} power set to ${power}`);
     } catch (error) {
@@ -114,23 +183,41 @@ async function setFanPower(fanName, power) {
     }
 }
 
-// Function to set up event listeners for the fan power sliders
+// Function to set up event listeners for the fan and group power sliders
 function setupSliders() {
-    const sliders = document.querySelectorAll('.fan-power-slider');
+    const sliders = document.querySelectorAll('.fan-power-slider, .group-power-slider');
 
     sliders.forEach(slider => {
+        const display = document.getElementById(slider.id.replace('-power-slider', '-power-display'));
+
         slider.addEventListener('input', (event) => {
-            const fanName = event.target.dataset.fanName;
-            document.getElementById(`${fanName}-power-display`).textContent = `${event.target.value} %`;
+            display.textContent = `${event.target.value} %`;
         });
 
         slider.addEventListener('change', (event) => {
-            const fanName = event.target.dataset.fanName;
-            setFanPower(fanName, parseInt(event.target.value, 10));
+            const isGroup = 'groupName' in event.target.dataset;
+            const name = isGroup ? event.target.dataset.groupName : event.target.dataset.fanName;
+            setFanPower(name, parseInt(event.target.value, 10), isGroup);
         });
     });
 }
 
+// Function to receive fan state changes pushed by the server as soon as they happen
+function subscribeToFanEvents() {
+    const events = new EventSource('/events');
+
+    events.addEventListener('fan', (event) => {
+        const state = JSON.parse(event.data);
+
+        // Update the fan data displays, sliders stay under user control
+        state.fans.forEach(fan => updateFanData(fan, false));
+    });
+
+    events.onerror = (error) => {
+        console.error('Error in fan event stream:', error);
+    };
+}
+
 // Function to start periodically fetching fan data every 2 seconds
 function startFetchingFanData() {
     setInterval(() => fetchFanData(false), 2000); // Fetch data every 2 seconds
@@ -138,9 +225,10 @@ function startFetchingFanData() {
 
 // Initialize the page
 async function initialize() {
-    await fetchFanData(true);       // Initial fan data fetch and slider update
+    await fetchFanData(true);       // Build the fan controls and set the sliders
     await fetchGeneralConfig();     // Fetch and set general settings
     setupSliders();                 // Set up slider event listeners
+    subscribeToFanEvents();         // Receive fan state changes immediately
     startFetchingFanData();         // Start fetching fan data periodically
 }
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#include "config.hpp"
+
+/**
+ * @brief Where the fan cycle stands, as needed to continue it after a restart.
+ */
+struct CycleState {
+    bool running;                           ///< True if the fans are in their running phase.
+    uint32_t elapsedMs;                     ///< Time spent in the current phase.
+    uint16_t interval;                      ///< Resting duration in seconds.
+    uint16_t runtimeOfFans;                 ///< Running duration in seconds.
+    uint32_t topologyHash;                  ///< Identifies the fans the powers belong to.
+    uint8_t fanCount;                       ///< Number of valid entries in `power`.
+    uint8_t power[FanConfig::MAX_FANS];     ///< Commanded power per fan in creation order.
+};
+
+/**
+ * @class CycleCheckpoint
+ * @brief Keeps the fan cycle state in RTC slow memory, which survives resets but not power loss.
+ *
+ * The fan task saves the state on every phase transition and command, and refreshes the elapsed
+ * time every `FanConfig::CHECKPOINT_INTERVAL_MS`. After a watchdog reset, panic or brownout the
+ * cycle continues from the checkpoint instead of restarting with the fans on. Newer settings
+ * than NVS are also recovered this way, since NVS commits are delayed. A checksum rejects the
+ * random contents found after power-on.
+ */
+class CycleCheckpoint {
+    public:
+        /**
+         * @brief Stores the cycle state.
+         * @param state The current state.
+         */
+        static void save(const CycleState& state);
+
+        /**
+         * @brief Reads the stored state if this boot is a warm restart and the checkpoint is intact.
+         * @param state Receives the stored state.
+         * @return True if the state is valid and should be resumed, false on a cold boot.
+         */
+        static bool restore(CycleState& state);
+
+    private:
+        /**
+         * @brief Layout of the checkpoint in RTC memory.
+         */
+        struct Record {
+            uint32_t magic;     ///< Marks a record written by this firmware.
+            uint16_t version;   ///< Layout version of the record.
+            CycleState state;   ///< The stored state.
+            uint32_t crc;       ///< CRC-32 over all preceding fields.
+        };
+
+        static Record _record;  ///< The checkpoint, not initialized at boot.
+
+        /**
+         * @brief Computes the checksum of the record.
+         */
+        static uint32_t checksum(const Record& record);
+};
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <atomic>
+
 #include "esp_timer.h"
 #include "esp_attr.h"
 #include "esp_log.h"
 
 #include "config.hpp"
-#include "IFan.hpp"
+#include "ifan.hpp"
+
+using namespace std;
+
+/**
+ * @brief Cumulative usage of a fan, the basis for predicting its wear.
+ */
+struct FanWear {
+    uint64_t onTimeMs;         ///< Time the fan was driven with a power above 0.
+    uint64_t dutyPercentMs;    ///< On-time multiplied by the power in percent; divided by 100 the equivalent time at full power.
+    uint64_t revolutions;      ///< Revolutions counted by the tachometer.
+    uint32_t starts;           ///< Times the fan was started from standstill.
+};
 
 /**
  * @class Fan
@@ -24,14 +38,26 @@ class Fan : public IFan {
          * tachometer pin, and LEDC PWM channel and timer.
          * 
          * @param config The configuration settings for the fan, including PWM and tachometer pin setup.
+         * @param index Position of the fan in creation order, identifies it in traces.
+         * @param simulated True for a fan of a trace replay, which drives no hardware and records nothing.
          */
-        Fan(const FanConfig::Config& config);
+        Fan(const FanConfig::Config& config, uint8_t index, bool simulated = false);
+
+        /**
+         * @brief Configures the LEDC timer a fan runs on.
+         * 
+         * Fans with the same frequency share a timer, so this is called once per timer before 
+         * the channels are initialized with `initPWM()`.
+         * 
+         * @param config A fan configuration naming the speed mode, timer and frequency.
+         */
+        static void initTimer(const FanConfig::Config& config);
 
         /**
          * @brief Initializes the PWM configuration for controlling the fan speed.
          * 
-         * This method sets up the PWM (Pulse Width Modulation) using the specified GPIO pin, channel,
-         * and timer. The fan speed can be adjusted using the `setSpeed()` method.
+         * This method sets up the PWM (Pulse Width Modulation) channel on the specified GPIO pin and
+         * binds it to the fan's timer, which must already be configured with `initTimer()`.
          */
         void initPWM();
 
@@ -39,7 +65,8 @@ class Fan : public IFan {
          * @brief Initializes the tachometer to measure the fan's RPM.
          * 
          * This method configures the GPIO pin for the tachometer input and sets up an interrupt service 
-         * routine (ISR) to count fan rotations. The RPM can be calculated using the `updateTacho()` method.
+         * routine (ISR) to count fan rotations. The RPM is calculated by `updateSpeed()`.
+         * Fans without a tacho pin are skipped and report a speed of 0.
          */
         void initTacho();
 
@@ -52,32 +79,130 @@ class Fan : public IFan {
          */
         const FanConfig::Config& getConfig() override;
 
+        /**
+         * @brief Returns the position of the fan in creation order.
+         */
+        uint8_t getIndex() const;
+
        /**
          * @brief Sets the power of the fan by adjusting the PWM duty cycle.
          * 
-         * This method adjusts the fan power by setting the duty cycle of the PWM signal. 
-         * The duty cycle corresponds to the desired power in percentage, where 0% is off and 100% is full power.
+         * This method stores the power as the fan's configured power. While the fan is running the 
+         * duty cycle is updated immediately, otherwise the power is applied on the next `start()`.
          * 
          * @param percent The desired power as a percentage (0-100%) to control the fan speed.
          */
         void setPower(uint8_t percent) override;
 
+        /**
+         * @brief Stores a new configured power and loads its duty cycle without latching it.
+         * 
+         * Several fans can be staged first and latched afterwards, so their duty cycles change
+         * together instead of one after another. Has no effect on the output until `latchPower()`.
+         * 
+         * @param percent The desired power as a percentage (0-100%).
+         */
+        void stagePower(uint8_t percent);
+
+        /**
+         * @brief Latches a duty cycle loaded by `stagePower()` into the PWM output.
+         */
+        void latchPower();
+
+        /**
+         * @brief Starts the fan with its configured power.
+         */
+        void start();
+
+        /**
+         * @brief Stops the fan without changing its configured power.
+         */
+        void stop();
+
+
+        /**
+         * @brief Closes the tacho measurement window once it has lasted `FanConfig::TACHO_UPDATE_CYCLE`.
+         * 
+         * Converts the pulses counted in the window into the speed returned by `getLastSpeed()`
+         * and starts the next window. Must only be called by the fan task, from every control tick.
+         * 
+         * @param nowMs The current time in milliseconds.
+         */
+        void updateSpeed(int64_t nowMs);
+
+        /**
+         * @brief Returns the speed measured by the tachometer in the last completed window.
+         * 
+         * @return The speed in RPM, 0 for fans without a tachometer.
+         */
+        uint16_t getLastSpeed() const override;
+
+        /**
+         * @brief Converts the tacho pulses counted in a measurement window into a speed.
+         * 
+         * @param pulses Number of tacho pulses.
+         * @param windowMs Length of the window in milliseconds.
+         * @return The speed in RPM.
+         */
+        static uint16_t rpmFromPulses(uint32_t pulses, uint32_t windowMs);
+
+        /**
+         * @brief Counts a tacho pulse of a simulated fan, in place of the ISR.
+         */
+        void countPulse();
+
+        /**
+         * @brief Adds the time since the last call to the usage counters.
+         * 
+         * Called by every control tick. The elapsed time is charged to the power the fan has been
+         * running with; the revolutions are taken from the pulses the tacho ISR has counted anyway.
+         * 
+         * @param elapsedMs Time since the previous call in milliseconds.
+         */
+        void accumulateWear(uint32_t elapsedMs);
 
         /**
-         * @brief Returns the current fan speed.
+         * @brief Returns the usage counters. Safe to call from any task.
+         */
+        FanWear getWear() const;
+
+        /**
+         * @brief Continues the usage counters from a persisted state.
          * 
-         * This method retrieves the current speed of the fan, which corresponds to the RPM value measured 
-         * by the tachometer.
+         * @param wear The counters read from NVS.
+         */
+        void restoreWear(const FanWear& wear);
+
+        /**
+         * @brief Computes the average speed of a fan scaled to full power.
          * 
-         * @return The current speed of the fan.
+         * A fan whose value falls over the months needs more duty for the same airflow, which
+         * indicates a worn bearing or a clogged filter.
+         * 
+         * @param wear The usage counters.
+         * @return The speed in RPM, 0 if the fan has not run yet.
          */
-        uint16_t getSpeed() override;
+        static uint32_t rpmAtFullPower(const FanWear& wear);
 
     private:
         FanConfig::Config config;                 ///< Fan configuration settings.
-        uint16_t _counterRPM;                     ///< Counter to track RPM pulses from the tachometer.
-        uint16_t _lastRPM;                        ///< Last measured RPM value.
-        unsigned long _lastTachoMeasurement;      ///< Timestamp of the last tachometer update.
+        uint8_t _index;                           ///< Position of the fan in creation order.
+        atomic<uint32_t> _counterRPM;             ///< Tacho pulses in the current measurement window, counted by the ISR.
+        atomic<uint16_t> _lastRPM;                ///< Speed of the last completed window, read from any task.
+        int64_t _lastTachoMeasurement;            ///< Start of the current measurement window in milliseconds, fan task only.
+        bool _running;                            ///< True while the fan is started.
+        bool _simulated;                          ///< True if the fan only exists in a trace replay.
+        atomic<uint32_t> _totalPulses;            ///< Tacho pulses since boot, wraps around; counted by the ISR.
+        uint32_t _countedPulses;                  ///< Pulses already added to the revolutions.
+        FanWear _wear;                            ///< Cumulative usage counters.
+        mutable portMUX_TYPE _wearLock;           ///< Protects `_wear` against torn reads from other tasks.
+
+        /**
+         * @brief Writes the PWM duty cycle for the given power.
+         * 
+         * @param percent The power as a percentage (0-100%).
+         */
+        void applyPower(uint8_t percent);
 
         /**
          * @brief Interrupt Service Routine (ISR) for counting fan rotations.
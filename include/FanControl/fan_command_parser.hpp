@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+#include "cJSON.h"
+
+#include "FanControl/fan_manager.hpp"
+
+/**
+ * @class FanCommandParser
+ * @brief Converts the JSON form of a command batch, shared by the HTTP and MQTT interfaces.
+ *
+ * The format is `{"fans":[{"name":"Front","power":50},{"group":"Top","power":40}],
+ * "interval":600,"runtimeOfFans":600}`; every member is optional. Only the syntax and value
+ * ranges are checked here, whether the fans exist is decided by `FanManager::submitBatch()`.
+ */
+class FanCommandParser {
+    public:
+        /**
+         * @brief Parses a command batch.
+         * @param json The JSON text, not necessarily zero-terminated.
+         * @param length Length of the text in bytes.
+         * @param batch Receives the parsed batch.
+         * @return nullptr on success, otherwise a description of the problem.
+         */
+        static const char* parse(const char* json, size_t length, FanCommandBatch& batch);
+
+        /**
+         * @brief Parses a command batch that is part of a larger JSON document.
+         * @param root The JSON object of the batch.
+         * @param batch Receives the parsed batch.
+         * @return nullptr on success, otherwise a description of the problem.
+         */
+        static const char* parse(const cJSON* root, FanCommandBatch& batch);
+};
@@ -1,18 +1,58 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <optional>
-#include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "config.hpp"
 #include "ifan.hpp"
+#include "FanControl/cycle_checkpoint.hpp"
 #include "FanControl/fan.hpp"
+#include "FanControl/settings_store.hpp"
+#include "FanControl/trace_recorder.hpp"
+#include "FanControl/wear_store.hpp"
+#include "Network/latency_stats.hpp"
+#include "System/jitter_histogram.hpp"
+#include "System/static_task.hpp"
 
 using namespace std;
 
+/**
+ * @brief A set of changes that is validated as a whole and applied in a single control tick.
+ */
+struct FanCommandBatch {
+    struct FanChange {
+        char name[SettingsConfig::MAX_FAN_NAME_LENGTH];  ///< Name of the fan or group to change.
+        uint8_t power;                                   ///< New power in percent.
+        bool isGroup;                                    ///< True if `name` is a group, which changes all its fans.
+    };
+
+    FanChange fans[FanConfig::MAX_BATCH_FANS];  ///< Per-fan power changes.
+    uint8_t fanCount;                           ///< Number of valid entries in `fans`.
+    bool hasInterval;                           ///< True if `interval` should be applied.
+    uint16_t interval;                          ///< New interval in seconds.
+    bool hasRuntimeOfFans;                      ///< True if `runtimeOfFans` should be applied.
+    uint16_t runtimeOfFans;                     ///< New runtime in seconds.
+};
+
+/**
+ * @brief Outcome of submitting a command batch.
+ */
+enum class BatchResult : uint8_t {
+    Accepted,       ///< The batch has been queued and will be applied on the next control tick.
+    Empty,          ///< The batch contains no changes.
+    UnknownFan,     ///< A fan or group name does not exist.
+    InvalidValue,   ///< A power, interval or runtime is out of range.
+    QueueFull       ///< Too many batches are waiting to be applied.
+};
+
 /**
  * @class FanManager
  * @brief Manages the creation, initialization, and control of fans.
@@ -20,9 +60,23 @@ using namespace std;
  * The FanManager class is responsible for managing multiple fans, including their creation,
  * initialization, and runtime control. It provides methods to start, stop, and log fan speeds,
  * as well as to set intervals and runtime durations for the fans.
+ * 
+ * The fan task runs a periodic control tick. Power changes from other tasks are queued as 
+ * command batches and applied by the tick, so all hardware access happens on the fan task.
+ * 
+ * A trace replay runs a simulated FanManager of its own: its fans drive no hardware, and it
+ * persists, checkpoints and records nothing, as long as `loadSettings()` and `loadWear()` are
+ * not called. The replay then calls `beginCycle()` and `controlTick()` with a virtual clock.
  */
 class FanManager {
     public:
+        /**
+         * @brief Constructs a FanManager object.
+         * 
+         * @param simulated True for the FanManager of a trace replay.
+         */
+        explicit FanManager(bool simulated = false);
+
         uint16_t getInterval() const;
 
         uint16_t getRuntimeOfFans() const;
@@ -36,14 +90,120 @@ class FanManager {
 
         /**
          * @brief Initializes all fans managed by this FanManager.
+         * 
+         * Simulated fans have no hardware to set up, only the command queue is created for them.
          */
         void initializeAllFans();
 
+        /**
+         * @brief Loads the persisted settings and starts persisting changes.
+         * 
+         * Must be called after the fans have been created and the defaults have been set.
+         * Stored values override the defaults; from now on every setter change is written to 
+         * NVS in the background.
+         */
+        void loadSettings();
+
+        /**
+         * @brief Restores the usage counters of the fans from NVS and starts persisting them.
+         * 
+         * Must be called after the fans have been created. The counters are advanced by every
+         * control tick and written whenever the fans stop and every `WearConfig::SAVE_INTERVAL_MS`.
+         */
+        void loadWear();
+
+        /**
+         * @brief Restores the cycle and the settings from the RTC checkpoint after a warm restart.
+         * 
+         * Must be called after `loadSettings()`, since the checkpoint is newer than NVS. It is
+         * ignored on a cold boot or if the fans have changed; the cycle then starts with the
+         * running phase.
+         * 
+         * @return True if the cycle will resume from the checkpoint.
+         */
+        bool restoreCheckpoint();
+
+        /**
+         * @brief Takes over the settings and the phase of a captured cycle.
+         * 
+         * Used for the RTC checkpoint and by a replay for the state at the start of a trace.
+         * The cycle continues from it with the next `beginCycle()`.
+         * 
+         * @param state The captured cycle.
+         * @return True if the state belongs to these fans and has been taken over.
+         */
+        bool resume(const CycleState& state);
+
+        /**
+         * @brief Returns true if the cycle has been resumed from the checkpoint at boot.
+         */
+        bool wasResumed() const;
+
         /**
          * @brief Runs the main task for managing fans.
+         * 
+         * Starts or resumes the cycle, then executes `controlTick()` every 
+         * `FanConfig::CONTROL_TICK_MS` milliseconds while the fans run. While they rest there are
+         * no tacho pulses to watch, so the task blocks until the next tick has something to do:
+         * the phase ends, a batch arrives or a checkpoint or wear save is due. The chip can stay
+         * in light sleep for that long instead of waking every tick.
          */
         void runTask();
 
+        /**
+         * @brief Starts the cycle, or continues the one taken over by `resume()`.
+         * 
+         * Must be called once before the first `controlTick()`, on the task that runs the ticks.
+         * 
+         * @param now The current time in microseconds.
+         */
+        void beginCycle(int64_t now);
+
+        /**
+         * @brief Applies queued batches and advances the running/resting cycle.
+         * 
+         * Called by `runTask()` with the system time, and by a replay with its virtual clock.
+         * 
+         * @param now The current time in microseconds.
+         */
+        void controlTick(int64_t now);
+
+        /**
+         * @brief Starts recording a trace at the next control tick.
+         * 
+         * The recording begins with a snapshot of the cycle, so a replay starts from the same
+         * state. Safe to call from any task; `TraceRecorder::stop()` ends the recording.
+         */
+        void startTrace();
+
+        /**
+         * @brief Decides whether the current phase of the cycle is over.
+         * 
+         * @param running True in the running phase, false in the resting phase.
+         * @param elapsedMs Time spent in the phase.
+         * @param interval Resting duration in seconds.
+         * @param runtimeOfFans Running duration in seconds.
+         * @return True if the other phase should begin.
+         */
+        static bool isPhaseOver(bool running, int64_t elapsedMs, uint16_t interval, uint16_t runtimeOfFans);
+
+        /**
+         * @brief Returns how late the control ticks ran compared to their schedule.
+         */
+        const JitterHistogram& getTickJitter() const;
+
+        /**
+         * @brief Validates a command batch and queues it for the next control tick.
+         * 
+         * Either every change of the batch is applied or none is: the batch is rejected as a 
+         * whole if any fan is unknown or any value is out of range. Group changes are expanded 
+         * into one change per member fan before the batch is queued.
+         * 
+         * @param batch The changes to apply.
+         * @return `BatchResult::Accepted` if the batch has been queued, the reason otherwise.
+         */
+        BatchResult submitBatch(const FanCommandBatch& batch);
+
         /**
          * @brief Retrieves a fan by its name.
          * 
@@ -53,14 +213,58 @@ class FanManager {
         optional<shared_ptr<IFan>> getFan(const string& name) const;
 
         /**
-         * @brief Retrieves a map of fans.
+         * @brief Retrieves all fans in the order they were created.
+         * 
+         * The list is fixed once the fans have been initialized, so it can be read from any task.
+         * 
+         * @return The fans in creation order.
+         */
+        const vector<shared_ptr<Fan>>& getFans() const;
+
+        /**
+         * @brief Checks whether at least one fan belongs to a group.
          * 
-         * This method returns an unordered map containing the fans, where the key is the fan name 
-         * (as a string) and the value is a shared pointer to an object implementing the IFan interface.
+         * @param group The name of the group.
+         * @return True if the group has members, false otherwise.
+         */
+        bool hasGroup(const char* group) const;
+
+        /**
+         * @brief Sets the configured power of a fan and persists it.
          * 
-         * @return An unordered map of fan names (keys) and corresponding shared pointers to IFan objects (values).
+         * The change is queued as a single-fan batch and applied on the next control tick.
+         * 
+         * @param name The name of the fan.
+         * @param percent The power as a percentage (0-100%).
+         * @return True if the change has been queued, false if the fan does not exist or the queue is full.
+         */
+        bool setFanPower(const string& name, uint8_t percent);
+
+        /**
+         * @brief Sets the configured power of all fans of a group and persists it.
+         * 
+         * The members change together in the next control tick.
+         * 
+         * @param group The name of the group.
+         * @param percent The power as a percentage (0-100%).
+         * @return The outcome of submitting the change.
+         */
+        BatchResult setGroupPower(const string& group, uint8_t percent);
+
+        /**
+         * @brief Returns how long the control ticks took to execute.
+         */
+        const LatencyStats& getTickCost() const;
+
+        /**
+         * @brief Returns the settings store, e.g. for its commit statistics.
          */
-        unordered_map<string, shared_ptr<IFan>> getFans() const;
+        const SettingsStore& getSettingsStore() const;
+
+        /**
+         * @brief Returns the store of the usage counters, e.g. for its commit statistics.
+         */
+        const WearStore& getWearStore() const;
 
         /**
          * @brief Sets the interval for fan operations.
@@ -76,10 +280,125 @@ class FanManager {
          */
         void setRuntimeOfFans(uint16_t new_runtimeOfFans);
 
+        /**
+         * @brief Returns whether the fans are currently in their running phase.
+         */
+        bool isRunning() const;
+
+        /**
+         * @brief Registers a callback invoked whenever the fan state changes.
+         *
+         * The callback runs on the task that caused the change and must not block.
+         * Pass `nullptr` to remove the listener. Returns only once no call of the previous
+         * listener is in progress any more, so whatever it uses may be torn down afterwards.
+         *
+         * @param listener The callback to invoke.
+         */
+        void setStateListener(function<void()> listener);
+
+        /**
+         * @brief Notifies the registered listener that the fan state has changed.
+         */
+        void notifyStateChanged();
+
     private:
-        unordered_map<string, shared_ptr<Fan>> _fans;           ///< A map of fan names to fan objects.
+        bool _simulated;                                        ///< True if the fans only exist in a trace replay.
+        vector<shared_ptr<Fan>> _fans;                          ///< The fans in creation order.
         uint16_t _interval;                                     ///< The interval for fan operations in milliseconds.
         uint16_t _runtimeOfFans;                                ///< The runtime duration for all fans in milliseconds.
+        atomic<bool> _running{false};                           ///< True while the fans are in their running phase, read from other tasks.
+        function<void()> _stateListener;                        ///< Callback invoked on fan state changes.
+        SemaphoreHandle_t _listenerMutex;                       ///< Protects `_stateListener` and `_listenerCalls`.
+        StaticSemaphore_t _listenerMutexBuffer;                 ///< Storage of `_listenerMutex`.
+        uint32_t _listenerCalls = 0;                            ///< Calls of the listener in progress.
+        SettingsStore _settingsStore;                           ///< Persists the settings to NVS.
+        QueueHandle_t _commandQueue = nullptr;                  ///< Batches waiting for the next control tick.
+        StaticQueue<FanCommandBatch, FanConfig::COMMAND_QUEUE_DEPTH> _commandQueueStorage; ///< Storage of `_commandQueue`.
+        int64_t _phaseStartUs = 0;                              ///< Start of the current running or resting phase.
+        JitterHistogram _tickJitter;                            ///< Lateness of the control ticks.
+        LatencyStats _tickCost;                                 ///< Execution time of the control ticks.
+        bool _resumed = false;                                  ///< True if the cycle continues from the checkpoint.
+        uint32_t _resumeElapsedMs = 0;                          ///< Time already spent in the resumed phase.
+        int64_t _lastCheckpointUs = 0;                          ///< Timestamp of the last checkpoint.
+        atomic<bool> _traceRequested{false};                    ///< Set by `startTrace()`, handled by the next tick.
+        WearStore _wearStore;                                   ///< Persists the usage counters to NVS.
+        int64_t _lastWearUs = 0;                                ///< Time up to which the usage counters have been advanced.
+        int64_t _lastWearSaveUs = 0;                            ///< Timestamp of the last handover to the wear store.
+
+        /**
+         * @brief Finds a fan by its name.
+         * 
+         * A linear search, which beats hashing for the handful of fans a controller drives.
+         * 
+         * @param name The name of the fan.
+         * @return The fan, or nullptr if not found.
+         */
+        Fan* findFan(const char* name) const;
+
+        /**
+         * @brief Applies one validated batch.
+         * 
+         * All duty cycles are loaded first and latched afterwards, so the fans change together.
+         * 
+         * @param batch The batch to apply.
+         */
+        void applyBatch(const FanCommandBatch& batch);
+
+        /**
+         * @brief Advances the usage counters of all fans to the given time.
+         * @param now The current time in microseconds.
+         */
+        void accumulateWear(int64_t now);
+
+        /**
+         * @brief Hands the usage counters to the wear store for writing.
+         * @param now The current time in microseconds.
+         */
+        void saveWear(int64_t now);
+
+        /**
+         * @brief Captures the current cycle state.
+         * @param now The current time in microseconds.
+         */
+        CycleState captureState(int64_t now) const;
+
+        /**
+         * @brief Writes the current cycle state to the RTC checkpoint.
+         * @param now The current time in microseconds.
+         */
+        void saveCheckpoint(int64_t now);
+
+        /**
+         * @brief Starts a trace recording with the current state as its header.
+         * @param now The current time in microseconds.
+         */
+        void beginTrace(int64_t now);
+
+        /**
+         * @brief Records a trace event, unless the fans are simulated.
+         * @param type What happened.
+         * @param fan Index of the fan, 0 for events without a fan.
+         * @param value Event specific value.
+         */
+        void record(TraceEventType type, uint8_t fan, uint16_t value);
+
+        /**
+         * @brief Returns the time the resting cycle needs its next tick.
+         * 
+         * The earliest of the end of the resting phase, the next checkpoint and the next handover
+         * to the wear store.
+         */
+        int64_t getRestingDeadlineUs() const;
+
+        /**
+         * @brief Blocks the resting fan task until its next tick is due or a batch is queued.
+         */
+        void waitWhileResting();
+
+        /**
+         * @brief Computes a hash of the fan names, which detects a changed topology.
+         */
+        uint32_t topologyHash() const;
 
         /**
          * @brief Logs the speeds of all fans.
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cJSON.h"
+
+#include "config.hpp"
+
+using namespace std;
+
+/**
+ * @class FanTopology
+ * @brief Describes which fans exist and how they are wired, loaded at runtime.
+ *
+ * The topology is read from a JSON file on SPIFFS, for example:
+ *
+ *     {"fans": [
+ *         {"name": "Front", "pwmPin": 27, "tachoPin": 14, "frequency": 25000, "power": 60, "group": "Top"},
+ *         {"name": "Back", "pwmPin": 32, "tachoPin": 33, "channel": 1}
+ *     ]}
+ *
+ * Only `name` and `pwmPin` are required. Without `tachoPin` the fan has no speed feedback,
+ * `frequency` defaults to `FanConfig::DEFAULT_FREQUENCY`, `power` to 100% and `channel` (0-15) to the next free one.
+ *
+ * Every fan is validated before any hardware is touched: names must be unique, pins usable and
+ * used only once, channels free. LEDC timers are then assigned so that fans with the same
+ * frequency share one timer.
+ */
+class FanTopology {
+    public:
+        /**
+         * @brief Loads and validates the topology from a JSON file.
+         * @param path Path of the file.
+         * @return True if the file described a valid topology, false otherwise.
+         */
+        bool loadFromFile(const char* path);
+
+        /**
+         * @brief Loads the built-in topology of `FanConfig::FAN_FRONT` and `FanConfig::FAN_BACK`.
+         */
+        void loadDefaults();
+
+        /**
+         * @brief Returns the validated fans in definition order.
+         */
+        const vector<FanConfig::Config>& getFans() const;
+
+        /**
+         * @brief Returns why the last load failed.
+         */
+        const string& getError() const;
+
+    private:
+        vector<FanConfig::Config> _fans;  ///< Validated fans with channels and timers assigned.
+        string _error;                    ///< Reason of the last failure.
+
+        /**
+         * @brief Converts one entry of the `fans` array.
+         * @param json The entry.
+         * @param config Receives the fan definition.
+         * @return True if the entry is well-formed, false otherwise.
+         */
+        bool parseFan(const cJSON* json, FanConfig::Config& config);
+
+        /**
+         * @brief Checks names, pins and channels and assigns channels and timers.
+         * @param fans The definitions to check, updated in place.
+         * @return True if the topology is valid, false otherwise.
+         */
+        bool validate(vector<FanConfig::Config>& fans);
+
+        /**
+         * @brief Records a failure.
+         * @param format printf-style description.
+         * @return Always false, for use in return statements.
+         */
+        bool fail(const char* format, ...);
+};
@@ -16,7 +16,8 @@ class IFan{
          * @brief Sets the power of the fan.
          * 
          * This method allows setting the fan power as a percentage (0-100%) where 0% is off 
-         * and 100% is full power.
+         * and 100% is full power. The power is kept as the fan's configured power across
+         * start and stop cycles.
          * 
          * @param percent The desired fan power as a percentage (0-100%).
          */
@@ -25,11 +26,12 @@ class IFan{
         /**
          * @brief Gets the current speed of the fan.
          * 
-         * This method returns the current fan speed in RPM.
+         * This method returns the fan speed in RPM of the last completed measurement window.
+         * It only reads the stored value and is safe to call from any task.
          * 
          * @return The current fan speed.
          */
-        virtual uint16_t getSpeed() = 0;
+        virtual uint16_t getLastSpeed() const = 0;
 
         /**
          * @brief Returns the configuration settings for the fan.
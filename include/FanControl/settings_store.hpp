@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "config.hpp"
+
+/**
+ * @brief Persisted settings of one fan.
+ */
+struct StoredFanSettings {
+    char name[SettingsConfig::MAX_FAN_NAME_LENGTH];  ///< Name of the fan the settings belong to.
+    uint8_t fanPower;                                ///< Configured fan power in percent.
+};
+
+/**
+ * @brief Versioned layout of the settings blob in NVS.
+ *
+ * The whole blob is read with a single NVS access at boot. Any change of this layout must
+ * increment `SettingsConfig::BLOB_VERSION`; blobs with another version are ignored.
+ */
+struct StoredSettings {
+    uint16_t version;                                           ///< Layout version of the blob.
+    uint16_t interval;                                          ///< Fan interval in seconds.
+    uint16_t runtimeOfFans;                                     ///< Fan runtime in seconds.
+    uint8_t fanCount;                                           ///< Number of valid entries in `fans`.
+    StoredFanSettings fans[SettingsConfig::MAX_STORED_FANS];    ///< Per-fan settings.
+};
+
+/**
+ * @class SettingsStore
+ * @brief Keeps the fan settings in RAM and persists them to NVS in the background.
+ *
+ * Setters only update the RAM mirror and mark it dirty. Changes are coalesced and written by
+ * a one-shot timer once no further change has happened for `SettingsConfig::COMMIT_DELAY_MS`,
+ * but at the latest `SettingsConfig::MAX_COMMIT_DELAY_MS` after the first pending change. This
+ * keeps flash writes off the request path and limits NVS wear when a slider is dragged.
+ * Setters are ignored until `init()` has been called, so defaults applied during startup are
+ * not written back.
+ */
+class SettingsStore {
+    public:
+        /**
+         * @brief Loads the settings from NVS with a single read.
+         *
+         * Entries missing from the stored blob keep the values already in `settings`.
+         *
+         * @param settings Holds the defaults on entry and the stored settings on return.
+         * @return True if a blob with the current layout version was found.
+         */
+        bool load(StoredSettings& settings);
+
+        /**
+         * @brief Initializes the RAM mirror and the commit timer.
+         * @param settings The settings currently in effect.
+         */
+        void init(const StoredSettings& settings);
+
+        /**
+         * @brief Updates the stored interval.
+         * @param interval The interval in seconds.
+         */
+        void setInterval(uint16_t interval);
+
+        /**
+         * @brief Updates the stored runtime.
+         * @param runtimeOfFans The runtime in seconds.
+         */
+        void setRuntimeOfFans(uint16_t runtimeOfFans);
+
+        /**
+         * @brief Updates the stored power of a fan.
+         * @param name The name of the fan.
+         * @param fanPower The power in percent.
+         */
+        void setFanPower(const char* name, uint8_t fanPower);
+
+        /**
+         * @brief Writes pending changes to NVS immediately.
+         */
+        void flush();
+
+        /**
+         * @brief Returns the number of NVS commits since boot.
+         */
+        uint32_t getCommitCount() const;
+
+        /**
+         * @brief Returns the number of changes since boot, each commit covers one or more.
+         */
+        uint32_t getChangeCount() const;
+
+    private:
+        StoredSettings _settings = {};              ///< RAM mirror of the settings.
+        SemaphoreHandle_t _mutex = nullptr;         ///< Protects the mirror and the dirty state.
+        StaticSemaphore_t _mutexBuffer;             ///< Storage of `_mutex`.
+        esp_timer_handle_t _commitTimer = nullptr;  ///< One-shot timer performing the commit.
+        bool _dirty = false;                        ///< True if the mirror differs from NVS.
+        int64_t _firstDirtyUs = 0;                  ///< Time of the first change not yet committed.
+        uint32_t _commits = 0;                      ///< Number of NVS commits.
+        uint32_t _changes = 0;                      ///< Number of changes to the mirror.
+
+        /**
+         * @brief Marks the mirror dirty and (re)arms the commit timer. Mutex must be held.
+         */
+        void scheduleCommit();
+
+        /**
+         * @brief Writes the mirror to NVS if it is dirty.
+         */
+        void commit();
+
+        /**
+         * @brief Commit timer callback.
+         * @param arg Pointer to the `SettingsStore` instance.
+         */
+        static void commit_timer_callback(void* arg);
+};
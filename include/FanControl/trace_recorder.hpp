@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "config.hpp"
+#include "FanControl/cycle_checkpoint.hpp"
+
+/**
+ * @brief Kind of a recorded event.
+ */
+enum class TraceEventType : uint8_t {
+    TachoEdge,      ///< A tacho pulse of `fan`.
+    Duty,           ///< The PWM output of `fan` changed to `value` percent.
+    Power,          ///< A command set the configured power of `fan` to `value` percent.
+    Interval,       ///< A command set the interval to `value` seconds.
+    RuntimeOfFans,  ///< A command set the runtime to `value` seconds.
+    Phase           ///< The cycle entered the running (`value` 1) or resting (`value` 0) phase.
+};
+
+/**
+ * @brief One recorded event, stored in the trace file as is.
+ */
+struct TraceEvent {
+    uint32_t timeUs;        ///< Time since the start of the recording.
+    TraceEventType type;    ///< What happened.
+    uint8_t fan;            ///< Index of the fan in creation order, 0 for events without a fan.
+    uint16_t value;         ///< Event specific value.
+};
+
+static_assert(sizeof(TraceEvent) == 8, "TraceEvent is stored in the trace file");
+
+/**
+ * @brief The start of a trace file, describing the fans and the cycle when the recording began.
+ */
+struct TraceHeader {
+    uint32_t magic;                                             ///< Marks a trace file.
+    uint16_t version;                                           ///< Layout version of the file.
+    uint16_t controlTickMs;                                     ///< Control tick period of the recording firmware.
+    uint16_t tachoMask;                                         ///< Bit i is set if fan i has a tacho signal.
+    CycleState state;                                           ///< The cycle at the start of the recording.
+    char names[FanConfig::MAX_FANS][FanConfig::MAX_NAME_LENGTH];  ///< Fan names in creation order.
+};
+
+/**
+ * @brief Counters describing the current or last recording.
+ */
+struct TraceStats {
+    bool active;            ///< True while events are recorded.
+    uint32_t events;        ///< Events recorded.
+    uint32_t dropped;       ///< Events lost because the buffer was full.
+    uint32_t bytesWritten;  ///< Size of the trace file.
+};
+
+/**
+ * @class TraceRecorder
+ * @brief Records tacho edges, duty changes and commands into a trace file on SPIFFS.
+ *
+ * Events are appended to a RAM ring from the tacho ISRs and the fan task, guarded by a spinlock,
+ * and written to `TraceConfig::PATH` by a periodic timer every `TraceConfig::FLUSH_INTERVAL_MS`,
+ * so no flash access happens in the control path. If the ring fills up between two flushes,
+ * further events are dropped and counted. A recording ends when stopped, after
+ * `TraceConfig::MAX_DURATION_MS` or once the file reaches `TraceConfig::MAX_FILE_SIZE`; the time
+ * limit keeps the 32 bit timestamps from wrapping.
+ *
+ * The file holds a `TraceHeader` followed by `TraceEvent`s in the order they were recorded.
+ */
+class TraceRecorder {
+    public:
+        // "FTRC", identifies a trace file
+        static constexpr uint32_t FILE_MAGIC = 0x46545243;
+
+        // Increment whenever TraceHeader or TraceEvent changes
+        static constexpr uint16_t FILE_VERSION = 1;
+
+        /**
+         * @brief Starts a new recording, replacing the previous trace file.
+         *
+         * Must be called on the fan task, between two control ticks, so the header matches the
+         * state the events start from.
+         *
+         * @param header The fans and the cycle state; magic, version and tick are filled in.
+         */
+        static void begin(const TraceHeader& header);
+
+        /**
+         * @brief Ends the recording. The buffered events are still written. Safe to call from any task.
+         */
+        static void stop();
+
+        /**
+         * @brief Returns true while events are recorded or the trace file is still being written.
+         */
+        static bool isActive();
+
+        /**
+         * @brief Records an event from task context. Does nothing unless a recording is active.
+         * @param type What happened.
+         * @param fan Index of the fan, 0 for events without a fan.
+         * @param value Event specific value.
+         */
+        static void record(TraceEventType type, uint8_t fan, uint16_t value);
+
+        /**
+         * @brief Records an event from an ISR. Does nothing unless a recording is active.
+         * @param type What happened.
+         * @param fan Index of the fan.
+         * @param value Event specific value.
+         */
+        IRAM_ATTR static void recordFromISR(TraceEventType type, uint8_t fan, uint16_t value);
+
+        /**
+         * @brief Returns the counters of the current or last recording.
+         */
+        static TraceStats getStats();
+
+    private:
+        static TraceEvent _events[TraceConfig::BUFFER_EVENTS];  ///< Ring of events not yet written.
+        static size_t _head;                                    ///< Index of the oldest buffered event.
+        static size_t _count;                                   ///< Number of buffered events.
+        static portMUX_TYPE _lock;                              ///< Guards the ring and the counters.
+        static volatile bool _active;                           ///< True while events are recorded.
+        static bool _headerPending;                             ///< True until the flush has created the file.
+        static int64_t _startUs;                                ///< Start of the recording.
+        static TraceHeader _header;                             ///< Header of the current recording.
+        static TraceStats _stats;                               ///< Counters of the current recording.
+        static FILE* _file;                                     ///< The open trace file, only used by the flush timer.
+        static esp_timer_handle_t _flushTimer;                  ///< Writes the ring to the file.
+
+        /**
+         * @brief Appends an event to the ring. The lock must be held.
+         */
+        IRAM_ATTR static void append(TraceEventType type, uint8_t fan, uint16_t value);
+
+        /**
+         * @brief Writes the buffered events and closes the file once the recording has ended.
+         */
+        static void flush();
+
+        /**
+         * @brief Flush timer callback.
+         * @param arg Unused.
+         */
+        static void flush_timer_callback(void* arg);
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "config.hpp"
+#include "FanControl/fan_manager.hpp"
+#include "FanControl/trace_recorder.hpp"
+
+using namespace std;
+
+/**
+ * @brief What a replay found out about one fan.
+ */
+struct TraceFanSummary {
+    char name[FanConfig::MAX_NAME_LENGTH];  ///< Name of the fan.
+    bool hasTacho;                          ///< True if the fan has a tacho signal.
+    uint32_t edges;                         ///< Tacho edges in the trace.
+    uint16_t minRpm;                        ///< Lowest speed of a measurement window with pulses.
+    uint16_t maxRpm;                        ///< Highest speed of a measurement window.
+    uint32_t rpmSum;                        ///< Sum of the speeds of the windows with pulses.
+    uint32_t rpmWindows;                    ///< Number of windows with pulses.
+    uint32_t stalls;                        ///< Windows spent entirely running with power but without a pulse.
+    uint32_t dutyChanges;                   ///< Recorded changes of the PWM output.
+};
+
+/**
+ * @brief Outcome of replaying a trace.
+ */
+struct TraceReplayResult {
+    CycleState start;                           ///< The cycle at the start of the recording.
+    uint32_t events;                            ///< Events replayed.
+    uint32_t ticks;                             ///< Control ticks simulated.
+    uint32_t durationUs;                        ///< Recorded time covered by the trace.
+    uint32_t cpuUs;                             ///< Time the replay took, including reading the file.
+    uint32_t transitions;                       ///< Phase transitions in the recording.
+    uint32_t mismatches;                        ///< Replayed transitions that differ from the recorded ones.
+    uint32_t maxDeviationUs;                    ///< Largest offset between a recorded and a replayed transition.
+    uint32_t dutyMismatches;                    ///< Recorded duties that are neither off nor the replayed configured power.
+    uint8_t fanCount;                           ///< Number of valid entries in `fans`.
+    TraceFanSummary fans[FanConfig::MAX_FANS];  ///< Per-fan results.
+};
+
+/**
+ * @class TraceReplayer
+ * @brief Feeds a recorded trace through the control logic on a virtual clock.
+ *
+ * The clock jumps from event to event instead of waiting, so a trace replays much faster than
+ * it was recorded. A simulated `FanManager` is built from the fans in the header, resumed from
+ * the recorded cycle state and ticked every recorded control tick period with the virtual
+ * time, so the replay runs the same `controlTick()` and `applyBatch()` as the fan task. The
+ * recorded commands are submitted to it as batches, and tacho edges are counted by its fans.
+ * Its phase transitions are compared with the recorded ones, allowing
+ * `TraceConfig::REPLAY_TOLERANCE_TICKS` of scheduling jitter. Tacho edges are also counted in
+ * windows of `FanConfig::TACHO_UPDATE_CYCLE` and converted with `Fan::rpmFromPulses()`, like
+ * the live measurement.
+ *
+ * A control change can thus be checked against field traces: a replay of a trace recorded by
+ * the previous firmware reports mismatches where the new logic decides differently.
+ */
+class TraceReplayer {
+    public:
+        /**
+         * @brief Replays a trace file.
+         * @param path The trace file.
+         * @return True if the trace has been replayed completely, see `getError()` otherwise.
+         */
+        bool run(const char* path);
+
+        /**
+         * @brief Returns the outcome of the last replay.
+         */
+        const TraceReplayResult& getResult() const;
+
+        /**
+         * @brief Returns why the last replay failed.
+         */
+        const char* getError() const;
+
+    private:
+        /**
+         * @brief A phase transition waiting to be matched with its counterpart.
+         */
+        struct Transition {
+            uint32_t timeUs;    ///< When the transition happened.
+            bool running;       ///< The phase that began.
+        };
+
+        // Transitions of one side that may wait for the other side
+        static constexpr size_t MAX_PENDING_TRANSITIONS = 4;
+
+        TraceReplayResult _result = {};                             ///< Outcome of the replay.
+        const char* _error = nullptr;                               ///< Reason of a failed replay.
+        TraceEvent _chunk[TraceConfig::REPLAY_CHUNK_EVENTS];        ///< Events read from the file.
+        unique_ptr<FanManager> _manager;                            ///< The simulated fans and cycle.
+        FanCommandBatch _commands = {};                             ///< Recorded commands not yet submitted.
+        bool _running = false;                                      ///< Phase of the simulated cycle after the last tick.
+        int64_t _phaseStartUs = 0;                                  ///< Start of the simulated phase, may precede the trace.
+        uint32_t _tickUs = 0;                                       ///< Period of the simulated control tick.
+        int64_t _nextTickUs = 0;                                    ///< Time of the next simulated tick.
+        int64_t _windowEndUs = 0;                                   ///< End of the current tacho window.
+        uint32_t _pulses[FanConfig::MAX_FANS] = {};                 ///< Tacho edges in the current window.
+        Transition _recorded[MAX_PENDING_TRANSITIONS];              ///< Recorded transitions not yet matched.
+        size_t _recordedCount = 0;                                  ///< Number of entries in `_recorded`.
+        Transition _replayed[MAX_PENDING_TRANSITIONS];              ///< Replayed transitions not yet matched.
+        size_t _replayedCount = 0;                                  ///< Number of entries in `_replayed`.
+
+        /**
+         * @brief Builds the simulated fans and cycle from the header of a trace.
+         * @return True if the recorded cycle state could be taken over.
+         */
+        bool reset(const TraceHeader& header);
+
+        /**
+         * @brief Runs the ticks and closes the tacho windows due up to a point in time.
+         * @param timeUs The time to advance to.
+         */
+        void advance(int64_t timeUs);
+
+        /**
+         * @brief Runs one control tick of the simulated cycle and notes its phase transition.
+         * @param nowUs The time of the tick.
+         */
+        void tick(int64_t nowUs);
+
+        /**
+         * @brief Submits the collected commands and applies them in the tick they were recorded in.
+         * @return False if the simulated fans rejected the commands.
+         */
+        bool submitCommands();
+
+        /**
+         * @brief Converts the pulses of the ending tacho window into speeds.
+         */
+        void closeWindow();
+
+        /**
+         * @brief Applies one recorded event to the simulation.
+         * @return False if the event does not fit the trace.
+         */
+        bool apply(const TraceEvent& event);
+
+        /**
+         * @brief Queues a transition and matches it with the other side if possible.
+         * @param transition The transition.
+         * @param recorded True if it comes from the recording, false if from the simulation.
+         */
+        void addTransition(const Transition& transition, bool recorded);
+};
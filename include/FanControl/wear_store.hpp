@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "config.hpp"
+#include "FanControl/fan.hpp"
+
+using namespace std;
+
+/**
+ * @brief Persisted usage counters of one fan.
+ */
+struct StoredFanWear {
+    char name[FanConfig::MAX_NAME_LENGTH];  ///< Name of the fan the counters belong to.
+    FanWear wear;                           ///< The counters.
+};
+
+/**
+ * @brief Versioned layout of the counter blob in NVS.
+ *
+ * Any change of this layout must increment `WearConfig::BLOB_VERSION`; blobs with another
+ * version are ignored and the counters start from zero.
+ */
+struct StoredWear {
+    uint16_t version;                           ///< Layout version of the blob.
+    uint8_t fanCount;                           ///< Number of valid entries in `fans`.
+    StoredFanWear fans[FanConfig::MAX_FANS];    ///< Per-fan counters in creation order.
+};
+
+/**
+ * @class WearStore
+ * @brief Persists the fan usage counters to NVS.
+ *
+ * The control loop hands over the counters at its own pace; the blob is written by a timer on
+ * the esp_timer task, so the flash write never delays a control tick. Counters are matched by
+ * fan name, so they follow a fan when the topology file is reordered.
+ */
+class WearStore {
+    public:
+        /**
+         * @brief Initializes the mirror and the commit timer and restores the stored counters.
+         *
+         * The blob is read with a single NVS access; fans without stored counters start from zero.
+         *
+         * @param fans The fans in creation order.
+         * @return True if a blob with the current layout version was found.
+         */
+        bool init(const vector<shared_ptr<Fan>>& fans);
+
+        /**
+         * @brief Updates the counters of a fan in the RAM mirror.
+         * @param index Position of the fan in creation order.
+         * @param wear The counters.
+         */
+        void setFanWear(uint8_t index, const FanWear& wear);
+
+        /**
+         * @brief Writes the mirror to NVS in the background.
+         */
+        void requestCommit();
+
+        /**
+         * @brief Returns the number of NVS commits since boot.
+         */
+        uint32_t getCommitCount() const;
+
+    private:
+        StoredWear _wear = {};                      ///< RAM mirror of the counters.
+        StoredWear _snapshot = {};                  ///< Blob being read or written, keeps it off the task stacks.
+        SemaphoreHandle_t _mutex = nullptr;         ///< Protects the mirror.
+        StaticSemaphore_t _mutexBuffer;             ///< Storage of `_mutex`.
+        esp_timer_handle_t _commitTimer = nullptr;  ///< One-shot timer performing the commit.
+        uint32_t _commits = 0;                      ///< Number of NVS commits.
+
+        /**
+         * @brief Writes the mirror to NVS.
+         */
+        void commit();
+
+        /**
+         * @brief Commit timer callback.
+         * @param arg Pointer to the `WearStore` instance.
+         */
+        static void commit_timer_callback(void* arg);
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class CborWriter
+ * @brief Encodes CBOR (RFC 8949) into a caller-provided buffer without allocating.
+ *
+ * Only the subset the API needs is supported: unsigned integers, text strings, booleans and
+ * arrays and maps of known length. Writing past the end of the buffer stops the encoding and
+ * marks the writer as overflowed; the output is then incomplete and must not be sent.
+ */
+class CborWriter {
+    public:
+        /**
+         * @brief Constructs a CborWriter object.
+         * @param buffer The memory to encode into.
+         * @param capacity Size of the buffer in bytes.
+         */
+        CborWriter(uint8_t* buffer, size_t capacity);
+
+        /**
+         * @brief Starts an array, followed by `count` items.
+         * @param count Number of items.
+         */
+        void beginArray(size_t count);
+
+        /**
+         * @brief Starts a map, followed by `count` key/value pairs.
+         * @param count Number of pairs.
+         */
+        void beginMap(size_t count);
+
+        /**
+         * @brief Writes an unsigned integer in the shortest form.
+         * @param value The value.
+         */
+        void writeUnsigned(uint64_t value);
+
+        /**
+         * @brief Writes a zero-terminated UTF-8 text string.
+         * @param text The text.
+         */
+        void writeText(const char* text);
+
+        /**
+         * @brief Writes a boolean.
+         * @param value The value.
+         */
+        void writeBool(bool value);
+
+        /**
+         * @brief Returns the number of bytes written.
+         */
+        size_t getLength() const;
+
+        /**
+         * @brief Returns true if the buffer was too small for the encoded data.
+         */
+        bool hasOverflowed() const;
+
+    private:
+        uint8_t* _buffer;   ///< Output buffer.
+        size_t _capacity;   ///< Size of the output buffer.
+        size_t _length;     ///< Bytes written so far.
+        bool _overflowed;   ///< True once a write did not fit.
+
+        /**
+         * @brief Writes the initial byte of a data item and its argument.
+         * @param majorType CBOR major type (0-7).
+         * @param argument The value, length or count of the item.
+         */
+        void writeHead(uint8_t majorType, uint64_t argument);
+
+        /**
+         * @brief Appends raw bytes.
+         * @param data The bytes.
+         * @param length Number of bytes.
+         */
+        void append(const void* data, size_t length);
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cJSON.h"
+
+#include "cbor_writer.hpp"
+
+/**
+ * @brief Type of a field value, decides how it is encoded.
+ */
+enum class FieldType : uint8_t {
+    Text,
+    Unsigned,
+    Bool
+};
+
+/**
+ * @brief A field value read from an object, independent of the wire format.
+ */
+struct FieldValue {
+    FieldType type;     ///< How the value is encoded.
+    const char* text;   ///< The value of a `Text` field.
+    uint64_t number;    ///< The value of an `Unsigned` or `Bool` field.
+
+    static constexpr FieldValue ofText(const char* value) { return {FieldType::Text, value, 0}; }
+    static constexpr FieldValue ofUnsigned(uint64_t value) { return {FieldType::Unsigned, nullptr, value}; }
+    static constexpr FieldValue ofBool(bool value) { return {FieldType::Bool, nullptr, value ? 1u : 0u}; }
+};
+
+/**
+ * @brief Describes one field of an API object: its key and how to read it.
+ *
+ * A table of descriptors defines an object once for every wire format, so the JSON and
+ * CBOR representations cannot drift apart.
+ *
+ * @tparam Source Type of the object the field is read from.
+ */
+template<typename Source>
+struct FieldDescriptor {
+    const char* key;                     ///< Name of the field in the encoded object.
+    FieldValue (*read)(Source& source);  ///< Reads the current value.
+};
+
+/**
+ * @brief Adds the described fields of an object to a JSON object.
+ * @param object The JSON object to add to.
+ * @param fields The field descriptors.
+ * @param source The object to read.
+ */
+template<typename Source, size_t N>
+void addFieldsToJSON(cJSON* object, const FieldDescriptor<Source> (&fields)[N], Source& source) {
+    for (const auto& field : fields) {
+        FieldValue value = field.read(source);
+        switch (value.type) {
+        case FieldType::Text:
+            cJSON_AddStringToObject(object, field.key, value.text);
+            break;
+        case FieldType::Unsigned:
+            cJSON_AddNumberToObject(object, field.key, value.number);
+            break;
+        case FieldType::Bool:
+            cJSON_AddBoolToObject(object, field.key, value.number != 0);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Writes the described fields of an object as a CBOR map.
+ * @param writer The writer to encode with.
+ * @param fields The field descriptors.
+ * @param source The object to read.
+ */
+template<typename Source, size_t N>
+void writeFieldsToCbor(CborWriter& writer, const FieldDescriptor<Source> (&fields)[N], Source& source) {
+    writer.beginMap(N);
+    for (const auto& field : fields) {
+        FieldValue value = field.read(source);
+        writer.writeText(field.key);
+        switch (value.type) {
+        case FieldType::Text:
+            writer.writeText(value.text);
+            break;
+        case FieldType::Unsigned:
+            writer.writeUnsigned(value.number);
+            break;
+        case FieldType::Bool:
+            writer.writeBool(value.number != 0);
+            break;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.hpp"
+
+/**
+ * @class FleetAuth
+ * @brief Signs the fleet announcements and rejects forged and replayed ones.
+ *
+ * Every announcement is followed by a newline and the HMAC-SHA256 of the announcement under the
+ * fleet key, as 64 hex characters. The key is shared by all dryers of a fleet and kept in NVS;
+ * a datagram whose signature does not match is dropped before it is parsed.
+ *
+ * A valid datagram can still be recorded and sent again later. Every announcement therefore
+ * carries the boot epoch of its sender, a counter in NVS that grows with every start, and a
+ * sequence number that grows with every announcement. Per sender the highest pair seen is
+ * remembered, and anything not newer is dropped.
+ */
+class FleetAuth {
+    public:
+        /**
+         * @brief Length of the signature appended to an announcement, including the newline.
+         */
+        static constexpr size_t SIGNATURE_LENGTH = 1 + 2 * 32;
+
+        /**
+         * @brief Loads the fleet key from NVS.
+         * @return True if a key is configured.
+         */
+        bool load();
+
+        /**
+         * @brief Uses a key for signing and checking from now on.
+         * @param key `FleetConfig::KEY_SIZE` bytes.
+         */
+        void useKey(const uint8_t* key);
+
+        /**
+         * @brief Returns true once a key is in use.
+         */
+        bool hasKey() const;
+
+        /**
+         * @brief Writes the fleet key to NVS.
+         * @param key `FleetConfig::KEY_SIZE` bytes.
+         * @return True if the key has been committed.
+         */
+        static bool storeKey(const uint8_t* key);
+
+        /**
+         * @brief Parses a key given as hex characters.
+         * @param hex The key, `2 * FleetConfig::KEY_SIZE` hex characters.
+         * @param length Number of characters in `hex`.
+         * @param key Receives `FleetConfig::KEY_SIZE` bytes.
+         * @return True if the key is valid.
+         */
+        static bool parseKey(const char* hex, size_t length, uint8_t* key);
+
+        /**
+         * @brief Counts up the boot epoch in NVS.
+         * @return The epoch of this boot, 0 if it could not be stored.
+         */
+        static uint32_t nextEpoch();
+
+        /**
+         * @brief Appends the signature to an announcement.
+         * @param datagram The announcement, followed by room for the signature.
+         * @param length Length of the announcement.
+         * @param size Size of the buffer.
+         * @return The length of the signed datagram, 0 if there is no key or no room.
+         */
+        size_t sign(char* datagram, size_t length, size_t size) const;
+
+        /**
+         * @brief Checks the signature of a received datagram.
+         * @param datagram The datagram.
+         * @param length Length of the datagram.
+         * @return The length of the announcement without its signature, 0 if the signature is
+         *         missing or wrong.
+         */
+        size_t verify(const char* datagram, size_t length) const;
+
+        /**
+         * @brief Checks that an announcement is newer than the last one accepted from its sender.
+         * @param id Device id of the sender.
+         * @param epoch Boot epoch of the sender.
+         * @param sequence Sequence number of the announcement within the epoch.
+         * @return True if the announcement is new, it is then remembered as the latest.
+         */
+        bool acceptSequence(const char* id, uint32_t epoch, uint32_t sequence);
+
+    private:
+        /**
+         * @brief The latest announcement accepted from a sender.
+         */
+        struct Sender {
+            char id[7];         ///< Device id, empty for a free entry.
+            uint32_t epoch;     ///< Boot epoch of the announcement.
+            uint32_t sequence;  ///< Sequence number of the announcement.
+        };
+
+        uint8_t _key[FleetConfig::KEY_SIZE] = {};           ///< The shared fleet key.
+        bool _hasKey = false;                               ///< True once `_key` is valid.
+        Sender _senders[FleetConfig::MAX_SENDERS] = {};     ///< Latest announcement per sender.
+        size_t _nextEviction = 0;                           ///< Entry replaced when a new sender does not fit.
+
+        /**
+         * @brief Computes the signature of an announcement as hex characters.
+         * @param payload The announcement.
+         * @param length Length of the announcement.
+         * @param hex Receives 64 hex characters, not terminated.
+         */
+        void computeMac(const char* payload, size_t length, char* hex) const;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cJSON.h"
+#include "mongoose.h"
+
+#include "config.hpp"
+#include "FanControl/fan_manager.hpp"
+#include "Network/fleet_auth.hpp"
+
+/**
+ * @brief The last reported state of a fan of another node.
+ */
+struct FleetFan {
+    char name[FanConfig::MAX_NAME_LENGTH];  ///< Name of the fan.
+    uint16_t rpm;                           ///< Measured speed.
+    uint8_t power;                          ///< Configured power in percent.
+};
+
+/**
+ * @brief Another dryer on the network, as known from its last announcement.
+ */
+struct FleetNode {
+    char id[7];                             ///< Device id of the node.
+    char address[16];                       ///< IPv4 address the announcement came from.
+    uint16_t port;                          ///< Port of the node's web server.
+    int64_t lastSeenUs;                     ///< Timestamp of the last announcement.
+    bool running;                           ///< True if the fans were in their running phase.
+    char configFrom[7];                     ///< Coordinator whose configuration the node applied last, empty if none.
+    uint32_t configEpoch;                   ///< Boot epoch of that coordinator when it distributed the configuration.
+    uint32_t configVersion;                 ///< Version of that configuration within the epoch.
+    uint8_t fanCount;                       ///< Number of valid entries in `fans`.
+    FleetFan fans[FanConfig::MAX_FANS];     ///< The node's fans.
+};
+
+/**
+ * @brief Counters describing the fleet traffic.
+ */
+struct FleetStats {
+    uint32_t announcementsSent;     ///< Announcements multicast by this node.
+    uint32_t announcementsReceived; ///< Announcements received from other nodes.
+    uint32_t announcementsRejected; ///< Datagrams dropped for a wrong signature or as a replay.
+    uint32_t configsPushed;         ///< Configurations accepted for the fleet while coordinator.
+    uint32_t configsApplied;        ///< Configurations received from the coordinator and applied.
+    uint32_t coordinatorChanges;    ///< Times a different node became coordinator.
+};
+
+/**
+ * @class FleetManager
+ * @brief Finds the other dryers on the network and keeps their configuration in step.
+ *
+ * Runs on the Mongoose event loop of the web server. Every node multicasts an announcement with
+ * its fan state every `FleetConfig::ANNOUNCE_INTERVAL_MS` and listens to the announcements of the
+ * others, so every node knows the whole fleet without any configuration.
+ *
+ * The node with the lowest device id is the coordinator; since every node sees the same
+ * announcements, all of them agree without further messages, and a new coordinator takes over
+ * as soon as the old one times out. A configuration posted to the coordinator is applied
+ * locally and then carried in its announcements until every member reports having applied it.
+ * Members apply the parts that concern fans or groups they have and ignore the rest.
+ *
+ * Versions count from 1 again after a restart, so every configuration is identified by its
+ * coordinator, its boot epoch and the version within that epoch. A restarted coordinator thus
+ * cannot be mistaken for one whose configuration has already been applied, and a configuration
+ * older than the applied one is ignored.
+ *
+ * Announcements are signed with the fleet key by `FleetAuth`, since they decide the coordinator
+ * and carry its configuration; unsigned, forged and replayed datagrams are dropped. Without a
+ * key in NVS the node neither announces nor listens and coordinates only itself.
+ */
+class FleetManager {
+    public:
+        /**
+         * @brief Constructs a FleetManager object.
+         * @param mgr The Mongoose event manager the fleet traffic runs on.
+         * @param fanManager Reference to the FanManager that is reported and configured.
+         * @param httpPort Port of the local web server, announced to the other nodes.
+         */
+        FleetManager(mg_mgr& mgr, FanManager& fanManager, uint16_t httpPort);
+
+        /**
+         * @brief Joins the multicast group and starts announcing.
+         */
+        void start();
+
+        /**
+         * @brief Stops announcing and closes the sockets.
+         */
+        void stop();
+
+        /**
+         * @brief Stores a new fleet key and starts announcing if the fleet was disabled.
+         * @param key `FleetConfig::KEY_SIZE` bytes, the same on every dryer of the fleet.
+         * @return True if the key has been stored.
+         */
+        bool setKey(const uint8_t* key);
+
+        /**
+         * @brief Returns true if a fleet key is configured and the node takes part in the fleet.
+         */
+        bool isEnabled() const;
+
+        /**
+         * @brief Returns the device id of this node.
+         */
+        const char* getSelfId() const;
+
+        /**
+         * @brief Returns the device id of the current coordinator.
+         */
+        const char* getCoordinatorId() const;
+
+        /**
+         * @brief Returns true if this node is the coordinator.
+         */
+        bool isCoordinator() const;
+
+        /**
+         * @brief Returns the number of other nodes currently known.
+         */
+        size_t getNodeCount() const;
+
+        /**
+         * @brief Returns another node.
+         * @param index Index of the node, less than `getNodeCount()`.
+         */
+        const FleetNode& getNode(size_t index) const;
+
+        /**
+         * @brief Finds another node by its device id.
+         * @param id The device id.
+         * @return The node, or nullptr if it is not known.
+         */
+        const FleetNode* findNode(const char* id) const;
+
+        /**
+         * @brief Applies a configuration locally and distributes it to all members.
+         *
+         * Only valid on the coordinator. The configuration is only distributed if it has been
+         * accepted locally.
+         *
+         * @param batch The parsed configuration.
+         * @param json The configuration as received, at most `FleetConfig::MAX_CONFIG_SIZE` bytes.
+         * @return The outcome of applying the configuration locally.
+         */
+        BatchResult pushConfig(const FanCommandBatch& batch, struct mg_str json);
+
+        /**
+         * @brief Returns the traffic counters.
+         */
+        const FleetStats& getStats() const;
+
+    private:
+        mg_mgr& _mgr;                           ///< Mongoose event manager.
+        FanManager& _fanManager;                ///< The local fans.
+        uint16_t _httpPort;                     ///< Port of the local web server.
+        struct mg_connection* _listener;        ///< Receives the announcements, nullptr if not open.
+        struct mg_connection* _sender;          ///< Sends to the multicast group, nullptr if not open.
+        bool _joined;                           ///< True once the listener has joined the multicast group.
+        bool _enabled;                          ///< True while announcing, requires a fleet key.
+        FleetAuth _auth;                        ///< Signs and checks the announcements.
+        struct mg_timer _announceTimer;         ///< Sends the announcements.
+        char _coordinatorId[7];                 ///< Device id of the current coordinator.
+        char _appliedFrom[7];                   ///< Coordinator whose configuration was applied last.
+        uint32_t _appliedEpoch;                 ///< Epoch of that configuration.
+        uint32_t _appliedVersion;               ///< Version of that configuration.
+        uint32_t _epoch;                        ///< Boot counter identifying this boot, sent with every announcement.
+        uint32_t _sequence;                     ///< Number of the last announcement within the epoch.
+        uint32_t _configVersion;                ///< Version of the configuration this node distributes, 0 if none.
+        size_t _configLength;                   ///< Length of `_config`.
+        FleetStats _stats;                      ///< Traffic counters.
+
+        static FleetNode _nodes[FleetConfig::MAX_NODES];       ///< Other known nodes, static to stay off the task stack.
+        static size_t _nodeCount;                              ///< Number of valid entries in `_nodes`.
+        static char _config[FleetConfig::MAX_CONFIG_SIZE];     ///< The configuration this node distributes.
+        static char _datagram[FleetConfig::MAX_DATAGRAM_SIZE]; ///< Encoding buffer of an announcement.
+
+        /**
+         * @brief Handles the events of the fleet sockets.
+         * @param connection Pointer to the connection.
+         * @param event Event type.
+         * @param event_data Event data.
+         */
+        static void handle_event(struct mg_connection* connection, int event, void* event_data);
+
+        /**
+         * @brief Takes the epoch of this boot and starts the announcements.
+         */
+        void enable();
+
+        /**
+         * @brief Opens missing sockets, expires silent nodes, elects the coordinator and announces this node.
+         */
+        void announce();
+
+        /**
+         * @brief Opens the listener and the sender and joins the multicast group, as far as not done yet.
+         */
+        void openSockets();
+
+        /**
+         * @brief Encodes and signs the announcement of this node into `_datagram`.
+         * @param includeConfig True to carry the configuration this node distributes.
+         * @return The encoded length, 0 if it does not fit.
+         */
+        size_t encodeAnnouncement(bool includeConfig);
+
+        /**
+         * @brief Processes a received announcement.
+         * @param connection The listener, whose remote address is the sender.
+         */
+        void handleAnnouncement(struct mg_connection* connection);
+
+        /**
+         * @brief Records the state reported in an announcement.
+         * @param json The announcement.
+         * @param id Device id of the sender.
+         * @param connection The listener, whose remote address is the sender.
+         */
+        void updateNode(const cJSON* json, const char* id, struct mg_connection* connection);
+
+        /**
+         * @brief Applies a configuration carried by the coordinator's announcement, unless it is not newer than the applied one.
+         * @param config The `config` object of the announcement.
+         * @param from Device id of the coordinator.
+         */
+        void applyConfig(const cJSON* config, const char* from);
+
+        /**
+         * @brief Forgets nodes whose last announcement is older than `FleetConfig::NODE_TIMEOUT_MS`.
+         */
+        void expireNodes();
+
+        /**
+         * @brief Makes the node with the lowest device id the coordinator.
+         */
+        void electCoordinator();
+
+        /**
+         * @brief Checks whether a member has not yet applied the configuration this node distributes.
+         */
+        bool isConfigPending() const;
+};
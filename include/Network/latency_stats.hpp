@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @class LatencyStats
+ * @brief Accumulates request latencies for one route.
+ *
+ * Latency is measured from the moment the event loop receives the request until the response
+ * has been handed to Mongoose, so queueing time on a worker is included.
+ */
+class LatencyStats {
+    public:
+        /**
+         * @brief Records one request latency.
+         * @param latencyUs The latency in microseconds.
+         */
+        void record(uint32_t latencyUs);
+
+        /**
+         * @brief Returns the number of recorded requests.
+         */
+        uint32_t getCount() const;
+
+        /**
+         * @brief Returns the average latency in microseconds.
+         */
+        uint32_t getAverageUs() const;
+
+        /**
+         * @brief Returns the maximum latency in microseconds.
+         */
+        uint32_t getMaxUs() const;
+
+        /**
+         * @brief Returns the latency of the most recent request in microseconds.
+         */
+        uint32_t getLastUs() const;
+
+    private:
+        uint32_t _count = 0;    ///< Number of recorded requests.
+        uint64_t _totalUs = 0;  ///< Sum of all latencies.
+        uint32_t _maxUs = 0;    ///< Maximum latency.
+        uint32_t _lastUs = 0;   ///< Latency of the most recent request.
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mongoose.h"
+
+#include "config.hpp"
+#include "FanControl/fan_manager.hpp"
+
+/**
+ * @brief The fan state at one point in time.
+ */
+struct TelemetrySample {
+    uint32_t uptimeS;                     ///< Seconds since boot when the sample was taken.
+    bool running;                         ///< True if the fans were in their running phase.
+    uint16_t rpm[FanConfig::MAX_FANS];    ///< Measured speed per fan in creation order.
+    uint8_t power[FanConfig::MAX_FANS];   ///< Configured power per fan in percent.
+};
+
+/**
+ * @brief Counters describing the telemetry delivery.
+ */
+struct MqttStats {
+    bool connected;          ///< True while a broker session is established.
+    uint32_t connects;       ///< Sessions established since boot.
+    uint32_t frames;         ///< Frames acknowledged by the broker.
+    uint32_t retransmits;    ///< Frames sent again because the acknowledgement was missing.
+    uint32_t queued;         ///< Samples waiting to be published.
+    uint32_t dropped;        ///< Samples dropped because the queue was full.
+    uint32_t commands;       ///< Command batches received.
+    uint32_t rejected;       ///< Command batches that were not accepted.
+};
+
+/**
+ * @class MqttClient
+ * @brief Publishes fan telemetry to an MQTT broker and takes fan commands from it.
+ *
+ * Runs entirely on the Mongoose event loop of the web server. The fan state is sampled every
+ * `MqttConfig::SAMPLE_INTERVAL_MS` into a bounded queue, which keeps filling while the broker is
+ * unreachable. Samples are published as compact JSON frames of up to `MqttConfig::SAMPLES_PER_FRAME`
+ * samples with QoS 1 and only leave the queue once the broker has acknowledged them. After a
+ * reconnect the backlog drains at one frame per `MqttConfig::DRAIN_INTERVAL_MS`.
+ *
+ * Topics, relative to `<TOPIC_PREFIX>/<device id>`:
+ * - `telemetry`: `{"now":130,"fans":["Front","Back"],"samples":[[100,1,1210,60,980,70],...]}`,
+ *   each sample is `[uptime, running, rpm and power per fan...]`.
+ * - `wear`: retained usage counters, `{"fans":[["Front",3600,2160,4500000,12,2083],...]}`, each fan is
+ *   `[name, on-time in s, time at full power in s, revolutions, starts, rpm at full power]`.
+ * - `status`: retained `online`, or `offline` as last will.
+ * - `cmd`: command batches in the format of `POST /fanBatch`.
+ * - `cmd/result`: the outcome of each command, e.g. `{"result":"accepted"}`.
+ */
+class MqttClient {
+    public:
+        /**
+         * @brief Constructs an MqttClient object.
+         * @param mgr The Mongoose event manager the client runs on.
+         * @param fanManager Reference to the FanManager that is sampled and commanded.
+         */
+        MqttClient(mg_mgr& mgr, FanManager& fanManager);
+
+        /**
+         * @brief Starts sampling and connects to the broker.
+         */
+        void start();
+
+        /**
+         * @brief Announces the client offline, disconnects and stops the timers.
+         */
+        void stop();
+
+        /**
+         * @brief Returns the delivery counters.
+         */
+        MqttStats getStats() const;
+
+    private:
+        mg_mgr& _mgr;                           ///< Mongoose event manager.
+        FanManager& _fanManager;                ///< The fans that are sampled and commanded.
+        struct mg_connection* _connection;      ///< Connection to the broker, nullptr while disconnected.
+        bool _connected;                        ///< True once the broker has accepted the session.
+        uint16_t _inFlightId;                   ///< Packet id of the unacknowledged frame, 0 if none.
+        size_t _inFlightSamples;                ///< Number of queued samples the unacknowledged frame carries.
+        int64_t _inFlightSentUs;                ///< Timestamp when the unacknowledged frame was sent.
+        int64_t _lastSendUs;                    ///< Timestamp of the last packet sent, used for keep-alive pings.
+        MqttStats _stats;                       ///< Delivery counters.
+        struct mg_timer _sampleTimer;           ///< Takes the samples.
+        struct mg_timer _drainTimer;            ///< Publishes queued frames.
+        struct mg_timer _connectTimer;          ///< Reconnects and keeps the session alive.
+        struct mg_timer _wearTimer;             ///< Publishes the usage counters.
+        char _statusTopic[40];                  ///< Topic of the online/offline status.
+        char _telemetryTopic[40];               ///< Topic of the telemetry frames.
+        char _commandTopic[40];                 ///< Topic of the incoming commands.
+        char _resultTopic[40];                  ///< Topic of the command results.
+        char _wearTopic[40];                    ///< Topic of the usage counters.
+        char _clientId[24];                     ///< MQTT client id derived from the MAC.
+
+        static TelemetrySample _samples[MqttConfig::QUEUE_SAMPLES]; ///< Queued samples, static to stay off the task stack.
+        static size_t _head;                                         ///< Index of the oldest queued sample.
+        static size_t _count;                                        ///< Number of queued samples.
+        static char _frame[MqttConfig::MAX_FRAME_SIZE];              ///< Encoding buffer of one frame.
+
+        /**
+         * @brief Handles the events of the broker connection.
+         * @param connection Pointer to the connection.
+         * @param event Event type.
+         * @param event_data Event data.
+         */
+        static void handle_event(struct mg_connection* connection, int event, void* event_data);
+
+        /**
+         * @brief Opens the broker connection if it is closed, otherwise pings if the session is idle.
+         */
+        void maintainConnection();
+
+        /**
+         * @brief Publishes the retained status and subscribes to the command topic.
+         */
+        void onConnected();
+
+        /**
+         * @brief Appends the current fan state to the queue, dropping the oldest sample if it is full.
+         */
+        void takeSample();
+
+        /**
+         * @brief Publishes the next frame if the session is up and no frame is waiting for its acknowledgement.
+         *
+         * A frame is sent once enough samples for a full frame are queued. A frame whose
+         * acknowledgement is overdue is sent again with the same packet id.
+         */
+        void publishPending();
+
+        /**
+         * @brief Removes the samples of the acknowledged frame from the queue.
+         * @param id Packet id of the acknowledgement.
+         */
+        void onAcknowledged(uint16_t id);
+
+        /**
+         * @brief Publishes the usage counters of all fans if the session is up.
+         *
+         * Only the latest counters matter, so they are neither queued nor sent again.
+         */
+        void publishWear();
+
+        /**
+         * @brief Encodes the oldest queued samples into `_frame`.
+         * @param length Receives the encoded length.
+         * @return The number of samples in the frame.
+         */
+        size_t encodeFrame(size_t& length);
+
+        /**
+         * @brief Applies a command batch and publishes its outcome.
+         * @param payload The command in the format of `POST /fanBatch`.
+         */
+        void handleCommand(struct mg_str payload);
+
+        /**
+         * @brief Publishes a message with QoS 1.
+         * @param topic The topic.
+         * @param payload The message.
+         * @param retain True if the broker should keep the message for new subscribers.
+         * @param retransmitId Packet id of a frame sent again, 0 for a new message.
+         * @return The packet id of the message.
+         */
+        uint16_t publish(const char* topic, struct mg_str payload, bool retain, uint16_t retransmitId = 0);
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "config.hpp"
+
+/**
+ * @class RequestArena
+ * @brief A bump allocator for the temporary memory of one HTTP request.
+ *
+ * Handlers build their responses with cJSON. While a `Scope` is active, cJSON allocations of the
+ * owning task are served from the arena and freeing them is a no-op; leaving the scope releases
+ * everything at once. This keeps the short-lived JSON trees off the heap, so they cannot
+ * fragment it. Allocations that do not fit, and those of other tasks, fall back to the heap.
+ */
+class RequestArena {
+    public:
+        /**
+         * @brief Activates the arena for the calling task and resets it when leaving the scope.
+         */
+        class Scope {
+            public:
+                Scope(RequestArena& arena);
+                ~Scope();
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+        };
+
+        /**
+         * @brief Routes the cJSON allocations through the active arena.
+         *
+         * Only one arena can serve cJSON; installing another one replaces it.
+         *
+         * @param arena The arena to use.
+         */
+        static void installJSONHooks(RequestArena& arena);
+
+        /**
+         * @brief Takes memory from the arena.
+         * @param size Number of bytes.
+         * @return The memory, or nullptr if the arena is exhausted.
+         */
+        void* allocate(size_t size);
+
+        /**
+         * @brief Checks whether memory has been taken from this arena.
+         * @param pointer The memory to check.
+         * @return True if the pointer lies inside the arena, false otherwise.
+         */
+        bool owns(const void* pointer) const;
+
+        /**
+         * @brief Releases all memory taken from the arena.
+         */
+        void reset();
+
+        /**
+         * @brief Returns the largest number of bytes used by a single request.
+         */
+        size_t getPeakUsed() const;
+
+        /**
+         * @brief Returns the number of allocations that did not fit and went to the heap.
+         */
+        uint32_t getOverflowCount() const;
+
+    private:
+        alignas(8) uint8_t _buffer[ServerConfig::REQUEST_ARENA_SIZE];  ///< The arena memory.
+        size_t _used = 0;                                              ///< Bytes taken since the last reset.
+        size_t _peakUsed = 0;                                          ///< Largest `_used` before a reset.
+        uint32_t _overflows = 0;                                       ///< Allocations that fell back to the heap.
+
+        static RequestArena* _jsonArena;   ///< Arena installed for cJSON.
+        static TaskHandle_t _activeTask;   ///< Task inside a scope, nullptr if none.
+
+        static void* json_malloc(size_t size);
+        static void json_free(void* pointer);
+};
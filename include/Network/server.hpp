@@ -3,19 +3,119 @@
 #include <memory>
 #include "cJSON.h"
 
+#include "cbor_writer.hpp"
 #include "mongoose_manager.hpp"
+#include "fleet_manager.hpp"
+#include "mqtt_client.hpp"
+#include "worker_pool.hpp"
+#include "latency_stats.hpp"
+#include "request_arena.hpp"
+#include "tls_session_manager.hpp"
 
 #include "config.hpp"
 #include "FanControl/fan_manager.hpp"
 #include "FanControl/ifan.hpp"
+#include "Network/wifi_manager.hpp"
+#include "Ota/esp_ota_backend.hpp"
+#include "Ota/ota_updater.hpp"
+#include "Ota/ota_writer.hpp"
 
 using namespace std;
 
 constexpr char FAN_ENDPOINT[] = "/fan";
 constexpr char FAN_MANAGER_ENDPOINT[] = "/fanManager";
+constexpr char FAN_BATCH_ENDPOINT[] = "/fanBatch";
+constexpr char FLEET_ENDPOINT[] = "/fleet";
+constexpr char FLEET_CONFIG_ENDPOINT[] = "/fleet/config";
+constexpr char FLEET_KEY_ENDPOINT[] = "/fleet/key";
+constexpr char TRACE_ENDPOINT[] = "/trace";
+constexpr char TRACE_FILE_ENDPOINT[] = "/trace/file";
+constexpr char TRACE_REPLAY_ENDPOINT[] = "/trace/replay";
 constexpr char SCRIPTS_ENDPOINT[] = "/scripts.js";
 constexpr char STYLES_ENDPOINT[] = "/styles.css";
+constexpr char STATS_ENDPOINT[] = "/stats";
+constexpr char EVENTS_ENDPOINT[] = "/events";
+constexpr char OTA_ENDPOINT[] = "/ota";
+constexpr char JSON_CONTENT_TYPE[] = "application/json";
+constexpr char CBOR_CONTENT_TYPE[] = "application/cbor";
 constexpr char INDEX_PATH[] = "/spiffs/index.html";
+constexpr char SCRIPTS_PATH[] = "/spiffs/scripts.js";
+constexpr char STYLES_PATH[] = "/spiffs/styles.css";
+
+/**
+ * @brief Routes tracked separately in the request latency statistics.
+ */
+enum class Route : uint8_t {
+    Fan,
+    FanManager,
+    FanBatch,
+    Fleet,
+    Trace,
+    Static,
+    Stats,
+    Events,
+    Ota,
+    Count
+};
+
+/**
+ * @brief Wire formats of API responses, chosen by the `Accept` header.
+ */
+enum class ResponseFormat : uint8_t {
+    Json,
+    Cbor
+};
+
+/**
+ * @brief Events delivered to the event loop through the Mongoose wakeup pipe.
+ */
+enum class LoopEvent : uint8_t {
+    JobsCompleted,      ///< A worker has finished a job.
+    FanStateChanged,    ///< Fans were started, stopped or changed power.
+    OtaProgress,        ///< The OTA writer has written a chunk or ended the update.
+    Shutdown            ///< The server has been asked to stop.
+};
+
+/**
+ * @brief Message posted into the event loop, carried as the wakeup payload.
+ */
+struct LoopMessage {
+    LoopEvent event;    ///< What happened.
+    int64_t postedUs;   ///< Timestamp when the message was posted, used to measure delivery latency.
+};
+
+/**
+ * @brief Per-connection state stored in the Mongoose connection's `data` field.
+ */
+struct ConnectionState {
+    int64_t requestStartUs;  ///< Timestamp when the current request was received, for TLS connections the accept time until then.
+    int64_t lastActivityUs;  ///< Timestamp of the last data received, used for the idle timeout.
+    Route route;             ///< Route of the current request.
+    bool isEventStream;      ///< True if the connection receives server-sent events.
+    bool isRejected;         ///< True if the connection has been answered with an error and is draining.
+    bool isUpload;           ///< True while the connection streams a firmware image.
+    bool isTls;              ///< True if the connection came in on the HTTPS port.
+    bool tlsResumed;         ///< True if the TLS handshake resumed an earlier session.
+    uint8_t requestCount;    ///< Requests received on the connection, saturating.
+};
+
+/**
+ * @brief Counters describing connection admission and buffer limits.
+ */
+struct ConnectionCounters {
+    uint32_t active;         ///< Currently open client connections.
+    uint32_t peak;           ///< Highest number of simultaneously open client connections.
+    uint32_t rejected;       ///< Connections refused because `MAX_CONNECTIONS` was reached.
+    uint32_t bodyTooLarge;   ///< Requests refused because their body exceeded `MAX_BODY_SIZE`.
+    uint32_t recvOverflows;  ///< Connections closed because unparsed data exceeded `MAX_RECV_BUFFER`.
+    uint32_t sendOverflows;  ///< Event streams closed because unsent data exceeded `MAX_SEND_BUFFER`.
+    uint32_t idleClosed;     ///< Connections closed by the idle timeout.
+    uint32_t tlsActive;      ///< Currently open HTTPS connections.
+    uint32_t tlsRejected;    ///< HTTPS connections refused because a connection limit was reached.
+    uint32_t tlsReused;      ///< Requests on an HTTPS connection that had already served one, saving a handshake.
+};
+
+static_assert(sizeof(ConnectionState) <= MG_DATA_SIZE, "ConnectionState does not fit into mg_connection::data");
 
 /**
  * @class WebServer
@@ -26,9 +126,10 @@ class WebServer {
         /**
          * @brief Constructs a WebServer object.
          * @param fanManager Reference to a FanManager object.
+         * @param wifiManager Reference to the WiFiManager, used for connection metrics.
          * @param port The port number to listen on (default is "8000").
          */
-        WebServer(FanManager& fanManager, const char *port = "8000");
+        WebServer(FanManager& fanManager, WiFiManager& wifiManager, const char *port = "8000");
 
         /**
          * @brief Starts the web server.
@@ -37,14 +138,46 @@ class WebServer {
 
         /**
          * @brief Stops the web server.
+         *
+         * Wakes the event loop immediately; `start()` then closes all connections, stops the
+         * workers and returns. Safe to call from any task.
          */
         void stop();
 
+        /**
+         * @brief Posts an event into the event loop.
+         *
+         * The event is delivered through the Mongoose wakeup pipe, so a blocked `mg_mgr_poll`
+         * returns immediately. Safe to call from any task.
+         *
+         * @param event The event to post.
+         */
+        void postEvent(LoopEvent event);
+
     private:
-        static struct mg_mgr mgr; ///< Mongoose event manager.
+        MongooseManager _mongooseManager; ///< Mongoose event manager.
         const char* _port; ///< Port number to listen on.
         FanManager& _fanManager; ///< Reference to the FanManager.
+        WiFiManager& _wifiManager; ///< Reference to the WiFiManager.
         bool _running; ///< Indicates if the server is running.
+        WorkerPool _workerPool; ///< Workers running slow handlers off the event loop.
+        unsigned long _listenerId; ///< Connection ID of the listener, target of worker wakeups.
+        LatencyStats _latency[static_cast<size_t>(Route::Count)]; ///< Request latencies per route.
+        LatencyStats _notifyLatency; ///< Latency from a fan state change to the event being queued for all clients.
+        ConnectionCounters _connections; ///< Admission control and buffer limit counters.
+        EspOtaBackend _otaBackend; ///< Flash backend for firmware updates.
+        OtaUpdater _otaUpdater; ///< Streams uploaded firmware into the OTA partition.
+        OtaWriter _otaWriter; ///< Runs the flash writes of `_otaUpdater` on its own task.
+        unsigned long _uploadId; ///< Connection ID of the running firmware upload.
+        MqttClient _mqttClient; ///< Publishes telemetry to the broker and receives commands, on the same event loop.
+        FleetManager _fleetManager; ///< Discovers the other dryers and distributes the fleet configuration.
+        TlsSessionManager _tlsSessions; ///< Certificate and session resumption of the HTTPS listener.
+        LatencyStats _fullHandshakes; ///< Duration of TLS handshakes that negotiated a new session.
+        LatencyStats _resumedHandshakes; ///< Duration of TLS handshakes that resumed a session.
+        LatencyStats _tlsRequests; ///< Latency of requests received over HTTPS.
+        LatencyStats _wakeLatency; ///< Time from the chip leaving light sleep until a request was parsed.
+        LatencyStats _powerSaveRequests; ///< Latency of requests handled while the fans rest and the chip saves power.
+        static RequestArena _arena; ///< Temporary memory of the request being handled, static to stay off the task stack.
 
         /**
          * @brief Handles incoming HTTP requests.
@@ -80,13 +213,251 @@ class WebServer {
          */
         void handleFanDataUpdate(struct mg_connection* connection, struct mg_http_message* http_message);
 
+        /**
+         * @brief Sets the power of all fans of a group, requested via `POST /fan?group=<name>`.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the POST data.
+         * @param groupName The name of the group.
+         */
+        void handleFanGroupUpdate(struct mg_connection* connection, struct mg_http_message* http_message, const char* groupName);
+
         /**
          * @brief Serves a static file.
+         *
+         * The file is read on a worker so that slow SPIFFS access does not stall the event loop.
+         * The connection is marked as having a pending response, which makes Mongoose hold back
+         * pipelined requests until the worker's response has been sent.
+         *
          * @param connection Pointer to the connection.
          * @param http_message Pointer to the HTTP message.
          * @param filePath Path to the static file.
          */
-        void serveStaticFile(struct mg_connection* c, struct mg_http_message* http_message, const string& filePath);
+        void serveStaticFile(struct mg_connection* c, struct mg_http_message* http_message, const char* filePath);
+
+        /**
+         * @brief Reads a static file into a response.
+         *
+         * Runs on a worker task and must not touch any Mongoose connection.
+         *
+         * @param filePath Path to the static file.
+         * @param buffer The worker's response buffer the file is read into.
+         * @param bufferSize Size of the buffer, larger files are answered with 500.
+         * @return The response containing the file or an error.
+         */
+        HttpResponse readStaticFile(const char* filePath, char* buffer, size_t bufferSize);
+
+        /**
+         * @brief Admits or refuses a newly accepted connection.
+         *
+         * Connections beyond `ServerConfig::MAX_CONNECTIONS` are answered with 503 and closed.
+         * Connections to the HTTPS port start their TLS handshake; beyond
+         * `ServerConfig::MAX_TLS_CONNECTIONS` they are closed without a response, since the
+         * client could not read one.
+         *
+         * @param connection Pointer to the accepted connection.
+         */
+        void admitConnection(struct mg_connection* connection);
+
+        /**
+         * @brief Records the duration of a completed TLS handshake.
+         * @param connection Pointer to the connection.
+         */
+        void recordHandshake(struct mg_connection* connection);
+
+        /**
+         * @brief Enforces the receive buffer limit after data has been read.
+         * @param connection Pointer to the connection.
+         */
+        void checkReceiveBuffer(struct mg_connection* connection);
+
+        /**
+         * @brief Rejects a request whose declared body exceeds `ServerConfig::MAX_BODY_SIZE`.
+         * @param connection Pointer to the connection.
+         * @param http_message Pointer to the HTTP message, possibly with only the headers parsed.
+         * @return True if the request has been rejected.
+         */
+        bool rejectOversizedBody(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Closes idle connections and event streams that do not keep up.
+         * @param connection Pointer to the connection being polled.
+         */
+        void checkConnectionLimits(struct mg_connection* connection);
+
+        /**
+         * @brief Answers a request with an error and closes the connection once it is sent.
+         * @param connection Pointer to the connection.
+         * @param status HTTP status code.
+         * @param message Response body.
+         */
+        void rejectConnection(struct mg_connection* connection, int status, const char* message);
+
+        /**
+         * @brief Starts a firmware upload once the request headers are complete.
+         *
+         * Requires a `Content-Length` and the expected digest in `OtaConfig::SHA256_HEADER`.
+         * The headers are removed from the receive buffer, which detaches the Mongoose HTTP
+         * handler so the body can be consumed as raw data while it arrives.
+         *
+         * @param connection Pointer to the connection.
+         * @param http_message Pointer to the HTTP message with the parsed headers.
+         */
+        void beginUpload(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Hands received firmware data to the OTA writer and finishes the update once
+         *        the image is complete.
+         *
+         * While the chunk buffers are all queued, the data stays in the receive buffer and
+         * reading from the socket is paused, so memory use does not depend on the image size.
+         *
+         * @param connection Pointer to the uploading connection.
+         */
+        void handleUploadData(struct mg_connection* connection);
+
+        /**
+         * @brief Continues the upload after the OTA writer freed a chunk buffer and answers the
+         *        client once the update has ended.
+         */
+        void handleOtaProgress();
+
+        /**
+         * @brief Handles firmware update status requests via HTTP GET.
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleOtaStatusRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Handles a message posted from another task.
+         * @param message The posted message.
+         */
+        void handleLoopMessage(const LoopMessage& message);
+
+        /**
+         * @brief Closes all connections and stops the workers.
+         *
+         * Connections are drained so that responses already queued are still sent, but the
+         * shutdown does not wait longer than `ServerConfig::SHUTDOWN_TIMEOUT_MS`.
+         */
+        void shutdown();
+
+        /**
+         * @brief Opens a server-sent events stream on a connection.
+         *
+         * The client immediately receives the current fan state and afterwards an update
+         * every time the fan state changes.
+         *
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleEventStreamRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Sends the current fan state to all event stream clients.
+         */
+        void broadcastFanState();
+
+        /**
+         * @brief Serializes the current fan state as a server-sent event payload.
+         * @return The JSON string; the caller must free it with `free`.
+         */
+        char* buildFanStateEvent();
+
+        /**
+         * @brief Builds the JSON array describing all fans.
+         * @return The JSON array; the caller must free it with `cJSON_Delete`.
+         */
+        cJSON* buildFanDataJSON();
+
+        /**
+         * @brief Writes the data of all fans as a CBOR array, with the same fields as `buildFanDataJSON()`.
+         * @param writer The writer to encode with.
+         */
+        void writeFanDataCbor(CborWriter& writer);
+
+        /**
+         * @brief Chooses the response format from the `Accept` header.
+         *
+         * Each format gets the quality of the most specific media range that matches it, so
+         * `application/cbor;q=0` excludes CBOR even if a wildcard accepts every type. CBOR is chosen
+         * if its quality is higher than that of JSON, or equal and non-zero with CBOR named
+         * explicitly and JSON only matched by a wildcard. Otherwise, and without the header,
+         * the format is JSON.
+         *
+         * @param http_message Pointer to the HTTP message containing the request details.
+         * @return The format to answer in.
+         */
+        ResponseFormat negotiateFormat(const struct mg_http_message* http_message);
+
+        /**
+         * @brief Matches a media range of an `Accept` header against a content type.
+         * @param range The media range, a content type or a wildcard.
+         * @param type The content type, e.g. `application/json`.
+         * @return 0 if the range does not match, 1 for the wildcard of all types, 2 for the wildcard
+         *         of all subtypes of the type, 3 for the exact type.
+         */
+        static uint8_t matchMediaRange(struct mg_str range, const char* type);
+
+        /**
+         * @brief Parses the value of a `q` parameter.
+         * @param value The value, `0` to `1` with up to three decimals.
+         * @param quality Receives the quality in thousandths.
+         * @return True if the value is a valid quality.
+         */
+        static bool parseQuality(struct mg_str value, uint16_t& quality);
+
+        /**
+         * @brief Answers a request with a CBOR body.
+         *
+         * The body is encoded into a buffer of `ServerConfig::MAX_CBOR_RESPONSE_SIZE` bytes
+         * taken from the request arena.
+         *
+         * @tparam Encode Callable taking a `CborWriter&` that writes the body.
+         * @param connection Pointer to the current HTTP connection.
+         * @param encode Writes the body.
+         */
+        template<typename Encode>
+        void replyCbor(struct mg_connection* connection, Encode encode);
+
+        /**
+         * @brief Encodes a payload in both formats and adds their sizes and encoding times to the statistics.
+         * @tparam BuildJSON Callable returning the payload as a cJSON tree.
+         * @tparam WriteCbor Callable taking a `CborWriter&` that writes the payload.
+         * @param parent The JSON object to add the comparison to.
+         * @param name Name of the payload.
+         * @param buildJSON Builds the JSON payload.
+         * @param writeCbor Writes the CBOR payload.
+         */
+        template<typename BuildJSON, typename WriteCbor>
+        void addEncodingComparison(cJSON* parent, const char* name, BuildJSON buildJSON, WriteCbor writeCbor);
+
+        /**
+         * @brief Sends the responses of all completed worker jobs.
+         *
+         * Responses for connections that have been closed in the meantime are dropped.
+         */
+        void sendCompletedResponses();
+
+        /**
+         * @brief Handles server statistics requests via HTTP GET.
+         *
+         * Reports the request latency per route, the worker pool state, the connection
+         * counters, the TLS handshake and request timings, the power saving residency and wake
+         * latency, the Wi-Fi reconnect metrics, the MQTT
+         * delivery, the JSON and CBOR encoding costs and the heap usage as JSON.
+         *
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleStatsRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Records the latency of the request that has just been answered on a connection.
+         * @param connection Pointer to the connection.
+         */
+        void recordLatency(struct mg_connection* connection);
 
         /**
          * @brief Handles fan manager data retrieval requests via HTTP GET.
@@ -110,11 +481,106 @@ class WebServer {
         void handleFanManagerDataUpdate(struct mg_connection* connection, struct mg_http_message* http_message);
 
         /**
-         * @brief Gets the MIME type of a file based on its path.
+         * @brief Handles batched fan commands via HTTP POST.
+         * 
+         * The body is parsed once, e.g. `{"fans":[{"name":"Front","power":50},{"group":"Top","power":40}],"interval":600}`.
+         * The batch is validated as a whole and applied by the fan task in a single control tick.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the POST data.
+         */
+        void handleFanBatchRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Handles fleet overview requests via HTTP GET.
+         * 
+         * Reports every known dryer with its address, fan state and the configuration it has
+         * applied, so a dashboard needs a single request for the whole fleet.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleFleetRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Handles fleet configuration changes via HTTP POST.
+         * 
+         * The body has the format of `POST /fanBatch`. It is accepted only by the coordinator,
+         * which applies it and distributes it to all other dryers. Other nodes answer with 409
+         * and the coordinator's address.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the POST data.
+         */
+        void handleFleetConfigRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Sets the fleet key via HTTP PUT.
+         * 
+         * The body is the key as `2 * FleetConfig::KEY_SIZE` hex characters; every dryer of a
+         * fleet needs the same key. The key is stored in NVS and never returned.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the key.
+         */
+        void handleFleetKeyRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Handles trace recording requests.
+         * 
+         * `GET` reports the state of the current or last recording, `POST ?action=start` starts a
+         * new recording with the next control tick and `POST ?action=stop` ends it.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleTraceRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Downloads the trace file via HTTP GET.
+         * 
+         * The file is streamed in chunks, since it is too large to be read into memory at once.
+         * Refused with 409 while a recording is in progress.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleTraceFileRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Replays the trace file on a worker, requested via HTTP POST.
+         * 
+         * Refused with 409 while a recording is in progress.
+         * 
+         * @param connection Pointer to the current HTTP connection.
+         * @param http_message Pointer to the HTTP message containing the request details.
+         */
+        void handleTraceReplayRequest(struct mg_connection* connection, struct mg_http_message* http_message);
+
+        /**
+         * @brief Replays the trace file and reports the outcome.
+         *
+         * Runs on a worker task and must not touch any Mongoose connection.
+         *
+         * @param buffer The worker's response buffer the result is printed into.
+         * @param bufferSize Size of the buffer.
+         * @return The response containing the replay result as JSON or an error.
+         */
+        HttpResponse replayTrace(char* buffer, size_t bufferSize);
+
+        /**
+         * @brief Sends the HTTP response matching the outcome of a submitted batch.
+         * @param connection Pointer to the current HTTP connection.
+         * @param result The outcome returned by `FanManager::submitBatch()`.
+         */
+        void replyBatchResult(struct mg_connection* connection, BatchResult result);
+
+        /**
+         * @brief Gets the Content-Type header of a file based on its path.
          * @param filePath Path to the file.
-         * @return MIME type as a const char*.
+         * @return The header line including its terminating "\r\n".
          */
-        const char* getMimeType(string_view filePath);
+        const char* getContentTypeHeader(string_view filePath);
 
         /**
          * @brief Extracts a JSON parameter from an HTTP message.
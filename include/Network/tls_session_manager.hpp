@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/x509_crt.h"
+#ifdef MBEDTLS_SSL_CACHE_C
+#include "mbedtls/ssl_cache.h"
+#endif
+#include "mongoose.h"
+
+#include "config.hpp"
+
+using namespace std;
+
+/**
+ * @class TlsSessionManager
+ * @brief Provides the server certificate and the session resumption state of the HTTPS listener.
+ *
+ * The certificate and key are read from SPIFFS and parsed once at startup; every accepted
+ * connection refers to the same parsed objects instead of parsing its own copy of the PEM
+ * files, which would cost each handshake the parse time and a few kilobytes of heap.
+ *
+ * A full handshake costs an ECDHE key exchange and a signature, which takes the ESP32 far
+ * longer than the request itself; clients that have connected before resume their session
+ * instead, either with a session ticket or, for clients without ticket support, by session ID
+ * from a small cache. Ticket keys are generated at boot, so sessions do not survive a restart.
+ *
+ * All callbacks run on the Mongoose event loop, so no locking is needed.
+ */
+class TlsSessionManager {
+    public:
+        /**
+         * @brief Loads the certificate and key and prepares session resumption.
+         * @return True if HTTPS can be served, false if the credentials are missing or invalid.
+         */
+        bool init();
+
+        /**
+         * @brief Returns true if `init()` has succeeded.
+         */
+        bool isReady() const;
+
+        /**
+         * @brief Starts the TLS layer of an accepted connection.
+         * @param connection The accepted connection.
+         * @param resumed Set to true during the handshake if the client resumes a session; must
+         *                stay valid for the lifetime of the connection.
+         */
+        void attach(struct mg_connection* connection, bool* resumed);
+
+    private:
+        bool _ready = false;    ///< True once the credentials are loaded.
+
+        static mbedtls_x509_crt _cert;               ///< Parsed server certificate, shared by all connections.
+        static mbedtls_pk_context _key;              ///< Parsed private key, shared by all connections.
+
+        static mbedtls_ssl_ticket_context _tickets;  ///< Encrypts and verifies session tickets.
+#ifdef MBEDTLS_SSL_CACHE_C
+        static mbedtls_ssl_cache_context _cache;     ///< Sessions by ID, for clients without tickets.
+#endif
+
+        /**
+         * @brief Reads a PEM file into a string.
+         * @param path The file.
+         * @param pem Receives the contents.
+         * @return True if the file could be read.
+         */
+        static bool readPem(const char* path, string& pem);
+
+        /**
+         * @brief Parses the certificate and key.
+         * @param cert The certificate in PEM format.
+         * @param key The private key in PEM format.
+         * @return True if both could be parsed and belong together.
+         */
+        static bool parseCredentials(const string& cert, const string& key);
+
+        /**
+         * @brief Fills a buffer with random bytes from the hardware RNG.
+         */
+        static int random_bytes(void* context, unsigned char* output, size_t length);
+
+        /**
+         * @brief Issues a session ticket.
+         */
+        static int ticket_write(void* resumed, const mbedtls_ssl_session* session, unsigned char* start,
+                                const unsigned char* end, size_t* length, uint32_t* lifetime);
+
+        /**
+         * @brief Restores a session from a ticket and flags the connection as resumed.
+         */
+        static int ticket_parse(void* resumed, mbedtls_ssl_session* session, unsigned char* buffer, size_t length);
+
+#ifdef MBEDTLS_SSL_CACHE_C
+        /**
+         * @brief Looks up a session by ID and flags the connection as resumed if found.
+         */
+        static int cache_get(void* resumed, const unsigned char* id, size_t idLength, mbedtls_ssl_session* session);
+
+        /**
+         * @brief Stores a session under its ID.
+         */
+        static int cache_set(void* resumed, const unsigned char* id, size_t idLength, const mbedtls_ssl_session* session);
+#endif
+};
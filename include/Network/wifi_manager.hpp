@@ -1,21 +1,50 @@
 #pragma once
 
+#include <atomic>
 #include <cstring>
 
 #include "esp_wifi.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "config.hpp"
 
 using namespace std;
 
+/**
+ * @brief Connection state of the Wi-Fi station.
+ */
+enum class WiFiState : uint8_t {
+    Connecting,     ///< A connection attempt is in progress.
+    Connected,      ///< Associated with the access point and the IP is configured.
+    WaitingToRetry  ///< Disconnected, the retry timer is running.
+};
+
+/**
+ * @brief Connection metrics reported by the WiFiManager.
+ */
+struct WiFiStats {
+    uint32_t initialConnectMs;   ///< Time from `init()` to the first IP, 0 until connected.
+    uint32_t lastReconnectMs;    ///< Time from the last disconnect to the IP being available again.
+    uint32_t maxReconnectMs;     ///< Longest reconnect time since boot.
+    uint32_t reconnects;         ///< Number of completed reconnects.
+    uint32_t failedAttempts;     ///< Number of connection attempts that ended in a disconnect.
+    bool usedCachedAccessPoint;  ///< True if the last attempt connected directly to the cached BSSID.
+};
+
 /**
  * @class WiFiManager
  * @brief A class to manage Wi-Fi connection and provide IP address information.
  * 
  * This class handles the initialization of the Wi-Fi connection using ESP32's Wi-Fi APIs. 
- * It also provides methods to retrieve the IP address assigned to the device once connected 
- * to a Wi-Fi network.
+ * After a disconnect, reconnection attempts are scheduled by a one-shot timer with jittered
+ * exponential backoff, so the default event loop is never blocked. The BSSID and channel of 
+ * the last access point are cached in NVS, which lets reconnects and cold boots skip the full 
+ * channel scan.
+ * 
+ * The event handler only updates the cache in RAM. NVS is written by a one-shot timer, and the
+ * station configuration is changed by the retry timer right before the next attempt; both run on
+ * the esp_timer task, so flash access never stalls the default event loop.
  */
 class WiFiManager {
     public:
@@ -27,14 +56,46 @@ class WiFiManager {
          */
         void init();
 
+        /**
+         * @brief Returns the current connection state.
+         */
+        WiFiState getState() const;
+
+        /**
+         * @brief Returns the connection metrics.
+         */
+        WiFiStats getStats() const;
+
     private:
+        /**
+         * @brief Access point data cached in NVS for fast reconnects.
+         */
+        struct CachedAccessPoint {
+            uint8_t bssid[6];
+            uint8_t channel;
+        };
+
+        esp_timer_handle_t _retryTimer = nullptr;          ///< One-shot timer scheduling the next attempt.
+        esp_timer_handle_t _cacheTimer = nullptr;          ///< One-shot timer writing the cache to NVS.
+        volatile WiFiState _state = WiFiState::Connecting; ///< Current connection state.
+        uint8_t _retryCount = 0;                           ///< Consecutive failed attempts, reset on connect.
+        bool _useCachedAccessPoint = false;                ///< True if the next attempt should use the cached BSSID.
+        CachedAccessPoint _cachedAccessPoint = {};         ///< Access point loaded from NVS or learned on connect.
+        portMUX_TYPE _cacheLock = portMUX_INITIALIZER_UNLOCKED; ///< Protects the two fields above, written by the event loop.
+        bool _configApplied = false;                       ///< True once a station configuration has been set.
+        atomic<bool> _configUsesCachedAccessPoint{false};  ///< True if the applied configuration locks onto the cached BSSID.
+        CachedAccessPoint _configAccessPoint = {};         ///< Access point of the applied configuration.
+        int64_t _initUs = 0;                               ///< Timestamp of `init()`.
+        int64_t _disconnectedUs = 0;                       ///< Timestamp of the last disconnect, 0 while connected.
+        WiFiStats _stats = {};                             ///< Connection metrics.
+
         /**
          * @brief Wi-Fi event handler for managing Wi-Fi connection events.
          * 
          * This static method is used as an event handler for Wi-Fi events such as connection success 
-         * or failure. It helps in managing the state of the Wi-Fi connection.
+         * or failure. It only updates state and arms the retry timer, it never blocks.
          * 
-         * @param arg A pointer to user-specific data (typically not used here).
+         * @param arg Pointer to the `WiFiManager` instance.
          * @param event_base The event base identifier.
          * @param event_id The event identifier.
          * @param event_data Additional data associated with the event.
@@ -42,8 +103,70 @@ class WiFiManager {
         static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 
         /**
-         * @brief Static variable to keep track of the number of retry attempts.
+         * @brief Retry timer callback, updates the station configuration and starts the next connection attempt.
+         * @param arg Pointer to the `WiFiManager` instance.
          */
-        static int retry_count;
-};
+        static void retry_timer_callback(void* arg);
+
+        /**
+         * @brief Cache timer callback, writes the access point cache to NVS.
+         * @param arg Pointer to the `WiFiManager` instance.
+         */
+        static void cache_timer_callback(void* arg);
+
+        /**
+         * @brief Handles a disconnect by scheduling the next attempt.
+         */
+        void onDisconnected();
+
+        /**
+         * @brief Handles a successful association and updates the access point cache.
+         * @param event The connection event data.
+         */
+        void onConnected(const wifi_event_sta_connected_t* event);
+
+        /**
+         * @brief Records connection timing once the IP is available.
+         */
+        void onGotIP();
+
+        /**
+         * @brief Calculates the delay before the next attempt.
+         *
+         * The delay doubles with every consecutive failure up to `Network::RECONNECT_MAX_DELAY_MS`
+         * and is randomized by `Network::RECONNECT_JITTER_PERCENT` so that several devices do not
+         * retry in lockstep after an access point restart.
+         *
+         * @return The delay in milliseconds.
+         */
+        uint32_t nextRetryDelayMs() const;
+
+        /**
+         * @brief Loads the cached access point from NVS.
+         * @return True if a cached access point was found.
+         */
+        bool loadCachedAccessPoint();
 
+        /**
+         * @brief Writes the cached access point to NVS, or erases it once dropped. Runs on the esp_timer task.
+         */
+        void storeCachedAccessPoint();
+
+        /**
+         * @brief Schedules `storeCachedAccessPoint()` on the esp_timer task.
+         */
+        void requestCacheWrite();
+
+        /**
+         * @brief Removes the cached access point, the next attempt falls back to a full scan.
+         */
+        void dropCachedAccessPoint();
+
+        /**
+         * @brief Applies the station configuration, with or without the cached access point.
+         *
+         * Does nothing if the configuration has not changed. A failure is logged and the
+         * configuration is applied again before the next attempt.
+         */
+        void applyStationConfig();
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "config.hpp"
+#include "System/static_task.hpp"
+
+using namespace std;
+
+/**
+ * @brief Identifies the request a job answers.
+ *
+ * The Mongoose `mg_http_message` points into the connection's receive buffer and is only valid
+ * during the event callback. Jobs capture the little data they need by value instead of copying
+ * the whole request.
+ */
+struct HttpRequest {
+    unsigned long connectionId;  ///< Mongoose ID of the connection the response belongs to.
+};
+
+/**
+ * @brief Response produced by a worker and sent by the event loop.
+ *
+ * The response owns no memory: the headers are string literals and the body is either a literal
+ * or lies in the response buffer the worker passed to the job.
+ */
+struct HttpResponse {
+    int status;            ///< HTTP status code.
+    const char* headers;   ///< Extra headers, each terminated by "\r\n".
+    string_view body;      ///< Response body.
+};
+
+/**
+ * @brief Finished job waiting to be sent by the event loop.
+ */
+struct HttpCompletion {
+    unsigned long connectionId;  ///< Mongoose ID of the connection the response belongs to.
+    size_t worker;               ///< Index of the worker whose buffer holds the body.
+    HttpResponse response;       ///< The response to send.
+};
+
+/**
+ * @brief Handler run on a worker.
+ *
+ * Receives the request and the worker's response buffer of `ServerConfig::WORKER_BUFFER_SIZE`
+ * bytes, which the returned body may point into.
+ */
+using HttpJob = function<HttpResponse(const HttpRequest&, char* buffer, size_t bufferSize)>;
+
+/**
+ * @class WorkerPool
+ * @brief A fixed pool of tasks that runs slow HTTP handlers off the Mongoose event loop.
+ *
+ * Jobs are assigned to a worker by connection ID, so all jobs of one connection run on the same
+ * worker in submission order. Each worker has a bounded queue; when it is full, `submit()` fails
+ * and the caller is expected to reject the request. Finished jobs are collected in a completion
+ * ring and the event loop is notified through the `notify` callback (typically `mg_wakeup`).
+ *
+ * Each worker builds its responses in one reused buffer and waits before its next job until the
+ * event loop has sent the previous response, so no job allocates memory for its response.
+ * Worker stacks, buffers, queues, job slots and completions are allocated statically, so only one
+ * pool may exist.
+ */
+class WorkerPool {
+    public:
+        /**
+         * @brief Constructs a WorkerPool object.
+         * @param notify Callback invoked from a worker task after a job has completed.
+         */
+        WorkerPool(function<void()> notify);
+
+        /**
+         * @brief Creates the worker queues and tasks.
+         */
+        void start();
+
+        /**
+         * @brief Stops all worker tasks.
+         *
+         * Jobs already queued are still executed. Blocks until every worker has exited and
+         * discards completions that have not been sent.
+         */
+        void stop();
+
+        /**
+         * @brief Queues a job for execution on a worker.
+         * @param request The request data the job operates on.
+         * @param job The handler producing the response.
+         * @return True if the job was queued, false if the worker queue is full.
+         */
+        bool submit(const HttpRequest& request, HttpJob job);
+
+        /**
+         * @brief Returns the oldest completed job without removing it.
+         *
+         * Must only be called from the event loop. The completion and its body stay valid until
+         * `releaseCompleted()` is called.
+         *
+         * @return The completed job, or nullptr if none is available.
+         */
+        const HttpCompletion* peekCompleted();
+
+        /**
+         * @brief Removes the oldest completed job and hands its buffer back to the worker.
+         *
+         * Must only be called from the event loop, after `peekCompleted()` returned a job.
+         */
+        void releaseCompleted();
+
+        /**
+         * @brief Returns the number of jobs rejected because a worker queue was full.
+         */
+        uint32_t getRejectedCount() const;
+
+        /**
+         * @brief Returns the number of jobs that are queued or running.
+         */
+        uint32_t getPendingCount() const;
+
+    private:
+        struct Job {
+            HttpRequest request;
+            HttpJob handler;
+        };
+
+        // One slot more than the queue depth, for the job that is running while the queue is full
+        static constexpr size_t JOB_SLOTS = ServerConfig::WORKER_QUEUE_DEPTH + 1;
+
+        struct Worker {
+            WorkerPool* pool;
+            QueueHandle_t queue;
+            Job jobs[JOB_SLOTS];    ///< Jobs are taken round robin; a slot is free again once the worker dequeued the next one.
+            uint32_t nextJob;       ///< Slot for the next submitted job.
+            StaticQueue<Job*, ServerConfig::WORKER_QUEUE_DEPTH> queueStorage;
+            StaticTask<TaskConfig::HTTP_WORKER_TASK.stackSize> task;
+            char buffer[ServerConfig::WORKER_BUFFER_SIZE];  ///< Response body of the current job.
+            SemaphoreHandle_t bufferFree;                    ///< Given once the response in `buffer` has been sent.
+            StaticSemaphore_t bufferFreeStorage;             ///< Storage of `bufferFree`.
+        };
+
+        // A worker waits for its buffer before the next job, so each has at most one completion
+        static constexpr size_t COMPLETION_SLOTS = ServerConfig::WORKER_COUNT;
+
+        function<void()> _notify;                       ///< Wakes the event loop after a completion.
+        static Worker _workers[ServerConfig::WORKER_COUNT]; ///< Worker tasks and their job queues.
+        SemaphoreHandle_t _completedMutex;              ///< Protects `_completed`.
+        SemaphoreHandle_t _exited;                      ///< Given by each worker when it exits.
+        StaticSemaphore_t _completedMutexBuffer;        ///< Storage of `_completedMutex`.
+        StaticSemaphore_t _exitedBuffer;                ///< Storage of `_exited`.
+        HttpCompletion _completed[COMPLETION_SLOTS];    ///< Ring of completed jobs in completion order.
+        size_t _completedHead;                          ///< Index of the oldest completion.
+        size_t _completedCount;                         ///< Number of completions in the ring.
+        uint32_t _rejected;                             ///< Jobs rejected because a queue was full.
+        uint32_t _pending;                              ///< Jobs queued or running.
+
+        /**
+         * @brief Worker task body: runs queued jobs and publishes their responses.
+         * @param arg Pointer to the `Worker` this task serves.
+         */
+        static void workerTask(void* arg);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_ota_ops.h"
+
+#include "Ota/iota_backend.hpp"
+
+/**
+ * @class EspOtaBackend
+ * @brief Writes OTA images to the next `ota_0`/`ota_1` partition using the ESP-IDF OTA API.
+ *
+ * The partition is erased sector by sector as the image arrives instead of all at once, so no
+ * single call blocks for the time it takes to erase a whole partition.
+ */
+class EspOtaBackend : public IOtaBackend {
+    public:
+        bool begin(size_t imageSize) override;
+
+        bool write(const uint8_t* data, size_t length) override;
+
+        bool finish() override;
+
+        bool activate() override;
+
+        void abort() override;
+
+    private:
+        const esp_partition_t* _partition = nullptr;  ///< Partition the image is written to.
+        esp_ota_handle_t _handle = 0;                 ///< Handle of the running OTA operation.
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class IOtaBackend
+ * @brief Interface for the storage an OTA image is written to.
+ *
+ * The OtaUpdater only talks to this interface, so the streaming, length and checksum
+ * handling can run against a fake backend without touching flash.
+ */
+class IOtaBackend {
+    public:
+        virtual ~IOtaBackend() = default;
+
+        /**
+         * @brief Prepares the inactive partition for a new image.
+         * @param imageSize The size of the image in bytes.
+         * @return True on success.
+         */
+        virtual bool begin(size_t imageSize) = 0;
+
+        /**
+         * @brief Appends a chunk of the image.
+         * @param data Pointer to the chunk.
+         * @param length Length of the chunk in bytes.
+         * @return True on success.
+         */
+        virtual bool write(const uint8_t* data, size_t length) = 0;
+
+        /**
+         * @brief Completes the write and validates the image.
+         * @return True if the image is valid.
+         */
+        virtual bool finish() = 0;
+
+        /**
+         * @brief Selects the written image for the next boot.
+         * @return True on success.
+         */
+        virtual bool activate() = 0;
+
+        /**
+         * @brief Discards a partially written image.
+         */
+        virtual void abort() = 0;
+};
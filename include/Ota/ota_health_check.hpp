@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * @class OtaHealthCheck
+ * @brief Confirms or rolls back a freshly installed firmware image.
+ *
+ * After an OTA update the bootloader starts the new image in the pending-verify state. The
+ * health check waits until the fans are running and the web server is listening, then marks
+ * the image as valid. Neither depends on the network: the listener is bound to any address, so an
+ * unreachable access point does not roll back a good image. If that does not happen within `OtaConfig::HEALTH_CHECK_TIMEOUT_MS`,
+ * the image is marked invalid and the device reboots into the previous firmware.
+ */
+class OtaHealthCheck {
+    public:
+        /**
+         * @brief Starts the health check if the running image is pending verification.
+         *
+         * Creates a short-lived task only when there is something to verify.
+         */
+        static void start();
+
+    private:
+        /**
+         * @brief Task waiting for the boot stages that prove the image is healthy.
+         * @param pvParameters Unused.
+         */
+        static void healthCheckTask(void* pvParameters);
+};
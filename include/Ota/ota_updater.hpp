@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mbedtls/sha256.h"
+
+#include "Ota/iota_backend.hpp"
+
+/**
+ * @brief State of a firmware update.
+ */
+enum class OtaState : uint8_t {
+    Idle,       ///< No update has been started since boot.
+    Receiving,  ///< An image is being received.
+    Succeeded,  ///< The image has been verified and selected for the next boot.
+    Failed      ///< The last update has been aborted.
+};
+
+/**
+ * @class OtaUpdater
+ * @brief Streams a firmware image into an OTA backend and verifies it.
+ *
+ * The image is passed through in the chunks it arrives in and is never buffered as a whole.
+ * A SHA-256 digest is computed on the fly; the update is only activated if the number of
+ * received bytes matches the announced size and the digest matches the expected one.
+ */
+class OtaUpdater {
+    public:
+        /**
+         * @brief Constructs an OtaUpdater object.
+         * @param backend The backend the image is written to.
+         */
+        OtaUpdater(IOtaBackend& backend);
+
+        ~OtaUpdater();
+
+        /**
+         * @brief Starts a new update.
+         * @param imageSize The announced size of the image in bytes.
+         * @param expectedSha256 The expected SHA-256 digest as 64 hex characters.
+         * @param expectedSha256Length Number of characters in `expectedSha256`.
+         * @return True if the update has been started.
+         */
+        bool begin(size_t imageSize, const char* expectedSha256, size_t expectedSha256Length);
+
+        /**
+         * @brief Passes the next chunk of the image to the backend.
+         *
+         * Data beyond the announced size aborts the update.
+         *
+         * @param data Pointer to the chunk.
+         * @param length Length of the chunk in bytes.
+         * @return True on success, false if the update has been aborted.
+         */
+        bool write(const uint8_t* data, size_t length);
+
+        /**
+         * @brief Verifies the received image and selects it for the next boot.
+         *
+         * Fails if the image is truncated, its digest does not match or the backend rejects it.
+         *
+         * @return True if the image is ready to boot.
+         */
+        bool finish();
+
+        /**
+         * @brief Aborts a running update, e.g. because the client disconnected.
+         * @param reason Description of why the update was aborted.
+         */
+        void abort(const char* reason);
+
+        /**
+         * @brief Returns whether all announced bytes have been received.
+         */
+        bool isComplete() const;
+
+        /**
+         * @brief Returns the state of the current or last update.
+         */
+        OtaState getState() const;
+
+        /**
+         * @brief Returns the number of bytes received so far.
+         */
+        size_t getReceived() const;
+
+        /**
+         * @brief Returns the announced image size.
+         */
+        size_t getImageSize() const;
+
+        /**
+         * @brief Returns why the last update failed, or an empty string.
+         */
+        const char* getError() const;
+
+    private:
+        IOtaBackend& _backend;                  ///< Backend the image is written to.
+        OtaState _state = OtaState::Idle;       ///< State of the current or last update.
+        size_t _imageSize = 0;                  ///< Announced image size.
+        size_t _received = 0;                   ///< Bytes received so far.
+        uint8_t _expectedSha256[32] = {};       ///< Expected SHA-256 digest.
+        mbedtls_sha256_context _sha256;         ///< Running digest of the received data.
+        const char* _error = "";                ///< Why the last update failed.
+
+        /**
+         * @brief Parses a hex encoded SHA-256 digest.
+         * @param hex The digest as hex characters.
+         * @param length Number of characters.
+         * @param digest Receives the 32 byte digest.
+         * @return True if the input was a valid digest.
+         */
+        static bool parseSha256(const char* hex, size_t length, uint8_t* digest);
+
+        /**
+         * @brief Marks the update as failed and discards the partial image.
+         * @param reason Description of the failure.
+         */
+        void fail(const char* reason);
+};
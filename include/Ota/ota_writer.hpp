@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "config.hpp"
+#include "Ota/ota_updater.hpp"
+#include "System/static_task.hpp"
+
+using namespace std;
+
+/**
+ * @class OtaWriter
+ * @brief Runs the flash work of an update on its own task, off the event loop.
+ *
+ * Erasing and writing a flash sector takes tens of milliseconds and validating the image at the
+ * end several hundred, during which the event loop would serve no other client. The event loop
+ * therefore only copies the received data into one of `OtaConfig::QUEUE_CHUNKS` chunk buffers
+ * of `OtaConfig::CHUNK_SIZE` bytes and queues it; the writer task passes the chunks to the
+ * `OtaUpdater` and finally verifies and activates the image. When all buffers are queued,
+ * `write()` accepts nothing and the caller leaves the data in the socket until the `notify`
+ * callback reports that a chunk has been written.
+ *
+ * `begin()` runs on the event loop, since sequential OTA writes erase nothing up front.
+ * All other methods except the getters must be called from the event loop as well.
+ */
+class OtaWriter {
+    public:
+        /**
+         * @brief Constructs an OtaWriter object.
+         * @param updater The updater the chunks are passed to.
+         * @param notify Callback invoked from the writer task after a chunk has been written and
+         *               after the update has been finished or aborted.
+         */
+        OtaWriter(OtaUpdater& updater, function<void()> notify);
+
+        /**
+         * @brief Creates the chunk queue and the writer task.
+         */
+        void start();
+
+        /**
+         * @brief Aborts a running update and stops the writer task.
+         *
+         * Blocks until the task has exited.
+         */
+        void stop();
+
+        /**
+         * @brief Starts a new update.
+         * @param imageSize The announced size of the image in bytes.
+         * @param expectedSha256 The expected SHA-256 digest as 64 hex characters.
+         * @param expectedSha256Length Number of characters in `expectedSha256`.
+         * @return True if the update has been started.
+         */
+        bool begin(size_t imageSize, const char* expectedSha256, size_t expectedSha256Length);
+
+        /**
+         * @brief Copies image data into the chunk buffers.
+         *
+         * Full chunks are queued for the writer task. Data beyond the announced size is ignored.
+         *
+         * @param data Pointer to the data.
+         * @param length Length of the data in bytes.
+         * @return Number of bytes taken, less than `length` if all chunk buffers are in use.
+         */
+        size_t write(const uint8_t* data, size_t length);
+
+        /**
+         * @brief Queues the last partial chunk and the verification of the image.
+         *
+         * Must only be called once all announced bytes have been taken by `write()`.
+         */
+        void finish();
+
+        /**
+         * @brief Discards the update, e.g. because the client disconnected.
+         *
+         * Chunks that are still queued are dropped without being written.
+         *
+         * @param reason Description of why the update was aborted.
+         */
+        void abort(const char* reason);
+
+        /**
+         * @brief Returns true between `begin()` and the acknowledgement of its outcome.
+         */
+        bool isBusy() const;
+
+        /**
+         * @brief Returns whether all announced bytes have been taken by `write()`.
+         */
+        bool isComplete() const;
+
+        /**
+         * @brief Takes the outcome of a finished or aborted update.
+         *
+         * Once taken, the writer is free for the next update.
+         *
+         * @return True if the update has ended, its state is then available from the updater.
+         */
+        bool takeOutcome();
+
+    private:
+        /**
+         * @brief What the writer task is asked to do.
+         */
+        enum class CommandType : uint8_t {
+            Write,   ///< Write a chunk buffer.
+            Finish,  ///< Verify and activate the image.
+            Abort,   ///< Discard the image.
+            Stop     ///< Exit the task.
+        };
+
+        /**
+         * @brief An entry of the command queue.
+         */
+        struct Command {
+            CommandType type;       ///< What to do.
+            uint16_t length;        ///< Bytes in the chunk buffer, for `Write`.
+            uint8_t* data;          ///< The chunk buffer, for `Write`.
+            const char* reason;     ///< Why the update was aborted, for `Abort`.
+        };
+
+        // The chunks plus one command that ends the update, so finish() and abort() always find room
+        static constexpr size_t QUEUE_DEPTH = OtaConfig::QUEUE_CHUNKS + 1;
+
+        OtaUpdater& _updater;                                           ///< Receives the chunks on the writer task.
+        function<void()> _notify;                                       ///< Wakes the event loop.
+        QueueHandle_t _queue = nullptr;                                 ///< Commands for the writer task.
+        StaticQueue<Command, QUEUE_DEPTH> _queueStorage;                ///< Storage of `_queue`.
+        SemaphoreHandle_t _exited = nullptr;                            ///< Given by the writer task when it exits.
+        StaticSemaphore_t _exitedBuffer;                                ///< Storage of `_exited`.
+        static StaticTask<TaskConfig::OTA_WRITER_TASK.stackSize> _task; ///< The writer task.
+        static uint8_t _chunks[OtaConfig::QUEUE_CHUNKS][OtaConfig::CHUNK_SIZE]; ///< Chunk buffers, used round robin.
+        uint32_t _chunksQueued = 0;                                     ///< Chunks handed to the writer task, event loop only.
+        atomic<uint32_t> _chunksWritten{0};                             ///< Chunks the writer task is done with.
+        size_t _fill = 0;                                               ///< Bytes in the chunk buffer being filled.
+        size_t _imageSize = 0;                                          ///< Announced image size.
+        size_t _taken = 0;                                              ///< Bytes taken by `write()`.
+        bool _busy = false;                                             ///< An update has begun and its outcome has not been taken.
+        bool _ending = false;                                           ///< The command ending the update has been queued.
+        atomic<bool> _ended{false};                                     ///< The writer task has processed the ending command.
+        atomic<bool> _abortRequested{false};                            ///< Queued chunks are skipped instead of written.
+
+        /**
+         * @brief Returns the chunk buffer that is filled next.
+         */
+        uint8_t* currentChunk() const;
+
+        /**
+         * @brief Returns whether a chunk buffer is free for filling.
+         */
+        bool hasFreeChunk() const;
+
+        /**
+         * @brief Queues the chunk buffer being filled.
+         */
+        void queueChunk();
+
+        /**
+         * @brief Writer task body: executes the queued commands in order.
+         * @param arg Pointer to the `OtaWriter` instance.
+         */
+        static void writerTask(void* arg);
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/**
+ * @brief Milestones of the startup sequence, in the order they are normally reached.
+ */
+enum class BootStage : uint8_t {
+    NvsReady,           ///< NVS is initialized.
+    SpiffsReady,        ///< The SPIFFS partition is mounted.
+    FansReady,          ///< PWM and tacho of all fans are initialized.
+    FirstAirflow,       ///< The fan cycle has started, or resumed after a warm restart.
+    WifiStarted,        ///< The Wi-Fi driver is started and connecting.
+    IpReady,            ///< The station interface has its IP address.
+    ServerReady,        ///< The web server is listening.
+    FirstHttpResponse,  ///< The first HTTP response has been sent.
+    Count
+};
+
+/**
+ * @class BootSequence
+ * @brief Tracks the startup dependencies between subsystems and measures their timing.
+ *
+ * Each stage is a bit in a FreeRTOS event group. Subsystems mark the stages they complete and
+ * tasks that depend on a stage block on it instead of starting blindly. The time of the first
+ * `markReached()` of every stage is recorded relative to boot.
+ */
+class BootSequence {
+    public:
+        /**
+         * @brief Creates the event group. Must be called before any other method.
+         */
+        static void init();
+
+        /**
+         * @brief Marks a stage as reached.
+         *
+         * Only the first call per stage records a timestamp. Safe to call from any task.
+         *
+         * @param stage The stage that has been reached.
+         */
+        static void markReached(BootStage stage);
+
+        /**
+         * @brief Returns whether a stage has been reached.
+         * @param stage The stage to check.
+         */
+        static bool isReached(BootStage stage);
+
+        /**
+         * @brief Blocks until a stage has been reached.
+         * @param stage The stage to wait for.
+         * @param timeout Maximum time to wait in ticks.
+         * @return True if the stage has been reached, false on timeout.
+         */
+        static bool waitFor(BootStage stage, TickType_t timeout = portMAX_DELAY);
+
+        /**
+         * @brief Returns the time a stage was reached.
+         * @param stage The stage to query.
+         * @return Milliseconds since boot, or 0 if the stage has not been reached yet.
+         */
+        static uint32_t getStageTimeMs(BootStage stage);
+
+        /**
+         * @brief Returns the name of a stage for logs and reports.
+         * @param stage The stage to name.
+         */
+        static const char* getStageName(BootStage stage);
+
+        /**
+         * @brief Logs the time of every stage reached so far.
+         */
+        static void logTimings();
+
+    private:
+        static EventGroupHandle_t _stages;                                      ///< One bit per reached stage.
+        static StaticEventGroup_t _stagesBuffer;                                ///< Storage of `_stages`.
+        static int64_t _stageTimesUs[static_cast<size_t>(BootStage::Count)];    ///< Time each stage was first reached.
+
+        /**
+         * @brief Returns the event group bit of a stage.
+         * @param stage The stage.
+         */
+        static EventBits_t bit(BootStage stage);
+};
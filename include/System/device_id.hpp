@@ -0,0 +1,19 @@
+#pragma once
+
+/**
+ * @class DeviceId
+ * @brief Identifies this dryer among others on the same network.
+ *
+ * The id is the last three bytes of the station MAC address as six lowercase hex digits,
+ * e.g. `a1b2c3`. It names the MQTT topics and the node in the fleet.
+ */
+class DeviceId {
+    public:
+        /**
+         * @brief Returns the id of this device.
+         */
+        static const char* get();
+
+    private:
+        static char _id[7];  ///< The id, empty until first requested.
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class JitterHistogram
+ * @brief Counts how late a periodic task wakes up, in fixed buckets.
+ *
+ * Written by the measured task and read by others; every counter is a single 32-bit word, so
+ * readers may see a sample that is only partly recorded but never a torn value.
+ */
+class JitterHistogram {
+    public:
+        // Upper bound of each bucket in microseconds, samples above the last bound go to an overflow bucket
+        static constexpr uint32_t BUCKET_LIMITS_US[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000};
+        static constexpr size_t BUCKET_COUNT = sizeof(BUCKET_LIMITS_US) / sizeof(BUCKET_LIMITS_US[0]) + 1;
+
+        /**
+         * @brief Records one wakeup.
+         * @param latenessUs How much later than scheduled the task ran, in microseconds.
+         */
+        void record(uint32_t latenessUs);
+
+        /**
+         * @brief Returns the number of recorded wakeups.
+         */
+        uint32_t getCount() const;
+
+        /**
+         * @brief Returns the largest lateness in microseconds.
+         */
+        uint32_t getMaxUs() const;
+
+        /**
+         * @brief Returns the number of wakeups in a bucket.
+         * @param bucket Index of the bucket, less than `BUCKET_COUNT`.
+         */
+        uint32_t getBucket(size_t bucket) const;
+
+    private:
+        uint32_t _count = 0;                     ///< Number of recorded wakeups.
+        uint32_t _maxUs = 0;                     ///< Largest lateness.
+        uint32_t _buckets[BUCKET_COUNT] = {};    ///< Wakeups per bucket.
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#include "esp_pm.h"
+#include "freertos/FreeRTOS.h"
+
+#include "config.hpp"
+
+/**
+ * @brief Time the chip spent saving power.
+ */
+struct PowerStats {
+    bool enabled;          ///< True if frequency scaling and light sleep are configured.
+    bool fansRunning;      ///< True while the fans keep the chip at full speed.
+    uint32_t lightSleeps;  ///< Light sleep periods since startup.
+    uint64_t sleepUs;      ///< Total time spent in light sleep.
+    uint64_t restingUs;    ///< Total time with the fans off, in which the chip may slow down and sleep.
+    uint64_t uptimeUs;     ///< Time since power management was started.
+};
+
+/**
+ * @class PowerManager
+ * @brief Lets the chip scale its clock and sleep while the fans rest.
+ *
+ * Frequency scaling and automatic light sleep are configured once at startup. While the fans run,
+ * two PM locks keep the CPU at full speed and the chip awake, since the tacho interrupts cannot
+ * wake it. While they rest, FreeRTOS enters light sleep whenever all tasks wait; Wi-Fi modem sleep
+ * wakes the radio for every DTIM beacon. PWM timers on the RC_FAST clock keep their output through
+ * light sleep, the others freeze at duty 0, which is the output of a resting fan anyway.
+ *
+ * Without `CONFIG_PM_ENABLE` the configuration fails and the chip simply stays at full speed.
+ */
+class PowerManager {
+    public:
+        /**
+         * @brief Configures frequency scaling and light sleep. The chip stays at full speed until
+         *        the fan cycle reports its first phase.
+         * @return True if power management is active.
+         */
+        static bool init();
+
+        /**
+         * @brief Holds the chip at full speed while the fans run and releases it while they rest.
+         * @param running True if the fans have been started.
+         */
+        static void setFansRunning(bool running);
+
+        /**
+         * @brief Returns true if the chip may currently slow down and sleep.
+         */
+        static bool isSaving();
+
+        /**
+         * @brief Returns the time the chip last left light sleep, 0 if it never slept.
+         */
+        static int64_t getLastWakeUs();
+
+        /**
+         * @brief Returns the residency counters.
+         */
+        static PowerStats getStats();
+
+    private:
+        static esp_pm_lock_handle_t _cpuLock;    ///< Keeps the CPU at its maximum frequency.
+        static esp_pm_lock_handle_t _sleepLock;  ///< Prevents light sleep.
+        static bool _enabled;                    ///< True if `esp_pm_configure()` succeeded.
+        static bool _fansRunning;                ///< True while the locks are held.
+        static int64_t _initUs;                  ///< Time of `init()`.
+        static int64_t _restingSinceUs;          ///< Start of the current resting phase.
+        static uint64_t _restingUs;              ///< Resting time of completed phases.
+        static uint32_t _lightSleeps;            ///< Light sleep periods.
+        static uint64_t _sleepUs;                ///< Total light sleep time.
+        static int64_t _lastWakeUs;              ///< Time the chip last left light sleep.
+        static portMUX_TYPE _lock;               ///< Protects the counters, the sleep callback runs on either core.
+
+        /**
+         * @brief Counts a light sleep period, called by the idle task right after waking.
+         * @param sleepTimeUs Duration of the sleep.
+         * @param arg Unused.
+         */
+        static esp_err_t on_sleep_exit(int64_t sleepTimeUs, void* arg);
+};
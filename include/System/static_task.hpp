@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "config.hpp"
+#include "System/task_monitor.hpp"
+
+/**
+ * @class StaticTask
+ * @brief Storage for a FreeRTOS task whose stack and control block are allocated at compile time.
+ *
+ * Instances are meant to have static storage duration, so the memory of every long-lived task
+ * is part of the image and never comes from the heap. Created tasks are registered with the
+ * `TaskMonitor`, which reports their stack high-water marks.
+ *
+ * @tparam StackSize Stack size in bytes, normally the `stackSize` of a `TaskConfig` entry.
+ */
+template<size_t StackSize>
+class StaticTask {
+    public:
+        /**
+         * @brief Creates the task in the static storage.
+         *
+         * The storage may only be reused after the previous task has been deleted.
+         *
+         * @param function The task body.
+         * @param config Name, priority and core of the task.
+         * @param arg Argument passed to the task body.
+         * @return The handle of the created task.
+         */
+        TaskHandle_t create(TaskFunction_t function, const TaskConfig::TaskConfig& config, void* arg = nullptr) {
+            static_assert(StackSize >= configMINIMAL_STACK_SIZE, "Stack is smaller than the FreeRTOS minimum");
+
+            // ESP-IDF measures stacks in bytes, so StackType_t is a single byte
+            TaskHandle_t handle = xTaskCreateStaticPinnedToCore(function, config.tag, StackSize, arg, config.priority, _stack, &_taskBuffer, config.core);
+            TaskMonitor::add(handle, config.tag, StackSize);
+            return handle;
+        }
+
+    private:
+        StackType_t _stack[StackSize];  ///< The task stack.
+        StaticTask_t _taskBuffer;       ///< The task control block.
+};
+
+/**
+ * @class StaticQueue
+ * @brief Storage for a FreeRTOS queue whose items and control block are allocated at compile time.
+ *
+ * @tparam T Item type, copied into the queue with `memcpy`.
+ * @tparam Depth Maximum number of queued items.
+ */
+template<typename T, size_t Depth>
+class StaticQueue {
+    public:
+        /**
+         * @brief Creates the queue in the static storage.
+         * @return The handle of the created queue.
+         */
+        QueueHandle_t create() {
+            return xQueueCreateStatic(Depth, sizeof(T), _storage, &_queueBuffer);
+        }
+
+    private:
+        uint8_t _storage[Depth * sizeof(T)];  ///< The queued items.
+        StaticQueue_t _queueBuffer;           ///< The queue control block.
+};
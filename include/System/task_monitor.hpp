@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "config.hpp"
+
+/**
+ * @brief Stack usage of a monitored task.
+ */
+struct TaskStackInfo {
+    const char* name;     ///< Name of the task.
+    uint32_t stackSize;   ///< Configured stack size in bytes.
+    uint32_t minFree;     ///< Smallest amount of free stack seen so far, in bytes.
+    int core;             ///< Core the task is pinned to, -1 if it may run on either.
+};
+
+/**
+ * @class TaskMonitor
+ * @brief Keeps track of the long-lived tasks and reports their stack high-water marks.
+ *
+ * The configured stack sizes in `TaskConfig` are checked against these numbers: a task should keep
+ * `TaskConfig::STACK_HEADROOM` bytes free under load, anything beyond that is wasted RAM.
+ */
+class TaskMonitor {
+    public:
+        /**
+         * @brief Starts monitoring a task. Tasks beyond `TaskConfig::MAX_MONITORED_TASKS` are ignored.
+         * @param handle The task handle.
+         * @param name Name of the task, must stay valid while the task is monitored.
+         * @param stackSize Configured stack size in bytes.
+         */
+        static void add(TaskHandle_t handle, const char* name, uint32_t stackSize);
+
+        /**
+         * @brief Stops monitoring a task. Must be called before a monitored task deletes itself.
+         * @param handle The task handle.
+         */
+        static void remove(TaskHandle_t handle);
+
+        /**
+         * @brief Returns the number of monitored tasks.
+         */
+        static size_t getCount();
+
+        /**
+         * @brief Reads the stack usage of a monitored task.
+         * @param index Index of the task, less than `getCount()`.
+         * @param info Receives the stack usage.
+         * @return True if the task exists, false otherwise.
+         */
+        static bool getInfo(size_t index, TaskStackInfo& info);
+
+    private:
+        struct Entry {
+            TaskHandle_t handle;
+            const char* name;
+            uint32_t stackSize;
+        };
+
+        static Entry _entries[TaskConfig::MAX_MONITORED_TASKS];  ///< Monitored tasks.
+        static size_t _count;                                     ///< Number of valid entries.
+        static portMUX_TYPE _lock;                                ///< Protects the entries.
+};
@@ -7,33 +7,71 @@
 #include "config_secrets.hpp"
 
 namespace FanConfig {
+    // Longest fan or group name including the terminating zero
+    constexpr size_t MAX_NAME_LENGTH = 16;
+
     struct Config {
-        const char* name; 
+        char name[MAX_NAME_LENGTH];
         gpio_num_t pwmPin;
-        gpio_num_t tachoPin;
-        ledc_channel_t channel; 
-        ledc_timer_t timer;
+        gpio_num_t tachoPin;       // GPIO_NUM_NC if the fan has no tacho signal
+        ledc_mode_t speedMode;     // Assigned by FanTopology from the channel
+        ledc_channel_t channel;    // LEDC_CHANNEL_MAX lets FanTopology pick a free channel
+        ledc_timer_t timer;        // Assigned by FanTopology, fans with the same frequency share a timer
+        ledc_clk_cfg_t clock;      // Assigned by FanTopology, RC_FAST keeps the PWM running in light sleep
+        uint32_t frequency;        // PWM frequency in Hz
         uint8_t fanPower;          // Max. Fan power in percent (0 - 100)
+        char group[MAX_NAME_LENGTH];  // Fans of the same group can be commanded as one unit, empty for none
     };
 
+    // Fan definitions are read from this file, the two fans below are used if it is missing or invalid
+    constexpr const char* TOPOLOGY_PATH = "/spiffs/fans.json";
+
     constexpr Config FAN_FRONT = {
             .name = "Front",
             .pwmPin = GPIO_NUM_27, 
             .tachoPin = GPIO_NUM_14, 
+            .speedMode = LEDC_LOW_SPEED_MODE,
             .channel = LEDC_CHANNEL_0, 
             .timer = LEDC_TIMER_0,
-            .fanPower = 60
+            .clock = LEDC_USE_RC_FAST_CLK,
+            .frequency = 25000,
+            .fanPower = 60,
+            .group = ""
         }; 
 
     constexpr Config FAN_BACK = {
             .name = "Back",
             .pwmPin = GPIO_NUM_32, 
             .tachoPin = GPIO_NUM_33, 
+            .speedMode = LEDC_LOW_SPEED_MODE,
             .channel = LEDC_CHANNEL_1, 
-            .timer = LEDC_TIMER_1,
-            .fanPower = 70
+            .timer = LEDC_TIMER_0,
+            .clock = LEDC_USE_RC_FAST_CLK,
+            .frequency = 25000,
+            .fanPower = 70,
+            .group = ""
         }; 
 
+    // Maximum number of fans, one per LEDC channel (8 low speed and 8 high speed channels)
+    constexpr uint8_t MAX_FANS = 16;
+
+    // Upper bound for the size of the topology file in bytes
+    constexpr size_t MAX_TOPOLOGY_FILE_SIZE = 4096;
+
+    // PWM frequency of fans that do not specify one, the 4-pin fan standard, in Hz
+    constexpr uint32_t DEFAULT_FREQUENCY = 25000;
+
+    // Accepted PWM frequencies in Hz
+    constexpr uint32_t MIN_FREQUENCY = 100;
+    constexpr uint32_t MAX_FREQUENCY = 100000;
+
+    // The 8 MHz RC_FAST clock carries 8 bit PWM up to about 31 kHz, faster low speed fans move all
+    // low speed timers to the APB clock, which stops in light sleep
+    constexpr uint32_t MAX_SLEEP_CLOCK_FREQUENCY = 30000;
+
+    // GPIOs 6 to 11 are wired to the SPI flash and must never be used for fans
+    constexpr uint64_t RESERVED_PIN_MASK = 0x0FC0ULL;
+
     constexpr uint8_t MAX_DUTY = 255;
 
     // How often should the fans run in seconds
@@ -42,6 +80,18 @@ namespace FanConfig {
     // Duration how long the fans should run in seconds
     constexpr uint16_t RUNTIME_OF_FANS = 600;    
 
+    // Period of the fan control loop, queued changes are applied once per tick, in milliseconds
+    constexpr uint16_t CONTROL_TICK_MS = 100;
+
+    // The elapsed time of the current phase is written to the RTC checkpoint at this interval, in milliseconds
+    constexpr uint32_t CHECKPOINT_INTERVAL_MS = 1000;
+
+    // Number of command batches that may wait for the next control tick
+    constexpr uint8_t COMMAND_QUEUE_DEPTH = 4;
+
+    // Maximum number of fan changes in one command batch, after groups have been expanded
+    constexpr uint8_t MAX_BATCH_FANS = MAX_FANS;
+
     // how often tacho speed shall be determined, in milliseconds
     constexpr uint16_t TACHO_UPDATE_CYCLE = 1000; 
 
@@ -55,9 +105,22 @@ namespace Network {
     constexpr const char* GATEWAY = "192.168.178.1";      // Gateway
     constexpr const char* SUBNET = "255.255.255.0";       // Subnetzmask
     constexpr const char* DNS = "192.168.178.100";        // DNS-Server
+    constexpr const char* BIND_ADDRESS = "0.0.0.0";       // Listeners accept on any address, so they open before the IP is assigned
 
     constexpr const char* WIFI_SSID = WIFI_SSID_SECRET; // SSID from config_secrets.hpp
     constexpr const char* WIFI_PASS = WIFI_PASS_SECRET; // Password from config_secrets.hpp
+
+    // Reconnect backoff: the delay doubles per failed attempt, starting at the base delay
+    constexpr uint32_t RECONNECT_BASE_DELAY_MS = 1000;
+    constexpr uint32_t RECONNECT_MAX_DELAY_MS = 30000;
+    constexpr uint8_t RECONNECT_JITTER_PERCENT = 25;
+
+    // Failed attempts on the cached BSSID/channel before falling back to a full scan
+    constexpr uint8_t CACHED_AP_MAX_FAILURES = 2;
+
+    // NVS location of the cached access point
+    constexpr const char* WIFI_NVS_NAMESPACE = "wifi";
+    constexpr const char* WIFI_NVS_AP_KEY = "ap";
 }
 
 namespace TaskConfig {
@@ -66,25 +129,291 @@ namespace TaskConfig {
         size_t stackSize;  // Stack-Größe
         UBaseType_t priority;  // Priorität
         const char* tag;  // Tag für den Task
+        BaseType_t core;  // Core the task is pinned to
     };
 
+    // Core 0 runs Wi-Fi, lwIP, esp_timer and everything network facing. Core 1 only runs the
+    // fan control task and the tacho interrupts, so network load cannot delay a control tick.
+    constexpr BaseType_t NETWORK_CORE = 0;
+    constexpr BaseType_t CONTROL_CORE = 1;
+
+    // Priorities: fan control outranks every application task and is alone on its core.
+    // On core 0 the system tasks (Wi-Fi 23, esp_timer 22, event loop 20, lwIP 18) come first,
+    // then the web server, its workers and finally background jobs.
+
+    // The stack sizes below are estimates, not derived from measured high-water marks: no load
+    // run on a device has been recorded yet. Check them against minFree in the "tasks" section
+    // of /stats, every task should keep at least STACK_HEADROOM bytes free under load.
+    constexpr uint32_t STACK_HEADROOM = 1024;
+
+    // Wi-Fi is driven by the system event task, only the tag of this entry is used
     constexpr TaskConfig WIFI_TASK = {
         .stackSize = 4096,
         .priority = 3,
-        .tag = "WiFiManager"
+        .tag = "WiFiManager",
+        .core = NETWORK_CORE
     };
 
     constexpr TaskConfig FAN_TASK = {
         .stackSize = 4096,
-        .priority = 4,
-        .tag = "FanControl"
+        .priority = 10,
+        .tag = "FanControl",
+        .core = CONTROL_CORE
     };
 
+    // TLS handshakes run on the event loop and need the larger stack
     constexpr TaskConfig WEB_SERVER_TASK = {
-        .stackSize = 4096,
+        .stackSize = 10240,
         .priority = 5,
-        .tag = "WebServer"
+        .tag = "WebServer",
+        .core = NETWORK_CORE
+    };
+
+    constexpr TaskConfig HTTP_WORKER_TASK = {
+        .stackSize = 4096,
+        .priority = 4,
+        .tag = "HttpWorker",
+        .core = NETWORK_CORE
     };
+
+    // Writes uploaded firmware to flash; esp_ota_end() verifies the image on this stack
+    constexpr TaskConfig OTA_WRITER_TASK = {
+        .stackSize = 4096,
+        .priority = 3,
+        .tag = "OtaWriter",
+        .core = NETWORK_CORE
+    };
+
+    constexpr TaskConfig OTA_HEALTH_TASK = {
+        .stackSize = 3072,
+        .priority = 2,
+        .tag = "OtaHealth",
+        .core = NETWORK_CORE
+    };
+
+    // Log tag of the startup sequence
+    constexpr const char* BOOT_TAG = "Boot";
+
+    // Number of long-lived tasks whose stack usage is tracked
+    constexpr uint8_t MAX_MONITORED_TASKS = 8;
+}
+
+namespace ServerConfig {
+    // Number of worker tasks that run slow handlers (SPIFFS reads, exports) off the event loop
+    constexpr uint8_t WORKER_COUNT = 2;
+
+    // Jobs that may wait per worker before further requests are rejected with 503
+    constexpr uint8_t WORKER_QUEUE_DEPTH = 4;
+
+    // Response buffer of each worker in bytes, reused for every job; bounds the size of a static
+    // file (scripts.js is the largest at about 8 KB) and of the trace replay summary
+    constexpr size_t WORKER_BUFFER_SIZE = 10 * 1024;
+
+    // Upper bound for mg_mgr_poll; posted events wake the loop immediately
+    constexpr int POLL_TIMEOUT_MS = 1000;
+
+    // How long a shutdown waits for connections to flush their pending data
+    constexpr uint16_t SHUTDOWN_TIMEOUT_MS = 500;
+
+    // Maximum number of client connections, further clients get a 503
+    constexpr uint8_t MAX_CONNECTIONS = 6;
+
+    // Maximum size of unparsed data buffered per connection in bytes
+    constexpr size_t MAX_RECV_BUFFER = 4096;
+
+    // Maximum size of unsent data buffered per event stream connection in bytes
+    constexpr size_t MAX_SEND_BUFFER = 8192;
+
+    // Maximum request body size in bytes, checked against Content-Length before parsing
+    constexpr size_t MAX_BODY_SIZE = 2048;
+
+    // Connections without traffic for this long are closed, in milliseconds
+    constexpr uint32_t IDLE_TIMEOUT_MS = 30000;
+
+    // Memory for the temporary allocations of one request, fits the /stats document including
+    // the growth of cJSON's print buffer; larger requests fall back to the heap
+    constexpr size_t REQUEST_ARENA_SIZE = 12 * 1024;
+
+    // Buffer for a CBOR response in bytes, fits GET /fan with the maximum number of fans and
+    // their usage counters
+    constexpr size_t MAX_CBOR_RESPONSE_SIZE = 2560;
+
+    // HTTPS is served on this port if a certificate and its key are found on SPIFFS
+    constexpr uint16_t TLS_PORT = 8443;
+    constexpr const char* TLS_CERT_PATH = "/spiffs/cert.pem";
+    constexpr const char* TLS_KEY_PATH = "/spiffs/key.pem";
+
+    // Largest certificate or key file in bytes
+    constexpr size_t MAX_PEM_SIZE = 4096;
+
+    // Each TLS connection holds about 25 KB of mbedTLS buffers, further HTTPS clients are refused
+    constexpr uint8_t MAX_TLS_CONNECTIONS = 2;
+
+    // Clients may resume a session for this long instead of a full handshake, in seconds
+    constexpr uint32_t TLS_SESSION_LIFETIME_S = 24 * 60 * 60;
+
+    // Sessions kept for resumption by session ID, for clients that do not support tickets
+    constexpr int TLS_SESSION_CACHE_SIZE = 4;
+}
+
+namespace OtaConfig {
+    constexpr const char* TAG = "OTA";
+
+    // Header carrying the expected SHA-256 digest of the uploaded image as hex
+    constexpr const char* SHA256_HEADER = "X-Firmware-SHA256";
+
+    // How long a new firmware has to reach a healthy state before it is rolled back
+    constexpr uint32_t HEALTH_CHECK_TIMEOUT_MS = 120000;
+
+    // The upload is written to flash by its own task in chunks of this size; the event loop
+    // buffers at most this many chunks ahead of the flash, further data waits in the socket
+    constexpr size_t CHUNK_SIZE = 2048;
+    constexpr uint8_t QUEUE_CHUNKS = 2;
+
+    // Delay between a successful upload and the restart, so the response reaches the client
+    constexpr uint32_t RESTART_DELAY_MS = 1000;
+}
+
+namespace SettingsConfig {
+    // NVS location of the persisted settings
+    constexpr const char* NVS_NAMESPACE = "settings";
+    constexpr const char* NVS_KEY = "fans";
+
+    // Layout version of the settings blob, increment whenever StoredSettings changes
+    constexpr uint16_t BLOB_VERSION = 1;
+
+    // Changes are written once no further change happened for this long, in milliseconds
+    constexpr uint32_t COMMIT_DELAY_MS = 5000;
+
+    // Pending changes are written at the latest after this long, in milliseconds
+    constexpr uint32_t MAX_COMMIT_DELAY_MS = 30000;
+
+    // Capacity of the settings blob
+    constexpr uint8_t MAX_STORED_FANS = FanConfig::MAX_FANS;
+    constexpr uint8_t MAX_FAN_NAME_LENGTH = FanConfig::MAX_NAME_LENGTH;
+}
+
+namespace WearConfig {
+    // NVS location of the fan usage counters
+    constexpr const char* NVS_NAMESPACE = "wear";
+    constexpr const char* NVS_KEY = "fans";
+
+    // Layout version of the counter blob, increment whenever StoredWear changes
+    constexpr uint16_t BLOB_VERSION = 1;
+
+    // The counters are written whenever the fans stop and at the latest at this interval; a power
+    // loss forgets at most this much usage. In milliseconds
+    constexpr uint32_t SAVE_INTERVAL_MS = 15 * 60 * 1000;
+}
+
+namespace MqttConfig {
+    constexpr const char* TAG = "MQTT";
+
+    // Broker receiving the telemetry, topics are <TOPIC_PREFIX>/<last 3 bytes of the MAC>/...
+    constexpr const char* BROKER_URL = "mqtt://192.168.178.100:1883";
+    constexpr const char* TOPIC_PREFIX = "cannadryer";
+
+    // The fan state is sampled at this cadence and published in frames of several samples
+    constexpr uint32_t SAMPLE_INTERVAL_MS = 5000;
+    constexpr uint8_t SAMPLES_PER_FRAME = 6;
+
+    // Samples kept while the broker is unreachable, 10 minutes at the default cadence;
+    // when full the oldest samples are dropped
+    constexpr size_t QUEUE_SAMPLES = 120;
+
+    // At most one frame is published per drain interval, which bounds the burst after a reconnect
+    constexpr uint32_t DRAIN_INTERVAL_MS = 200;
+
+    // A frame that has not been acknowledged after this long is sent again, in milliseconds
+    constexpr uint32_t ACK_TIMEOUT_MS = 10000;
+
+    // Delay between connection attempts in milliseconds
+    constexpr uint32_t RECONNECT_DELAY_MS = 5000;
+
+    // Keep-alive announced to the broker in seconds, a ping is sent after half of it without traffic
+    constexpr uint16_t KEEPALIVE_S = 60;
+
+    // Buffer for one encoded frame in bytes
+    constexpr size_t MAX_FRAME_SIZE = 1536;
+
+    // The usage counters of the fans are published retained at this interval, in milliseconds
+    constexpr uint32_t WEAR_INTERVAL_MS = 10 * 60 * 1000;
+}
+
+namespace FleetConfig {
+    constexpr const char* TAG = "Fleet";
+
+    // Dryers find each other by announcing themselves to this multicast group
+    constexpr const char* MULTICAST_GROUP = "239.255.42.99";
+    constexpr uint16_t PORT = 4210;
+
+    // Every node announces itself and its fan state at this interval, in milliseconds
+    constexpr uint32_t ANNOUNCE_INTERVAL_MS = 2000;
+
+    // Nodes not heard from for this long are considered gone, in milliseconds
+    constexpr uint32_t NODE_TIMEOUT_MS = 3 * ANNOUNCE_INTERVAL_MS + 1000;
+
+    // Other nodes tracked at the same time
+    constexpr size_t MAX_NODES = 8;
+
+    // Largest announcement in bytes, stays below the Ethernet MTU to avoid fragmentation
+    constexpr size_t MAX_DATAGRAM_SIZE = 1400;
+
+    // Largest fleet configuration in bytes, it is repeated in the coordinator's announcements
+    constexpr size_t MAX_CONFIG_SIZE = 512;
+
+    // The shared key that signs the announcements and the boot counter that orders them live
+    // in this NVS namespace; without a key the fleet stays disabled
+    constexpr const char* NVS_NAMESPACE = "fleet";
+    constexpr const char* NVS_KEY = "key";
+    constexpr const char* NVS_EPOCH_KEY = "epoch";
+
+    // Length of the shared key in bytes, set as twice as many hex characters
+    constexpr size_t KEY_SIZE = 32;
+
+    // Senders whose last announcement is remembered to reject replays, outlives the node timeout
+    constexpr size_t MAX_SENDERS = 2 * MAX_NODES;
+}
+
+namespace TraceConfig {
+    constexpr const char* TAG = "Trace";
+
+    // Recordings are written to this file, a new recording replaces the previous one
+    constexpr const char* PATH = "/spiffs/trace.bin";
+
+    // Events buffered in RAM between two flushes, 8 bytes each; four fans at 3000 rpm produce
+    // 400 tacho edges per second, so the buffer covers slow SPIFFS writes of more than a second
+    constexpr size_t BUFFER_EVENTS = 1024;
+
+    // The buffered events are written to the file at this interval, in milliseconds
+    constexpr uint32_t FLUSH_INTERVAL_MS = 250;
+
+    // A recording ends once the file has this size or after this duration; the duration stays
+    // below the 71 minutes after which the 32 bit microsecond timestamps would wrap
+    constexpr size_t MAX_FILE_SIZE = 192 * 1024;
+    constexpr uint32_t MAX_DURATION_MS = 60 * 60 * 1000;
+
+    // Events read from the file at once during a replay
+    constexpr size_t REPLAY_CHUNK_EVENTS = 64;
+
+    // Phase transitions of a replay may differ from the recorded ones by this many control ticks
+    // before they count as a mismatch, which absorbs the scheduling jitter of the recording
+    constexpr uint8_t REPLAY_TOLERANCE_TICKS = 2;
+}
+
+namespace PowerConfig {
+    constexpr const char* TAG = "Power";
+
+    // Scale the CPU clock and enter light sleep while the fans rest; needs CONFIG_PM_ENABLE and
+    // CONFIG_FREERTOS_USE_TICKLESS_IDLE, without them the chip stays at full speed
+    constexpr bool ENABLED = true;
+
+    // CPU clock while the fans run and the lowest while they rest (the crystal), in MHz
+    constexpr int MAX_CPU_FREQ_MHZ = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    constexpr int MIN_CPU_FREQ_MHZ = 40;
+
+    // A request parsed within this time after the chip left light sleep is counted as having woken it, in microseconds
+    constexpr int64_t WAKE_WINDOW_US = 50000;
 }
 
 namespace SPIFFSConfig {
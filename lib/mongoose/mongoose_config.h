@@ -1 +1,9 @@
-#define MG_ARCH MG_ARCH_ESP32
\ No newline at end of file
+#define MG_ARCH MG_ARCH_ESP32
+
+// Grow connection buffers in small steps and cap them, the ESP32 has little RAM to spare.
+// The per-connection limits in ServerConfig are enforced below these hard caps.
+#define MG_IO_SIZE 512
+#define MG_MAX_RECV_SIZE (8 * 1024)
+
+// HTTPS uses the mbedTLS of ESP-IDF
+#define MG_TLS MG_TLS_MBED
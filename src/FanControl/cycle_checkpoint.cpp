@@ -0,0 +1,45 @@
+#include "FanControl/cycle_checkpoint.hpp"
+
+#include <cstddef>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+// "CYCL", distinguishes a written record from leftovers of other firmware
+static constexpr uint32_t RECORD_MAGIC = 0x4359434C;
+
+// Increment whenever CycleState changes
+static constexpr uint16_t RECORD_VERSION = 1;
+
+RTC_NOINIT_ATTR CycleCheckpoint::Record CycleCheckpoint::_record;
+
+void CycleCheckpoint::save(const CycleState& state) {
+    _record.magic = RECORD_MAGIC;
+    _record.version = RECORD_VERSION;
+    _record.state = state;
+    _record.crc = checksum(_record);
+}
+
+bool CycleCheckpoint::restore(CycleState& state) {
+    // RTC memory only holds meaningful data if the chip was reset without losing power
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool warm = reason == ESP_RST_SW || reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT ||
+                reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+    if (!warm) {
+        return false;
+    }
+
+    if (_record.magic != RECORD_MAGIC || _record.version != RECORD_VERSION || _record.crc != checksum(_record)) {
+        ESP_LOGW(TaskConfig::FAN_TASK.tag, "Warm restart (reason %d) without a valid checkpoint", reason);
+        return false;
+    }
+
+    state = _record.state;
+    return true;
+}
+
+uint32_t CycleCheckpoint::checksum(const Record& record) {
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&record), offsetof(Record, crc));
+}
@@ -1,37 +1,56 @@
 #include "FanControl/fan.hpp"
 
+#include "FanControl/trace_recorder.hpp"
+
 // Constructor to initialize pin variables
-Fan::Fan(const FanConfig::Config& config)
+Fan::Fan(const FanConfig::Config& config, uint8_t index, bool simulated)
     : config(config),
+      _index(index),
       _counterRPM(0),
       _lastRPM(0),
-      _lastTachoMeasurement(0) {}
+      _lastTachoMeasurement(0),
+      _running(false),
+      _simulated(simulated),
+      _totalPulses(0),
+      _countedPulses(0),
+      _wear{},
+      _wearLock(portMUX_INITIALIZER_UNLOCKED) {}
+
+// Initialize the LEDC timer of a fan, fans sharing a timer only need this once
+void Fan::initTimer(const FanConfig::Config& config) {
+    ledc_timer_config_t timer_config = {};
+    timer_config = {
+        .speed_mode = config.speedMode,
+        .duty_resolution = LEDC_TIMER_8_BIT,
+        .timer_num = config.timer,
+        .freq_hz = config.frequency,
+        .clk_cfg = config.clock
+    };
+    ESP_ERROR_CHECK(ledc_timer_config(&timer_config));
+}
 
 // Initialize PWM for fan control
 void Fan::initPWM() {
+    // Fans stay off until the cycle decides, it may resume in the resting phase
     ledc_channel_config_t channel_config = {
         .gpio_num = config.pwmPin,
-        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .speed_mode = config.speedMode,
         .channel = config.channel,
         .intr_type = LEDC_INTR_DISABLE,
-        .duty = FanConfig::MAX_DUTY,
+        .timer_sel = config.timer,
+        .duty = 0,
         .hpoint = 0
     };
     ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
-
-    ledc_timer_config_t timer_config = {};
-    timer_config = {
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .duty_resolution = LEDC_TIMER_8_BIT,
-        .timer_num = config.timer,
-        .freq_hz = 25000,   // 25kHz
-        .clk_cfg = LEDC_AUTO_CLK
-    };
-    ESP_ERROR_CHECK(ledc_timer_config(&timer_config));
 }
 
 // Initialize tachometer for RPM measurement
 void Fan::initTacho() {
+    if (config.tachoPin == GPIO_NUM_NC) {
+        ESP_LOGI(TaskConfig::FAN_TASK.tag, "Fan %s has no tachometer", config.name);
+        return;
+    }
+
     gpio_config_t io_conf = {};
     io_conf.intr_type = GPIO_INTR_POSEDGE;
     io_conf.pin_bit_mask = (1ULL << config.tachoPin);
@@ -45,41 +64,144 @@ void Fan::initTacho() {
 
 // Interrupt Service Routine (ISR) for counting fan rotations (placed in IRAM)
 void Fan::rpmFanISR(void* arg) {
+    // Relaxed increments are enough, the counters are only ever read as a whole
     Fan* fanControl = static_cast<Fan*>(arg);
-    fanControl->_counterRPM++;
+    fanControl->_counterRPM.fetch_add(1, memory_order_relaxed);
+    fanControl->_totalPulses.fetch_add(1, memory_order_relaxed);
+    TraceRecorder::recordFromISR(TraceEventType::TachoEdge, fanControl->_index, 0);
 };
 
-uint16_t Fan::getSpeed() {
-    unsigned long currentTime = esp_timer_get_time() / 1000;
-
-    if ((currentTime - _lastTachoMeasurement) >= FanConfig::TACHO_UPDATE_CYCLE) {
-        // Temporarily disable interrupts while calculating RPM
-        gpio_intr_disable(config.tachoPin); 
+void Fan::countPulse() {
+    _counterRPM.fetch_add(1, memory_order_relaxed);
+    _totalPulses.fetch_add(1, memory_order_relaxed);
+}
 
-        _lastRPM = _counterRPM * (60.0 / FanConfig::NUMBER_OF_INTERRUPS_IN_ONE_SINGLE_ROTATION) * (1000.0 / FanConfig::TACHO_UPDATE_CYCLE);
+void Fan::updateSpeed(int64_t nowMs) {
+    if (config.tachoPin == GPIO_NUM_NC || _simulated) {
+        return;
+    }
 
-        _counterRPM = 0;
-        _lastTachoMeasurement = currentTime;
+    // The first call only opens a window, the pulses since boot span an unknown time
+    if (_lastTachoMeasurement == 0) {
+        _counterRPM.store(0, memory_order_relaxed);
+        _lastTachoMeasurement = nowMs;
+        return;
+    }
 
-        // Re-enable interrupts
-        gpio_intr_enable(config.tachoPin);
+    // Sparse ticks while the fans rest make windows longer, so the actual length is used
+    int64_t windowMs = nowMs - _lastTachoMeasurement;
+    if (windowMs >= FanConfig::TACHO_UPDATE_CYCLE) {
+        // Taking and clearing the count in one step loses no pulse, so the interrupt stays enabled
+        uint32_t pulses = _counterRPM.exchange(0, memory_order_relaxed);
+        _lastRPM.store(rpmFromPulses(pulses, static_cast<uint32_t>(windowMs)), memory_order_relaxed);
+        _lastTachoMeasurement = nowMs;
     }
+}
 
-    return _lastRPM;
+uint16_t Fan::getLastSpeed() const {
+    return _lastRPM.load(memory_order_relaxed);
 }
 
-// Set fan speed using PWM duty cycle (0-255)
+uint16_t Fan::rpmFromPulses(uint32_t pulses, uint32_t windowMs) {
+    return pulses * (60.0 / FanConfig::NUMBER_OF_INTERRUPS_IN_ONE_SINGLE_ROTATION) * (1000.0 / windowMs);
+}
+
+// Set the configured fan power, applied right away while the fan is running
 void Fan::setPower(uint8_t percent) {
-    int dutyCycle = static_cast<int>(percent * static_cast<float>(FanConfig::MAX_DUTY) / 100.0f);
+    stagePower(percent);
+    latchPower();
+}
+
+void Fan::stagePower(uint8_t percent) {
+    // Powering up a running fan from 0 is a start as well
+    if (_running && config.fanPower == 0 && percent > 0) {
+        portENTER_CRITICAL(&_wearLock);
+        _wear.starts++;
+        portEXIT_CRITICAL(&_wearLock);
+    }
 
     // Update the current config
     config.fanPower = percent;
 
-    ESP_ERROR_CHECK(ledc_set_duty(LEDC_LOW_SPEED_MODE, config.channel, dutyCycle));
-    ESP_ERROR_CHECK(ledc_update_duty(LEDC_LOW_SPEED_MODE, config.channel));
+    if (_running && !_simulated) {
+        int dutyCycle = static_cast<int>(percent * static_cast<float>(FanConfig::MAX_DUTY) / 100.0f);
+        ESP_ERROR_CHECK(ledc_set_duty(config.speedMode, config.channel, dutyCycle));
+    }
+}
+
+void Fan::latchPower() {
+    if (_running && !_simulated) {
+        ESP_ERROR_CHECK(ledc_update_duty(config.speedMode, config.channel));
+        TraceRecorder::record(TraceEventType::Duty, _index, config.fanPower);
+    }
+}
+
+void Fan::start() {
+    if (!_running && config.fanPower > 0) {
+        portENTER_CRITICAL(&_wearLock);
+        _wear.starts++;
+        portEXIT_CRITICAL(&_wearLock);
+    }
+    _running = true;
+    applyPower(config.fanPower);
+}
+
+void Fan::stop() {
+    _running = false;
+    applyPower(0);
+}
+
+// Set fan speed using PWM duty cycle (0-255)
+void Fan::applyPower(uint8_t percent) {
+    if (_simulated) {
+        return;
+    }
+
+    int dutyCycle = static_cast<int>(percent * static_cast<float>(FanConfig::MAX_DUTY) / 100.0f);
+
+    ESP_ERROR_CHECK(ledc_set_duty(config.speedMode, config.channel, dutyCycle));
+    ESP_ERROR_CHECK(ledc_update_duty(config.speedMode, config.channel));
+    TraceRecorder::record(TraceEventType::Duty, _index, percent);
 }
 
 // Returns the configuration of the fan
 const FanConfig::Config& Fan::getConfig() {
     return config;
 }
+
+uint8_t Fan::getIndex() const {
+    return _index;
+}
+
+void Fan::accumulateWear(uint32_t elapsedMs) {
+    // Only whole revolutions are taken, the remaining pulses are counted next time
+    uint32_t revolutions = (_totalPulses.load(memory_order_relaxed) - _countedPulses) / FanConfig::NUMBER_OF_INTERRUPS_IN_ONE_SINGLE_ROTATION;
+    _countedPulses += revolutions * FanConfig::NUMBER_OF_INTERRUPS_IN_ONE_SINGLE_ROTATION;
+
+    uint8_t power = _running ? config.fanPower : 0;
+    portENTER_CRITICAL(&_wearLock);
+    _wear.revolutions += revolutions;
+    if (power > 0) {
+        _wear.onTimeMs += elapsedMs;
+        _wear.dutyPercentMs += static_cast<uint64_t>(elapsedMs) * power;
+    }
+    portEXIT_CRITICAL(&_wearLock);
+}
+
+FanWear Fan::getWear() const {
+    portENTER_CRITICAL(&_wearLock);
+    FanWear wear = _wear;
+    portEXIT_CRITICAL(&_wearLock);
+    return wear;
+}
+
+void Fan::restoreWear(const FanWear& wear) {
+    portENTER_CRITICAL(&_wearLock);
+    _wear = wear;
+    portEXIT_CRITICAL(&_wearLock);
+}
+
+uint32_t Fan::rpmAtFullPower(const FanWear& wear) {
+    // revolutions / (dutyPercentMs / 100 / 60000)
+    return wear.dutyPercentMs > 0 ? static_cast<uint32_t>(wear.revolutions * 6000000ULL / wear.dutyPercentMs) : 0;
+}
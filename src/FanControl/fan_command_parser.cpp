@@ -0,0 +1,69 @@
+#include "FanControl/fan_command_parser.hpp"
+
+#include <cstring>
+#include <memory>
+
+const char* FanCommandParser::parse(const char* json, size_t length, FanCommandBatch& batch) {
+    // Parse the text once for all commands
+    auto jsonDeleter = [](cJSON* json) { cJSON_Delete(json); };
+    unique_ptr<cJSON, decltype(jsonDeleter)> root(cJSON_ParseWithLength(json, length), jsonDeleter);
+
+    if (!root) {
+        return "Invalid JSON body";
+    }
+    return parse(root.get(), batch);
+}
+
+const char* FanCommandParser::parse(const cJSON* root, FanCommandBatch& batch) {
+    if (!cJSON_IsObject(root)) {
+        return "Invalid JSON body";
+    }
+
+    batch = {};
+
+    // Collect the per-fan power changes
+    const cJSON* fans = cJSON_GetObjectItemCaseSensitive(root, "fans");
+    if (fans) {
+        if (!cJSON_IsArray(fans) || cJSON_GetArraySize(fans) > FanConfig::MAX_BATCH_FANS) {
+            return "Invalid 'fans' array";
+        }
+
+        const cJSON* entry;
+        cJSON_ArrayForEach(entry, fans) {
+            // An entry addresses either a single fan or all fans of a group
+            const cJSON* group = cJSON_GetObjectItemCaseSensitive(entry, "group");
+            const cJSON* name = group ? group : cJSON_GetObjectItemCaseSensitive(entry, "name");
+            const cJSON* power = cJSON_GetObjectItemCaseSensitive(entry, "power");
+            if (!cJSON_IsString(name) || strlen(name->valuestring) >= sizeof(batch.fans[0].name) ||
+                !cJSON_IsNumber(power) || power->valueint < 0 || power->valueint > 100) {
+                return "Invalid fan entry";
+            }
+
+            FanCommandBatch::FanChange& change = batch.fans[batch.fanCount++];
+            strcpy(change.name, name->valuestring);
+            change.power = static_cast<uint8_t>(power->valueint);
+            change.isGroup = group != nullptr;
+        }
+    }
+
+    // Collect the optional cycle durations
+    const cJSON* interval = cJSON_GetObjectItemCaseSensitive(root, "interval");
+    if (interval) {
+        if (!cJSON_IsNumber(interval) || interval->valueint <= 0 || interval->valueint > UINT16_MAX) {
+            return "Invalid 'interval' value";
+        }
+        batch.hasInterval = true;
+        batch.interval = static_cast<uint16_t>(interval->valueint);
+    }
+
+    const cJSON* runtimeOfFans = cJSON_GetObjectItemCaseSensitive(root, "runtimeOfFans");
+    if (runtimeOfFans) {
+        if (!cJSON_IsNumber(runtimeOfFans) || runtimeOfFans->valueint <= 0 || runtimeOfFans->valueint > UINT16_MAX) {
+            return "Invalid 'runtimeOfFans' value";
+        }
+        batch.hasRuntimeOfFans = true;
+        batch.runtimeOfFans = static_cast<uint16_t>(runtimeOfFans->valueint);
+    }
+
+    return nullptr;
+}
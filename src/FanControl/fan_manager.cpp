@@ -1,50 +1,495 @@
 #include "FanControl/fan_manager.hpp"
 
+#include <algorithm>
+#include <cstring>
+
+#include "esp_rom_crc.h"
+
+#include "System/boot_sequence.hpp"
+#include "System/power_manager.hpp"
+
+FanManager::FanManager(bool simulated)
+    : _simulated(simulated),
+      _listenerMutex(xSemaphoreCreateMutexStatic(&_listenerMutexBuffer)) {}
+
 void FanManager::createFan(const FanConfig::Config& config) {
-    _fans[config.name] = make_shared<Fan>(config);
+    _fans.push_back(make_shared<Fan>(config, static_cast<uint8_t>(_fans.size()), _simulated));
 }
 
 void FanManager::initializeAllFans() {
-    for (auto& [name, fan] : _fans) {
+    _commandQueue = _commandQueueStorage.create();
+    if (_simulated) {
+        return;
+    }
+
+    // Configure every shared timer once, before the channels that use it
+    bool timerConfigured[LEDC_SPEED_MODE_MAX][LEDC_TIMER_MAX] = {};
+    for (auto& fan : _fans) {
+        const FanConfig::Config& config = fan->getConfig();
+        if (!timerConfigured[config.speedMode][config.timer]) {
+            Fan::initTimer(config);
+            timerConfigured[config.speedMode][config.timer] = true;
+        }
+    }
+
+    for (auto& fan : _fans) {
         fan->initPWM();
         fan->initTacho();
     }
+    BootSequence::markReached(BootStage::FansReady);
+}
+
+void FanManager::loadSettings() {
+    // Start from the settings currently in effect, i.e. the defaults
+    StoredSettings settings = {};
+    settings.interval = _interval;
+    settings.runtimeOfFans = _runtimeOfFans;
+    for (auto& fan : _fans) {
+        if (settings.fanCount == SettingsConfig::MAX_STORED_FANS) {
+            ESP_LOGW(TaskConfig::FAN_TASK.tag, "Too many fans, settings of %s are not persisted", fan->getConfig().name);
+            continue;
+        }
+        StoredFanSettings& stored = settings.fans[settings.fanCount++];
+        strncpy(stored.name, fan->getConfig().name, sizeof(stored.name) - 1);
+        stored.fanPower = fan->getConfig().fanPower;
+    }
+
+    // Apply whatever has been stored on top of the defaults
+    if (_settingsStore.load(settings)) {
+        _interval = settings.interval;
+        _runtimeOfFans = settings.runtimeOfFans;
+        for (uint8_t i = 0; i < settings.fanCount; i++) {
+            findFan(settings.fans[i].name)->setPower(settings.fans[i].fanPower);
+        }
+        ESP_LOGI(TaskConfig::FAN_TASK.tag, "Loaded stored settings");
+    }
+
+    _settingsStore.init(settings);
+}
+
+void FanManager::loadWear() {
+    if (_wearStore.init(_fans)) {
+        ESP_LOGI(TaskConfig::FAN_TASK.tag, "Loaded fan usage counters");
+    }
+}
+
+bool FanManager::restoreCheckpoint() {
+    CycleState state;
+    if (!CycleCheckpoint::restore(state)) {
+        return false;
+    }
+    if (!resume(state)) {
+        ESP_LOGW(TaskConfig::FAN_TASK.tag, "Checkpoint does not match the fans, starting a new cycle");
+        return false;
+    }
+    return true;
+}
+
+bool FanManager::resume(const CycleState& state) {
+    // Powers are stored by position, so they only apply to the same fans
+    if (state.fanCount != _fans.size() || state.topologyHash != topologyHash() || state.interval == 0 || state.runtimeOfFans == 0) {
+        return false;
+    }
+
+    // Changes that had not been committed to NVS before the reset are persisted now
+    setInterval(state.interval);
+    setRuntimeOfFans(state.runtimeOfFans);
+    for (uint8_t i = 0; i < state.fanCount; i++) {
+        _fans[i]->setPower(state.power[i]);
+        _settingsStore.setFanPower(_fans[i]->getConfig().name, state.power[i]);
+    }
+
+    _running = state.running;
+    _resumeElapsedMs = state.elapsedMs;
+    _resumed = true;
+    return true;
+}
+
+bool FanManager::wasResumed() const {
+    return _resumed;
 }
 
 void FanManager::runTask() {
+    int64_t now = esp_timer_get_time();
+    beginCycle(now);
+    BootSequence::markReached(BootStage::FirstAirflow);
+
+    if (_resumed) {
+        ESP_LOGI(TaskConfig::FAN_TASK.tag, "Resumed %s phase after %lu s, %lld ms after boot", _running ? "running" : "resting",
+                 static_cast<unsigned long>(_resumeElapsedMs / 1000), now / 1000);
+    }
+
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t scheduledUs = 0;
     while (true) {
-        startFans();
+        int64_t now;
+        if (_running) {
+            vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(FanConfig::CONTROL_TICK_MS));
+
+            // The first wakeup is aligned to a tick and anchors the schedule, later ones are measured against it
+            now = esp_timer_get_time();
+            if (scheduledUs == 0) {
+                scheduledUs = now;
+            } else {
+                scheduledUs += FanConfig::CONTROL_TICK_MS * 1000LL;
+                _tickJitter.record(now > scheduledUs ? static_cast<uint32_t>(now - scheduledUs) : 0);
+            }
+        } else {
+            // Resting wakeups follow no schedule, the periodic ticks start over from the next running one
+            waitWhileResting();
+            now = esp_timer_get_time();
+            lastWake = xTaskGetTickCount();
+            scheduledUs = 0;
+        }
 
-        vTaskDelay((_runtimeOfFans * 1000) / portTICK_PERIOD_MS);
+        controlTick(now);
+        _tickCost.record(static_cast<uint32_t>(esp_timer_get_time() - now));
+    }
+}
 
-        logFanSpeeds();
+int64_t FanManager::getRestingDeadlineUs() const {
+    int64_t deadlineUs = _phaseStartUs + _interval * 1000000LL;
+    deadlineUs = min<int64_t>(deadlineUs, _lastCheckpointUs + FanConfig::CHECKPOINT_INTERVAL_MS * 1000LL);
+    return min<int64_t>(deadlineUs, _lastWearSaveUs + WearConfig::SAVE_INTERVAL_MS * 1000LL);
+}
+
+void FanManager::waitWhileResting() {
+    int64_t waitUs = getRestingDeadlineUs() - esp_timer_get_time();
+    if (waitUs <= 0) {
+        return;
+    }
+
+    // Rounded up to whole ticks, so the tick never comes before its deadline
+    constexpr int64_t TICK_US = portTICK_PERIOD_MS * 1000LL;
+    FanCommandBatch batch;
+    xQueuePeek(_commandQueue, &batch, static_cast<TickType_t>((waitUs + TICK_US - 1) / TICK_US));
+}
+
+const JitterHistogram& FanManager::getTickJitter() const {
+    return _tickJitter;
+}
 
+const LatencyStats& FanManager::getTickCost() const {
+    return _tickCost;
+}
+
+void FanManager::startTrace() {
+    _traceRequested = true;
+}
+
+void FanManager::beginCycle(int64_t now) {
+    // Continue an interrupted cycle where it was, otherwise begin with the running phase
+    if (_resumed && !_running) {
         stopFans();
+    } else {
+        startFans();
+    }
+    _phaseStartUs = now - _resumeElapsedMs * 1000LL;
+    _lastWearUs = now;
+    _lastWearSaveUs = now;
+    saveCheckpoint(now);
+}
+
+bool FanManager::isPhaseOver(bool running, int64_t elapsedMs, uint16_t interval, uint16_t runtimeOfFans) {
+    return running ? elapsedMs >= runtimeOfFans * 1000LL : elapsedMs >= interval * 1000LL;
+}
+
+void FanManager::controlTick(int64_t now) {
+    // Usage since the last tick is charged to the powers the fans had until now
+    accumulateWear(now);
 
-        vTaskDelay((_interval * 1000) / portTICK_PERIOD_MS);
+    // Speeds are only measured here, everyone else reads the stored values
+    for (auto& fan : _fans) {
+        fan->updateSpeed(now / 1000);
+    }
+
+    // A recording starts from the state before this tick's commands
+    if (_traceRequested.exchange(false)) {
+        beginTrace(now);
+    }
+
+    // Apply everything that arrived since the last tick
+    bool changed = false;
+    FanCommandBatch batch;
+    while (xQueueReceive(_commandQueue, &batch, 0) == pdTRUE) {
+        applyBatch(batch);
+        changed = true;
+    }
+
+    // Advance the cycle, changed durations take effect for the current phase
+    int64_t elapsedMs = (now - _phaseStartUs) / 1000;
+    if (isPhaseOver(_running, elapsedMs, _interval, _runtimeOfFans)) {
+        if (_running) {
+            logFanSpeeds();
+            stopFans();
+            saveWear(now);
+        } else {
+            startFans();
+        }
+        record(TraceEventType::Phase, 0, _running);
+        _phaseStartUs = now;
+        changed = true;
+    }
+
+    // Transitions and commands are checkpointed immediately, the elapsed time periodically
+    if (changed || now - _lastCheckpointUs >= FanConfig::CHECKPOINT_INTERVAL_MS * 1000LL) {
+        saveCheckpoint(now);
+    }
+}
+
+void FanManager::accumulateWear(int64_t now) {
+    // Whole milliseconds are charged, the remainder is carried into the next tick
+    uint32_t elapsedMs = static_cast<uint32_t>((now - _lastWearUs) / 1000);
+    for (auto& fan : _fans) {
+        fan->accumulateWear(elapsedMs);
+    }
+    _lastWearUs += elapsedMs * 1000LL;
+
+    if (now - _lastWearSaveUs >= WearConfig::SAVE_INTERVAL_MS * 1000LL) {
+        saveWear(now);
     }
 }
 
+void FanManager::saveWear(int64_t now) {
+    for (auto& fan : _fans) {
+        _wearStore.setFanWear(fan->getIndex(), fan->getWear());
+    }
+    _wearStore.requestCommit();
+    _lastWearSaveUs = now;
+}
+
+CycleState FanManager::captureState(int64_t now) const {
+    CycleState state = {};
+    state.running = _running;
+    state.elapsedMs = static_cast<uint32_t>((now - _phaseStartUs) / 1000);
+    state.interval = _interval;
+    state.runtimeOfFans = _runtimeOfFans;
+    state.topologyHash = topologyHash();
+    state.fanCount = static_cast<uint8_t>(_fans.size());
+    for (size_t i = 0; i < _fans.size(); i++) {
+        state.power[i] = _fans[i]->getConfig().fanPower;
+    }
+    return state;
+}
+
+void FanManager::saveCheckpoint(int64_t now) {
+    if (_simulated) {
+        return;
+    }
+    CycleCheckpoint::save(captureState(now));
+    _lastCheckpointUs = now;
+}
+
+void FanManager::beginTrace(int64_t now) {
+    TraceHeader header = {};
+    header.state = captureState(now);
+    for (size_t i = 0; i < _fans.size(); i++) {
+        strncpy(header.names[i], _fans[i]->getConfig().name, sizeof(header.names[i]) - 1);
+        if (_fans[i]->getConfig().tachoPin != GPIO_NUM_NC) {
+            header.tachoMask |= 1 << i;
+        }
+    }
+    TraceRecorder::begin(header);
+}
+
+void FanManager::record(TraceEventType type, uint8_t fan, uint16_t value) {
+    // A replay must not end up in a recording that is running at the same time
+    if (!_simulated) {
+        TraceRecorder::record(type, fan, value);
+    }
+}
+
+uint32_t FanManager::topologyHash() const {
+    uint32_t hash = 0;
+    for (const auto& fan : _fans) {
+        const char* name = fan->getConfig().name;
+        hash = esp_rom_crc32_le(hash, reinterpret_cast<const uint8_t*>(name), strlen(name) + 1);
+    }
+    return hash;
+}
+
+BatchResult FanManager::submitBatch(const FanCommandBatch& batch) {
+    if (batch.fanCount == 0 && !batch.hasInterval && !batch.hasRuntimeOfFans) {
+        return BatchResult::Empty;
+    }
+    if (batch.fanCount > FanConfig::MAX_BATCH_FANS) {
+        return BatchResult::InvalidValue;
+    }
+    if ((batch.hasInterval && batch.interval == 0) || (batch.hasRuntimeOfFans && batch.runtimeOfFans == 0)) {
+        return BatchResult::InvalidValue;
+    }
+
+    // Validate everything up front so the batch is applied completely or not at all,
+    // groups are replaced by their members so the fan task only sees single fans
+    FanCommandBatch expanded = batch;
+    expanded.fanCount = 0;
+    for (uint8_t i = 0; i < batch.fanCount; i++) {
+        const FanCommandBatch::FanChange& change = batch.fans[i];
+        if (change.power > 100) {
+            return BatchResult::InvalidValue;
+        }
+
+        if (!change.isGroup) {
+            if (findFan(change.name) == nullptr) {
+                return BatchResult::UnknownFan;
+            }
+            if (expanded.fanCount == FanConfig::MAX_BATCH_FANS) {
+                return BatchResult::InvalidValue;
+            }
+            expanded.fans[expanded.fanCount++] = change;
+            continue;
+        }
+
+        if (!hasGroup(change.name)) {
+            return BatchResult::UnknownFan;
+        }
+        for (const auto& fan : _fans) {
+            if (strcmp(fan->getConfig().group, change.name) != 0) {
+                continue;
+            }
+            if (expanded.fanCount == FanConfig::MAX_BATCH_FANS) {
+                return BatchResult::InvalidValue;
+            }
+            FanCommandBatch::FanChange& member = expanded.fans[expanded.fanCount++];
+            strcpy(member.name, fan->getConfig().name);
+            member.power = change.power;
+            member.isGroup = false;
+        }
+    }
+
+    if (_commandQueue == nullptr || xQueueSend(_commandQueue, &expanded, 0) != pdTRUE) {
+        return BatchResult::QueueFull;
+    }
+    return BatchResult::Accepted;
+}
+
+void FanManager::applyBatch(const FanCommandBatch& batch) {
+    // Load all duty cycles first, then latch them back to back
+    Fan* fans[FanConfig::MAX_BATCH_FANS];
+    for (uint8_t i = 0; i < batch.fanCount; i++) {
+        fans[i] = findFan(batch.fans[i].name);
+        fans[i]->stagePower(batch.fans[i].power);
+        record(TraceEventType::Power, fans[i]->getIndex(), batch.fans[i].power);
+    }
+    for (uint8_t i = 0; i < batch.fanCount; i++) {
+        fans[i]->latchPower();
+    }
+
+    // Persist in the background
+    for (uint8_t i = 0; i < batch.fanCount; i++) {
+        _settingsStore.setFanPower(batch.fans[i].name, batch.fans[i].power);
+    }
+    if (batch.hasInterval) {
+        setInterval(batch.interval);
+        record(TraceEventType::Interval, 0, batch.interval);
+    }
+    if (batch.hasRuntimeOfFans) {
+        setRuntimeOfFans(batch.runtimeOfFans);
+        record(TraceEventType::RuntimeOfFans, 0, batch.runtimeOfFans);
+    }
+
+    notifyStateChanged();
+}
+
 void FanManager::logFanSpeeds() {
-    for (auto& [name, fan] : _fans) {
-        ESP_LOGI(TaskConfig::FAN_TASK.tag, "Fan Speed %s: %d", fan->getConfig().name, fan->getSpeed());
+    if (_simulated) {
+        return;
+    }
+    for (auto& fan : _fans) {
+        ESP_LOGI(TaskConfig::FAN_TASK.tag, "Fan Speed %s: %d", fan->getConfig().name, fan->getLastSpeed());
     }
 }
 
 void FanManager::stopFans() {
-    for (auto& [name, fan] : _fans) {
-        fan->setPower(0);
+    for (auto& fan : _fans) {
+        fan->stop();
     }
+    _running = false;
+    if (!_simulated) {
+        PowerManager::setFansRunning(false);
+    }
+    notifyStateChanged();
 }
 
 void FanManager::startFans() {
-    for (auto& [name, fan] : _fans) {
-        fan->setPower(fan->getConfig().fanPower);
+    if (!_simulated) {
+        PowerManager::setFansRunning(true);
+    }
+    for (auto& fan : _fans) {
+        fan->start();
     }
+    _running = true;
+    notifyStateChanged();
+}
+
+bool FanManager::isRunning() const {
+    return _running;
+}
+
+void FanManager::setStateListener(function<void()> listener) {
+    xSemaphoreTake(_listenerMutex, portMAX_DELAY);
+    _stateListener = listener;
+    xSemaphoreGive(_listenerMutex);
+
+    // A call that copied the previous listener may still be running on the fan task
+    while (true) {
+        xSemaphoreTake(_listenerMutex, portMAX_DELAY);
+        uint32_t calls = _listenerCalls;
+        xSemaphoreGive(_listenerMutex);
+        if (calls == 0) {
+            break;
+        }
+        vTaskDelay(1);
+    }
+}
+
+void FanManager::notifyStateChanged() {
+    // The listener is called on a copy, so it may be replaced while it runs
+    xSemaphoreTake(_listenerMutex, portMAX_DELAY);
+    function<void()> listener = _stateListener;
+    if (listener) {
+        _listenerCalls++;
+    }
+    xSemaphoreGive(_listenerMutex);
+
+    if (!listener) {
+        return;
+    }
+    listener();
+
+    xSemaphoreTake(_listenerMutex, portMAX_DELAY);
+    _listenerCalls--;
+    xSemaphoreGive(_listenerMutex);
+}
+
+bool FanManager::setFanPower(const string& name, uint8_t percent) {
+    FanCommandBatch batch = {};
+    strncpy(batch.fans[0].name, name.c_str(), sizeof(batch.fans[0].name) - 1);
+    batch.fans[0].power = percent;
+    batch.fanCount = 1;
+    return submitBatch(batch) == BatchResult::Accepted;
+}
+
+BatchResult FanManager::setGroupPower(const string& group, uint8_t percent) {
+    FanCommandBatch batch = {};
+    strncpy(batch.fans[0].name, group.c_str(), sizeof(batch.fans[0].name) - 1);
+    batch.fans[0].power = percent;
+    batch.fans[0].isGroup = true;
+    batch.fanCount = 1;
+    return submitBatch(batch);
+}
+
+const SettingsStore& FanManager::getSettingsStore() const {
+    return _settingsStore;
+}
+
+const WearStore& FanManager::getWearStore() const {
+    return _wearStore;
 }
 
 void FanManager::setInterval(uint16_t new_interval) {
     _interval = new_interval;
+    _settingsStore.setInterval(new_interval);
 }
 
 uint16_t FanManager::getInterval() const {
@@ -53,6 +498,7 @@ uint16_t FanManager::getInterval() const {
 
 void FanManager::setRuntimeOfFans(uint16_t new_runtimeOfFans) {
     _runtimeOfFans = new_runtimeOfFans;
+    _settingsStore.setRuntimeOfFans(new_runtimeOfFans);
 }
 
 uint16_t FanManager::getRuntimeOfFans() const {
@@ -60,17 +506,35 @@ uint16_t FanManager::getRuntimeOfFans() const {
 }
 
 optional<shared_ptr<IFan>> FanManager::getFan(const string& name) const {
-    auto it = _fans.find(name);
-    if (it != _fans.end()) {
-        return static_pointer_cast<IFan>(it->second);
+    for (const auto& fan : _fans) {
+        if (name == fan->getConfig().name) {
+            return static_pointer_cast<IFan>(fan);
+        }
     }
     return nullopt;
 }
 
-unordered_map<string, shared_ptr<IFan>> FanManager::getFans() const {
-    unordered_map<string, shared_ptr<IFan>> fans;
-    for (const auto& [name, fan] : _fans) {
-        fans[name] = static_pointer_cast<IFan>(fan);
+const vector<shared_ptr<Fan>>& FanManager::getFans() const {
+    return _fans;
+}
+
+bool FanManager::hasGroup(const char* group) const {
+    if (group[0] == '\0') {
+        return false;
+    }
+    for (const auto& fan : _fans) {
+        if (strcmp(fan->getConfig().group, group) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Fan* FanManager::findFan(const char* name) const {
+    for (const auto& fan : _fans) {
+        if (strcmp(fan->getConfig().name, name) == 0) {
+            return fan.get();
+        }
     }
-    return fans;
-}
\ No newline at end of file
+    return nullptr;
+}
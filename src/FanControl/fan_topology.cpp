@@ -0,0 +1,247 @@
+#include "FanControl/fan_topology.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "esp_log.h"
+#include "soc/soc_caps.h"
+
+// Channels are numbered across speed modes: 0-7 are low speed, 8-15 high speed channels
+static constexpr size_t TOTAL_CHANNELS = LEDC_SPEED_MODE_MAX * LEDC_CHANNEL_MAX;
+
+static ledc_mode_t modeOfChannel(size_t index) {
+#if SOC_LEDC_SUPPORT_HS_MODE
+    return index < LEDC_CHANNEL_MAX ? LEDC_LOW_SPEED_MODE : LEDC_HIGH_SPEED_MODE;
+#else
+    return LEDC_LOW_SPEED_MODE;
+#endif
+}
+
+static size_t indexOfChannel(ledc_mode_t mode, ledc_channel_t channel) {
+    return (mode == LEDC_LOW_SPEED_MODE ? 0 : LEDC_CHANNEL_MAX) + channel;
+}
+
+bool FanTopology::loadFromFile(const char* path) {
+    _fans.clear();
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return fail("%s not found", path);
+    }
+
+    // Read the whole file, it is small and parsed only once at startup
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0 || size > static_cast<long>(FanConfig::MAX_TOPOLOGY_FILE_SIZE)) {
+        fclose(file);
+        return fail("%s has an invalid size of %ld bytes", path, size);
+    }
+
+    unique_ptr<char[]> content(new char[size]);
+    size_t bytesRead = fread(content.get(), 1, size, file);
+    fclose(file);
+    if (bytesRead != static_cast<size_t>(size)) {
+        return fail("Failed to read %s", path);
+    }
+
+    // Parse JSON with RAII for cleanup
+    auto jsonDeleter = [](cJSON* json) { cJSON_Delete(json); };
+    unique_ptr<cJSON, decltype(jsonDeleter)> json(cJSON_ParseWithLength(content.get(), size), jsonDeleter);
+    if (!json) {
+        return fail("%s is not valid JSON", path);
+    }
+
+    const cJSON* fans = cJSON_GetObjectItemCaseSensitive(json.get(), "fans");
+    if (!cJSON_IsArray(fans)) {
+        return fail("Missing 'fans' array");
+    }
+
+    vector<FanConfig::Config> configs;
+    const cJSON* entry;
+    cJSON_ArrayForEach(entry, fans) {
+        FanConfig::Config config = {};
+        if (!parseFan(entry, config)) {
+            return false;
+        }
+        configs.push_back(config);
+    }
+
+    if (!validate(configs)) {
+        return false;
+    }
+
+    _fans = move(configs);
+    return true;
+}
+
+void FanTopology::loadDefaults() {
+    vector<FanConfig::Config> configs = {FanConfig::FAN_FRONT, FanConfig::FAN_BACK};
+
+    // The built-in fans are valid by construction, this only assigns their timers
+    ESP_ERROR_CHECK(validate(configs) ? ESP_OK : ESP_ERR_INVALID_ARG);
+    _fans = move(configs);
+}
+
+const vector<FanConfig::Config>& FanTopology::getFans() const {
+    return _fans;
+}
+
+const string& FanTopology::getError() const {
+    return _error;
+}
+
+bool FanTopology::parseFan(const cJSON* json, FanConfig::Config& config) {
+    const cJSON* name = cJSON_GetObjectItemCaseSensitive(json, "name");
+    if (!cJSON_IsString(name) || name->valuestring[0] == '\0' || strlen(name->valuestring) >= sizeof(config.name)) {
+        return fail("Fan name missing or longer than %u characters", static_cast<unsigned>(sizeof(config.name) - 1));
+    }
+    strcpy(config.name, name->valuestring);
+
+    const cJSON* pwmPin = cJSON_GetObjectItemCaseSensitive(json, "pwmPin");
+    if (!cJSON_IsNumber(pwmPin)) {
+        return fail("Fan %s: missing 'pwmPin'", config.name);
+    }
+    config.pwmPin = static_cast<gpio_num_t>(pwmPin->valueint);
+
+    // Optional values fall back to sensible defaults
+    const cJSON* tachoPin = cJSON_GetObjectItemCaseSensitive(json, "tachoPin");
+    config.tachoPin = cJSON_IsNumber(tachoPin) && tachoPin->valueint >= 0 ? static_cast<gpio_num_t>(tachoPin->valueint) : GPIO_NUM_NC;
+
+    const cJSON* frequency = cJSON_GetObjectItemCaseSensitive(json, "frequency");
+    config.frequency = cJSON_IsNumber(frequency) ? static_cast<uint32_t>(frequency->valuedouble) : FanConfig::DEFAULT_FREQUENCY;
+
+    const cJSON* power = cJSON_GetObjectItemCaseSensitive(json, "power");
+    if (power && (!cJSON_IsNumber(power) || power->valueint < 0 || power->valueint > 100)) {
+        return fail("Fan %s: 'power' must be between 0 and 100", config.name);
+    }
+    config.fanPower = power ? static_cast<uint8_t>(power->valueint) : 100;
+
+    const cJSON* group = cJSON_GetObjectItemCaseSensitive(json, "group");
+    if (group && (!cJSON_IsString(group) || strlen(group->valuestring) >= sizeof(config.group))) {
+        return fail("Fan %s: 'group' must be a string of at most %u characters", config.name, static_cast<unsigned>(sizeof(config.group) - 1));
+    }
+    if (group) {
+        strcpy(config.group, group->valuestring);
+    }
+
+    const cJSON* channel = cJSON_GetObjectItemCaseSensitive(json, "channel");
+    if (channel) {
+        if (!cJSON_IsNumber(channel) || channel->valueint < 0 || channel->valueint >= static_cast<int>(TOTAL_CHANNELS)) {
+            return fail("Fan %s: 'channel' must be between 0 and %u", config.name, static_cast<unsigned>(TOTAL_CHANNELS - 1));
+        }
+        config.speedMode = modeOfChannel(channel->valueint);
+        config.channel = static_cast<ledc_channel_t>(channel->valueint % LEDC_CHANNEL_MAX);
+    } else {
+        config.speedMode = LEDC_LOW_SPEED_MODE;
+        config.channel = LEDC_CHANNEL_MAX;
+    }
+
+    return true;
+}
+
+bool FanTopology::validate(vector<FanConfig::Config>& fans) {
+    if (fans.empty() || fans.size() > FanConfig::MAX_FANS) {
+        return fail("Between 1 and %u fans are supported, got %u", static_cast<unsigned>(FanConfig::MAX_FANS), static_cast<unsigned>(fans.size()));
+    }
+
+    uint64_t usedPins = 0;
+    bool usedChannels[TOTAL_CHANNELS] = {};
+
+    for (size_t i = 0; i < fans.size(); i++) {
+        const FanConfig::Config& fan = fans[i];
+
+        // Names identify fans in the API and in the stored settings
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(fans[j].name, fan.name) == 0) {
+                return fail("Fan name %s is used twice", fan.name);
+            }
+        }
+
+        if (!GPIO_IS_VALID_OUTPUT_GPIO(fan.pwmPin) || (FanConfig::RESERVED_PIN_MASK & (1ULL << fan.pwmPin))) {
+            return fail("Fan %s: GPIO %d cannot drive PWM", fan.name, fan.pwmPin);
+        }
+        if (usedPins & (1ULL << fan.pwmPin)) {
+            return fail("Fan %s: GPIO %d is already in use", fan.name, fan.pwmPin);
+        }
+        usedPins |= 1ULL << fan.pwmPin;
+
+        if (fan.tachoPin != GPIO_NUM_NC) {
+            if (!GPIO_IS_VALID_GPIO(fan.tachoPin) || (FanConfig::RESERVED_PIN_MASK & (1ULL << fan.tachoPin))) {
+                return fail("Fan %s: GPIO %d cannot read the tacho", fan.name, fan.tachoPin);
+            }
+            if (usedPins & (1ULL << fan.tachoPin)) {
+                return fail("Fan %s: GPIO %d is already in use", fan.name, fan.tachoPin);
+            }
+            usedPins |= 1ULL << fan.tachoPin;
+        }
+
+        if (fan.frequency < FanConfig::MIN_FREQUENCY || fan.frequency > FanConfig::MAX_FREQUENCY) {
+            return fail("Fan %s: frequency %lu Hz is out of range", fan.name, static_cast<unsigned long>(fan.frequency));
+        }
+
+        // Reserve explicitly requested channels before free ones are handed out
+        if (fan.channel != LEDC_CHANNEL_MAX) {
+            size_t index = indexOfChannel(fan.speedMode, fan.channel);
+            if (usedChannels[index]) {
+                return fail("Fan %s: channel %u is already in use", fan.name, static_cast<unsigned>(index));
+            }
+            usedChannels[index] = true;
+        }
+    }
+
+    // Assign the lowest free channel to every fan that did not ask for one
+    for (auto& fan : fans) {
+        if (fan.channel != LEDC_CHANNEL_MAX) {
+            continue;
+        }
+        size_t index = 0;
+        while (usedChannels[index]) {
+            index++;
+        }
+        usedChannels[index] = true;
+        fan.speedMode = modeOfChannel(index);
+        fan.channel = static_cast<ledc_channel_t>(index % LEDC_CHANNEL_MAX);
+    }
+
+    // Fans with the same frequency share a timer, each speed mode has its own set of timers
+    uint32_t timerFrequencies[LEDC_SPEED_MODE_MAX][LEDC_TIMER_MAX] = {};
+    for (auto& fan : fans) {
+        uint32_t* frequencies = timerFrequencies[fan.speedMode];
+        size_t timer = 0;
+        while (timer < LEDC_TIMER_MAX && frequencies[timer] != 0 && frequencies[timer] != fan.frequency) {
+            timer++;
+        }
+        if (timer == LEDC_TIMER_MAX) {
+            return fail("Fan %s: more than %u different frequencies on one speed mode", fan.name, static_cast<unsigned>(LEDC_TIMER_MAX));
+        }
+        frequencies[timer] = fan.frequency;
+        fan.timer = static_cast<ledc_timer_t>(timer);
+    }
+
+    // All low speed timers share one clock source, high speed timers cannot use RC_FAST at all
+    bool sleepClock = true;
+    for (const auto& fan : fans) {
+        if (fan.speedMode == LEDC_LOW_SPEED_MODE && fan.frequency > FanConfig::MAX_SLEEP_CLOCK_FREQUENCY) {
+            sleepClock = false;
+        }
+    }
+    for (auto& fan : fans) {
+        fan.clock = fan.speedMode == LEDC_LOW_SPEED_MODE && sleepClock ? LEDC_USE_RC_FAST_CLK : LEDC_AUTO_CLK;
+    }
+
+    return true;
+}
+
+bool FanTopology::fail(const char* format, ...) {
+    char message[96];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    _error = message;
+    return false;
+}
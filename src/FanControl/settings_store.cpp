@@ -0,0 +1,173 @@
+#include "FanControl/settings_store.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+bool SettingsStore::load(StoredSettings& settings) {
+    nvs_handle_t handle;
+    if (nvs_open(SettingsConfig::NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    StoredSettings stored = {};
+    size_t size = sizeof(stored);
+    esp_err_t err = nvs_get_blob(handle, SettingsConfig::NVS_KEY, &stored, &size);
+    nvs_close(handle);
+
+    if (err != ESP_OK || size != sizeof(stored) || stored.version != SettingsConfig::BLOB_VERSION) {
+        ESP_LOGW(TaskConfig::FAN_TASK.tag, "No usable stored settings, using defaults");
+        return false;
+    }
+
+    settings.interval = stored.interval;
+    settings.runtimeOfFans = stored.runtimeOfFans;
+
+    // Only take over fans that still exist, in case the fan setup has changed
+    for (uint8_t i = 0; i < settings.fanCount; i++) {
+        for (uint8_t j = 0; j < std::min<uint8_t>(stored.fanCount, SettingsConfig::MAX_STORED_FANS); j++) {
+            if (strncmp(settings.fans[i].name, stored.fans[j].name, sizeof(settings.fans[i].name)) == 0) {
+                settings.fans[i].fanPower = stored.fans[j].fanPower;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+void SettingsStore::init(const StoredSettings& settings) {
+    _settings = settings;
+    _settings.version = SettingsConfig::BLOB_VERSION;
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = commit_timer_callback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "settings_commit",
+        .skip_unhandled_events = true
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &_commitTimer));
+}
+
+void SettingsStore::setInterval(uint16_t interval) {
+    if (_mutex == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_settings.interval != interval) {
+        _settings.interval = interval;
+        _changes++;
+        scheduleCommit();
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void SettingsStore::setRuntimeOfFans(uint16_t runtimeOfFans) {
+    if (_mutex == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_settings.runtimeOfFans != runtimeOfFans) {
+        _settings.runtimeOfFans = runtimeOfFans;
+        _changes++;
+        scheduleCommit();
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void SettingsStore::setFanPower(const char* name, uint8_t fanPower) {
+    if (_mutex == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < _settings.fanCount; i++) {
+        StoredFanSettings& fan = _settings.fans[i];
+        if (strncmp(fan.name, name, sizeof(fan.name)) == 0) {
+            if (fan.fanPower != fanPower) {
+                fan.fanPower = fanPower;
+                _changes++;
+                scheduleCommit();
+            }
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void SettingsStore::flush() {
+    if (_mutex == nullptr) {
+        return;
+    }
+
+    esp_timer_stop(_commitTimer);
+    commit();
+}
+
+uint32_t SettingsStore::getCommitCount() const {
+    return _commits;
+}
+
+uint32_t SettingsStore::getChangeCount() const {
+    return _changes;
+}
+
+void SettingsStore::scheduleCommit() {
+    int64_t now = esp_timer_get_time();
+    if (!_dirty) {
+        _dirty = true;
+        _firstDirtyUs = now;
+    }
+
+    // Every change restarts the quiet period, but the commit is never pushed past the deadline
+    int64_t deadline = _firstDirtyUs + SettingsConfig::MAX_COMMIT_DELAY_MS * 1000LL;
+    int64_t delayUs = std::min<int64_t>(SettingsConfig::COMMIT_DELAY_MS * 1000LL, deadline - now);
+
+    esp_timer_stop(_commitTimer);
+    esp_timer_start_once(_commitTimer, static_cast<uint64_t>(std::max<int64_t>(delayUs, 0)));
+}
+
+void SettingsStore::commit() {
+    // Take a snapshot so the mutex is not held during the flash write
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (!_dirty) {
+        xSemaphoreGive(_mutex);
+        return;
+    }
+    StoredSettings snapshot = _settings;
+    _dirty = false;
+    xSemaphoreGive(_mutex);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SettingsConfig::NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, SettingsConfig::NVS_KEY, &snapshot, sizeof(snapshot));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TaskConfig::FAN_TASK.tag, "Failed to store settings: %s", esp_err_to_name(err));
+
+        // Keep the changes pending and try again later
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        scheduleCommit();
+        xSemaphoreGive(_mutex);
+        return;
+    }
+
+    _commits++;
+    ESP_LOGI(TaskConfig::FAN_TASK.tag, "Settings stored (%lu changes in %lu commits)", static_cast<unsigned long>(_changes), static_cast<unsigned long>(_commits));
+}
+
+void SettingsStore::commit_timer_callback(void* arg) {
+    static_cast<SettingsStore*>(arg)->commit();
+}
@@ -0,0 +1,177 @@
+#include "FanControl/trace_recorder.hpp"
+
+#include "esp_log.h"
+
+// Events moved from the ring to the file at once
+static constexpr size_t FLUSH_CHUNK_EVENTS = 64;
+
+TraceEvent TraceRecorder::_events[TraceConfig::BUFFER_EVENTS];
+size_t TraceRecorder::_head = 0;
+size_t TraceRecorder::_count = 0;
+portMUX_TYPE TraceRecorder::_lock = portMUX_INITIALIZER_UNLOCKED;
+volatile bool TraceRecorder::_active = false;
+bool TraceRecorder::_headerPending = false;
+int64_t TraceRecorder::_startUs = 0;
+TraceHeader TraceRecorder::_header = {};
+TraceStats TraceRecorder::_stats = {};
+FILE* TraceRecorder::_file = nullptr;
+esp_timer_handle_t TraceRecorder::_flushTimer = nullptr;
+
+void TraceRecorder::begin(const TraceHeader& header) {
+    // The timer keeps running once created, idle flushes return right away
+    if (_flushTimer == nullptr) {
+        esp_timer_create_args_t timerArgs = {
+            .callback = flush_timer_callback,
+            .arg = nullptr,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "trace_flush",
+            .skip_unhandled_events = true
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &_flushTimer));
+        ESP_ERROR_CHECK(esp_timer_start_periodic(_flushTimer, TraceConfig::FLUSH_INTERVAL_MS * 1000ULL));
+    }
+
+    portENTER_CRITICAL(&_lock);
+    _header = header;
+    _header.magic = FILE_MAGIC;
+    _header.version = FILE_VERSION;
+    _header.controlTickMs = FanConfig::CONTROL_TICK_MS;
+    _head = 0;
+    _count = 0;
+    _stats = {};
+    _stats.active = true;
+    _startUs = esp_timer_get_time();
+    _headerPending = true;
+    _active = true;
+    portEXIT_CRITICAL(&_lock);
+
+    ESP_LOGI(TraceConfig::TAG, "Recording started");
+}
+
+void TraceRecorder::stop() {
+    portENTER_CRITICAL(&_lock);
+    _active = false;
+    _stats.active = false;
+    portEXIT_CRITICAL(&_lock);
+}
+
+bool TraceRecorder::isActive() {
+    // The file is complete once the flush timer has closed it
+    return _active || _file != nullptr;
+}
+
+void TraceRecorder::record(TraceEventType type, uint8_t fan, uint16_t value) {
+    if (!_active) {
+        return;
+    }
+    portENTER_CRITICAL(&_lock);
+    append(type, fan, value);
+    portEXIT_CRITICAL(&_lock);
+}
+
+void IRAM_ATTR TraceRecorder::recordFromISR(TraceEventType type, uint8_t fan, uint16_t value) {
+    if (!_active) {
+        return;
+    }
+    portENTER_CRITICAL_ISR(&_lock);
+    append(type, fan, value);
+    portEXIT_CRITICAL_ISR(&_lock);
+}
+
+void IRAM_ATTR TraceRecorder::append(TraceEventType type, uint8_t fan, uint16_t value) {
+    // Checked again under the lock, the recording may have ended in the meantime
+    if (!_active) {
+        return;
+    }
+    if (_count == TraceConfig::BUFFER_EVENTS) {
+        _stats.dropped++;
+        return;
+    }
+
+    TraceEvent& event = _events[(_head + _count) % TraceConfig::BUFFER_EVENTS];
+    event.timeUs = static_cast<uint32_t>(esp_timer_get_time() - _startUs);
+    event.type = type;
+    event.fan = fan;
+    event.value = value;
+    _count++;
+    _stats.events++;
+}
+
+TraceStats TraceRecorder::getStats() {
+    portENTER_CRITICAL(&_lock);
+    TraceStats stats = _stats;
+    portEXIT_CRITICAL(&_lock);
+    return stats;
+}
+
+void TraceRecorder::flush() {
+    static TraceEvent chunk[FLUSH_CHUNK_EVENTS];
+
+    // A new recording replaces the file of the previous one
+    portENTER_CRITICAL(&_lock);
+    bool createFile = _headerPending;
+    _headerPending = false;
+    TraceHeader header = _header;
+    int64_t startUs = _startUs;
+    portEXIT_CRITICAL(&_lock);
+
+    if (createFile) {
+        if (_file != nullptr) {
+            fclose(_file);
+        }
+        _file = fopen(TraceConfig::PATH, "wb");
+        if (_file == nullptr || fwrite(&header, sizeof(header), 1, _file) != 1) {
+            ESP_LOGE(TraceConfig::TAG, "Failed to create %s", TraceConfig::PATH);
+            stop();
+        } else {
+            portENTER_CRITICAL(&_lock);
+            _stats.bytesWritten = sizeof(header);
+            portEXIT_CRITICAL(&_lock);
+        }
+    }
+
+    while (true) {
+        portENTER_CRITICAL(&_lock);
+        // Events of a recording started meanwhile belong into its new file
+        size_t count = _headerPending ? 0 : (_count < FLUSH_CHUNK_EVENTS ? _count : FLUSH_CHUNK_EVENTS);
+        for (size_t i = 0; i < count; i++) {
+            chunk[i] = _events[_head];
+            _head = (_head + 1) % TraceConfig::BUFFER_EVENTS;
+        }
+        _count -= count;
+        portEXIT_CRITICAL(&_lock);
+
+        if (count == 0 || _file == nullptr) {
+            break;
+        }
+        if (fwrite(chunk, sizeof(TraceEvent), count, _file) != count) {
+            ESP_LOGE(TraceConfig::TAG, "Failed to write %s, file system full?", TraceConfig::PATH);
+            stop();
+            break;
+        }
+
+        portENTER_CRITICAL(&_lock);
+        _stats.bytesWritten += count * sizeof(TraceEvent);
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    TraceStats stats = getStats();
+    if (stats.active && (stats.bytesWritten >= TraceConfig::MAX_FILE_SIZE ||
+                         esp_timer_get_time() - startUs >= TraceConfig::MAX_DURATION_MS * 1000LL)) {
+        stop();
+    }
+
+    // Events recorded after the check above are written by the next flush
+    if (!_active && _count == 0 && _file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+        stats = getStats();
+        ESP_LOGI(TraceConfig::TAG, "Recording finished: %lu events, %lu dropped, %lu bytes",
+                 static_cast<unsigned long>(stats.events), static_cast<unsigned long>(stats.dropped),
+                 static_cast<unsigned long>(stats.bytesWritten));
+    }
+}
+
+void TraceRecorder::flush_timer_callback(void* arg) {
+    flush();
+}
@@ -0,0 +1,266 @@
+#include "FanControl/trace_replayer.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "esp_timer.h"
+
+#include "FanControl/fan.hpp"
+
+// Commands are recorded by the tick that applies them, one event per changed value
+static bool isCommand(TraceEventType type) {
+    return type == TraceEventType::Power || type == TraceEventType::Interval || type == TraceEventType::RuntimeOfFans;
+}
+
+bool TraceReplayer::run(const char* path) {
+    _result = {};
+    _error = nullptr;
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        _error = "No trace recorded";
+        return false;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != TraceRecorder::FILE_MAGIC) {
+        fclose(file);
+        _error = "Not a trace file";
+        return false;
+    }
+    if (header.version != TraceRecorder::FILE_VERSION || header.state.fanCount == 0 || header.state.fanCount > FanConfig::MAX_FANS ||
+        header.controlTickMs == 0) {
+        fclose(file);
+        _error = "Unsupported trace version";
+        return false;
+    }
+
+    int64_t startUs = esp_timer_get_time();
+    if (!reset(header)) {
+        fclose(file);
+        _manager.reset();
+        _error = "Trace does not match its fans";
+        return false;
+    }
+
+    bool valid = true;
+    uint32_t lastUs = 0;
+    size_t count;
+    while (valid && (count = fread(_chunk, sizeof(TraceEvent), TraceConfig::REPLAY_CHUNK_EVENTS, file)) > 0) {
+        for (size_t i = 0; valid && i < count; i++) {
+            const TraceEvent& event = _chunk[i];
+            if (event.timeUs < lastUs || event.fan >= _result.fanCount) {
+                valid = false;
+                break;
+            }
+
+            // The commands of a tick are collected until an event follows that is not one of them
+            if (!isCommand(event.type) || event.timeUs >= _nextTickUs) {
+                valid = submitCommands();
+            }
+            advance(event.timeUs);
+            valid = valid && apply(event);
+            lastUs = event.timeUs;
+        }
+    }
+    fclose(file);
+
+    valid = valid && submitCommands();
+    _manager.reset();
+    if (!valid) {
+        _error = "Corrupt trace";
+        return false;
+    }
+
+    // Transitions left without a counterpart differ by definition
+    _result.mismatches += _recordedCount + _replayedCount;
+    _result.durationUs = lastUs;
+    _result.cpuUs = static_cast<uint32_t>(esp_timer_get_time() - startUs);
+    return true;
+}
+
+const TraceReplayResult& TraceReplayer::getResult() const {
+    return _result;
+}
+
+const char* TraceReplayer::getError() const {
+    return _error;
+}
+
+bool TraceReplayer::reset(const TraceHeader& header) {
+    _result.start = header.state;
+    _result.fanCount = header.state.fanCount;
+    _manager = make_unique<FanManager>(true);
+    for (uint8_t i = 0; i < _result.fanCount; i++) {
+        TraceFanSummary& fan = _result.fans[i];
+        memcpy(fan.name, header.names[i], sizeof(fan.name));
+        fan.name[sizeof(fan.name) - 1] = '\0';
+        fan.hasTacho = (header.tachoMask & (1 << i)) != 0;
+        fan.minRpm = UINT16_MAX;
+        _pulses[i] = 0;
+
+        // Only the name matters to the simulated fans, it identifies them in commands
+        FanConfig::Config config = {};
+        memcpy(config.name, fan.name, sizeof(config.name));
+        config.pwmPin = GPIO_NUM_NC;
+        config.tachoPin = GPIO_NUM_NC;
+        _manager->createFan(config);
+    }
+    _manager->initializeAllFans();
+    if (!_manager->resume(header.state)) {
+        return false;
+    }
+
+    // The recording began between two ticks, partway into a phase
+    _manager->beginCycle(0);
+    _running = header.state.running;
+    _phaseStartUs = -static_cast<int64_t>(header.state.elapsedMs) * 1000;
+    _commands = {};
+    _tickUs = header.controlTickMs * 1000;
+    _nextTickUs = 0;
+    _windowEndUs = FanConfig::TACHO_UPDATE_CYCLE * 1000LL;
+    _recordedCount = 0;
+    _replayedCount = 0;
+    return true;
+}
+
+void TraceReplayer::advance(int64_t timeUs) {
+    // Ticks and tacho windows are due independently, process them in time order
+    while (true) {
+        if (_nextTickUs <= _windowEndUs && _nextTickUs <= timeUs) {
+            _result.ticks++;
+            tick(_nextTickUs);
+            _nextTickUs += _tickUs;
+        } else if (_windowEndUs <= timeUs) {
+            closeWindow();
+            _windowEndUs += FanConfig::TACHO_UPDATE_CYCLE * 1000LL;
+        } else {
+            break;
+        }
+    }
+}
+
+void TraceReplayer::tick(int64_t nowUs) {
+    _manager->controlTick(nowUs);
+    if (_manager->isRunning() != _running) {
+        _running = !_running;
+        _phaseStartUs = nowUs;
+        addTransition({static_cast<uint32_t>(nowUs), _running}, false);
+    }
+}
+
+bool TraceReplayer::submitCommands() {
+    BatchResult result = _manager->submitBatch(_commands);
+    _commands = {};
+    if (result == BatchResult::Empty) {
+        return true;
+    }
+    if (result != BatchResult::Accepted) {
+        return false;
+    }
+
+    // The tick that recorded the commands has already been replayed, it runs once more to apply them;
+    // a second tick at the same time cannot end the phase again
+    tick(_nextTickUs - _tickUs);
+    return true;
+}
+
+void TraceReplayer::closeWindow() {
+    // A window only counts as stalled if the fans ran for all of it
+    int64_t windowStartUs = _windowEndUs - FanConfig::TACHO_UPDATE_CYCLE * 1000LL;
+    bool ranThroughout = _running && _phaseStartUs <= windowStartUs;
+
+    for (uint8_t i = 0; i < _result.fanCount; i++) {
+        TraceFanSummary& fan = _result.fans[i];
+        if (!fan.hasTacho) {
+            continue;
+        }
+        if (_pulses[i] > 0) {
+            uint16_t rpm = Fan::rpmFromPulses(_pulses[i], FanConfig::TACHO_UPDATE_CYCLE);
+            fan.minRpm = rpm < fan.minRpm ? rpm : fan.minRpm;
+            fan.maxRpm = rpm > fan.maxRpm ? rpm : fan.maxRpm;
+            fan.rpmSum += rpm;
+            fan.rpmWindows++;
+        } else if (ranThroughout && _manager->getFans()[i]->getConfig().fanPower > 0) {
+            fan.stalls++;
+        }
+        _pulses[i] = 0;
+    }
+}
+
+bool TraceReplayer::apply(const TraceEvent& event) {
+    _result.events++;
+    Fan& fan = *_manager->getFans()[event.fan];
+    switch (event.type) {
+        case TraceEventType::TachoEdge:
+            fan.countPulse();
+            _pulses[event.fan]++;
+            _result.fans[event.fan].edges++;
+            break;
+        case TraceEventType::Duty:
+            _result.fans[event.fan].dutyChanges++;
+            if (event.value != 0 && event.value != fan.getConfig().fanPower) {
+                _result.dutyMismatches++;
+            }
+            break;
+        case TraceEventType::Power: {
+            if (event.value > 100 || (_commands.fanCount == FanConfig::MAX_BATCH_FANS && !submitCommands())) {
+                return false;
+            }
+            FanCommandBatch::FanChange& change = _commands.fans[_commands.fanCount++];
+            strcpy(change.name, fan.getConfig().name);
+            change.power = static_cast<uint8_t>(event.value);
+            change.isGroup = false;
+            break;
+        }
+        case TraceEventType::Interval:
+            if (_commands.hasInterval && !submitCommands()) {
+                return false;
+            }
+            _commands.hasInterval = true;
+            _commands.interval = event.value;
+            break;
+        case TraceEventType::RuntimeOfFans:
+            if (_commands.hasRuntimeOfFans && !submitCommands()) {
+                return false;
+            }
+            _commands.hasRuntimeOfFans = true;
+            _commands.runtimeOfFans = event.value;
+            break;
+        case TraceEventType::Phase:
+            _result.transitions++;
+            addTransition({event.timeUs, event.value != 0}, true);
+            break;
+    }
+    return true;
+}
+
+void TraceReplayer::addTransition(const Transition& transition, bool recorded) {
+    Transition* own = recorded ? _recorded : _replayed;
+    size_t& ownCount = recorded ? _recordedCount : _replayedCount;
+    Transition* other = recorded ? _replayed : _recorded;
+    size_t& otherCount = recorded ? _replayedCount : _recordedCount;
+
+    // The oldest waiting transition of the other side is the counterpart
+    if (otherCount > 0) {
+        const Transition& counterpart = other[0];
+        uint32_t deviationUs = transition.timeUs > counterpart.timeUs ? transition.timeUs - counterpart.timeUs
+                                                                      : counterpart.timeUs - transition.timeUs;
+        if (counterpart.running != transition.running || deviationUs > TraceConfig::REPLAY_TOLERANCE_TICKS * _tickUs) {
+            _result.mismatches++;
+        } else if (deviationUs > _result.maxDeviationUs) {
+            _result.maxDeviationUs = deviationUs;
+        }
+        memmove(other, other + 1, (otherCount - 1) * sizeof(Transition));
+        otherCount--;
+        return;
+    }
+
+    // One side running far ahead means they have diverged, the oldest entry is given up
+    if (ownCount == MAX_PENDING_TRANSITIONS) {
+        _result.mismatches++;
+        memmove(own, own + 1, (ownCount - 1) * sizeof(Transition));
+        ownCount--;
+    }
+    own[ownCount++] = transition;
+}
@@ -0,0 +1,104 @@
+#include "FanControl/wear_store.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+bool WearStore::init(const vector<shared_ptr<Fan>>& fans) {
+    _wear = {};
+    _wear.version = WearConfig::BLOB_VERSION;
+    _wear.fanCount = static_cast<uint8_t>(min<size_t>(fans.size(), FanConfig::MAX_FANS));
+    for (uint8_t i = 0; i < _wear.fanCount; i++) {
+        strncpy(_wear.fans[i].name, fans[i]->getConfig().name, sizeof(_wear.fans[i].name) - 1);
+    }
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = commit_timer_callback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wear_commit",
+        .skip_unhandled_events = true
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &_commitTimer));
+
+    nvs_handle_t handle;
+    if (nvs_open(WearConfig::NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t size = sizeof(_snapshot);
+    esp_err_t err = nvs_get_blob(handle, WearConfig::NVS_KEY, &_snapshot, &size);
+    nvs_close(handle);
+
+    if (err != ESP_OK || size != sizeof(_snapshot) || _snapshot.version != WearConfig::BLOB_VERSION) {
+        ESP_LOGW(TaskConfig::FAN_TASK.tag, "No usable fan usage counters, starting from zero");
+        return false;
+    }
+
+    // Only take over fans that still exist, in case the fan setup has changed
+    for (uint8_t i = 0; i < _wear.fanCount; i++) {
+        for (uint8_t j = 0; j < min<uint8_t>(_snapshot.fanCount, FanConfig::MAX_FANS); j++) {
+            if (strncmp(_wear.fans[i].name, _snapshot.fans[j].name, sizeof(_wear.fans[i].name)) == 0) {
+                _wear.fans[i].wear = _snapshot.fans[j].wear;
+                fans[i]->restoreWear(_snapshot.fans[j].wear);
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+void WearStore::setFanWear(uint8_t index, const FanWear& wear) {
+    if (_mutex == nullptr || index >= _wear.fanCount) {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _wear.fans[index].wear = wear;
+    xSemaphoreGive(_mutex);
+}
+
+void WearStore::requestCommit() {
+    if (_mutex == nullptr) {
+        return;
+    }
+
+    // A commit that is already pending picks up the latest counters as well
+    esp_timer_stop(_commitTimer);
+    esp_timer_start_once(_commitTimer, 0);
+}
+
+uint32_t WearStore::getCommitCount() const {
+    return _commits;
+}
+
+void WearStore::commit() {
+    // Take a snapshot so the mutex is not held during the flash write
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _snapshot = _wear;
+    xSemaphoreGive(_mutex);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(WearConfig::NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, WearConfig::NVS_KEY, &_snapshot, sizeof(_snapshot));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    // The next save brings the counters up to date again, no retry needed
+    if (err != ESP_OK) {
+        ESP_LOGE(TaskConfig::FAN_TASK.tag, "Failed to store fan usage counters: %s", esp_err_to_name(err));
+        return;
+    }
+    _commits++;
+}
+
+void WearStore::commit_timer_callback(void* arg) {
+    static_cast<WearStore*>(arg)->commit();
+}
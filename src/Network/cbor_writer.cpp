@@ -0,0 +1,88 @@
+#include "Network/cbor_writer.hpp"
+
+#include <cstring>
+
+// Major types used by the encoder
+static constexpr uint8_t MAJOR_UNSIGNED = 0;
+static constexpr uint8_t MAJOR_TEXT = 3;
+static constexpr uint8_t MAJOR_ARRAY = 4;
+static constexpr uint8_t MAJOR_MAP = 5;
+static constexpr uint8_t MAJOR_SIMPLE = 7;
+
+// Simple values
+static constexpr uint8_t SIMPLE_FALSE = 20;
+static constexpr uint8_t SIMPLE_TRUE = 21;
+
+CborWriter::CborWriter(uint8_t* buffer, size_t capacity)
+    : _buffer(buffer),
+      _capacity(capacity),
+      _length(0),
+      _overflowed(false) {}
+
+void CborWriter::beginArray(size_t count) {
+    writeHead(MAJOR_ARRAY, count);
+}
+
+void CborWriter::beginMap(size_t count) {
+    writeHead(MAJOR_MAP, count);
+}
+
+void CborWriter::writeUnsigned(uint64_t value) {
+    writeHead(MAJOR_UNSIGNED, value);
+}
+
+void CborWriter::writeText(const char* text) {
+    size_t length = strlen(text);
+    writeHead(MAJOR_TEXT, length);
+    append(text, length);
+}
+
+void CborWriter::writeBool(bool value) {
+    writeHead(MAJOR_SIMPLE, value ? SIMPLE_TRUE : SIMPLE_FALSE);
+}
+
+size_t CborWriter::getLength() const {
+    return _length;
+}
+
+bool CborWriter::hasOverflowed() const {
+    return _overflowed;
+}
+
+void CborWriter::writeHead(uint8_t majorType, uint64_t argument) {
+    uint8_t head[9];
+    size_t size;
+
+    // Arguments below 24 fit into the initial byte, larger ones follow in big-endian order
+    if (argument < 24) {
+        head[0] = (majorType << 5) | static_cast<uint8_t>(argument);
+        size = 1;
+    } else if (argument <= UINT8_MAX) {
+        head[0] = (majorType << 5) | 24;
+        size = 2;
+    } else if (argument <= UINT16_MAX) {
+        head[0] = (majorType << 5) | 25;
+        size = 3;
+    } else if (argument <= UINT32_MAX) {
+        head[0] = (majorType << 5) | 26;
+        size = 5;
+    } else {
+        head[0] = (majorType << 5) | 27;
+        size = 9;
+    }
+    for (size_t i = size - 1; i > 0; i--) {
+        head[i] = static_cast<uint8_t>(argument);
+        argument >>= 8;
+    }
+
+    append(head, size);
+}
+
+void CborWriter::append(const void* data, size_t length) {
+    if (_overflowed || _capacity - _length < length) {
+        _overflowed = true;
+        return;
+    }
+    memcpy(_buffer + _length, data, length);
+    _length += length;
+}
@@ -0,0 +1,165 @@
+#include "Network/fleet_auth.hpp"
+
+#include <cstring>
+
+#include "esp_log.h"
+#include "mbedtls/md.h"
+#include "nvs.h"
+
+static constexpr size_t MAC_SIZE = 32;
+
+static_assert(FleetAuth::SIGNATURE_LENGTH == 1 + 2 * MAC_SIZE, "The signature is a newline and the hex encoded HMAC-SHA256");
+
+bool FleetAuth::load() {
+    nvs_handle_t handle;
+    if (nvs_open(FleetConfig::NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    uint8_t key[FleetConfig::KEY_SIZE];
+    size_t size = sizeof(key);
+    esp_err_t err = nvs_get_blob(handle, FleetConfig::NVS_KEY, key, &size);
+    nvs_close(handle);
+    if (err != ESP_OK || size != sizeof(key)) {
+        return false;
+    }
+
+    useKey(key);
+    return true;
+}
+
+void FleetAuth::useKey(const uint8_t* key) {
+    memcpy(_key, key, sizeof(_key));
+    _hasKey = true;
+}
+
+bool FleetAuth::hasKey() const {
+    return _hasKey;
+}
+
+bool FleetAuth::storeKey(const uint8_t* key) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(FleetConfig::NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, FleetConfig::NVS_KEY, key, FleetConfig::KEY_SIZE);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(FleetConfig::TAG, "Failed to store the fleet key: %s", esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+bool FleetAuth::parseKey(const char* hex, size_t length, uint8_t* key) {
+    if (hex == nullptr || length != 2 * FleetConfig::KEY_SIZE) {
+        return false;
+    }
+
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    for (size_t i = 0; i < FleetConfig::KEY_SIZE; i++) {
+        int high = nibble(hex[2 * i]);
+        int low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        key[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+uint32_t FleetAuth::nextEpoch() {
+    nvs_handle_t handle;
+    if (nvs_open(FleetConfig::NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return 0;
+    }
+
+    // Written before it is used, so no two boots announce the same epoch
+    uint32_t epoch = 0;
+    esp_err_t err = nvs_get_u32(handle, FleetConfig::NVS_EPOCH_KEY, &epoch);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+        epoch++;
+        err = nvs_set_u32(handle, FleetConfig::NVS_EPOCH_KEY, epoch);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+    }
+    nvs_close(handle);
+    return err == ESP_OK ? epoch : 0;
+}
+
+size_t FleetAuth::sign(char* datagram, size_t length, size_t size) const {
+    if (!_hasKey || length + SIGNATURE_LENGTH > size) {
+        return 0;
+    }
+
+    datagram[length] = '\n';
+    computeMac(datagram, length, datagram + length + 1);
+    return length + SIGNATURE_LENGTH;
+}
+
+size_t FleetAuth::verify(const char* datagram, size_t length) const {
+    if (!_hasKey || length <= SIGNATURE_LENGTH || datagram[length - SIGNATURE_LENGTH] != '\n') {
+        return 0;
+    }
+
+    size_t payloadLength = length - SIGNATURE_LENGTH;
+    char expected[2 * MAC_SIZE];
+    computeMac(datagram, payloadLength, expected);
+
+    // Compared in constant time, so the timing does not reveal how much of a guess was right
+    uint8_t difference = 0;
+    for (size_t i = 0; i < sizeof(expected); i++) {
+        difference |= expected[i] ^ datagram[payloadLength + 1 + i];
+    }
+    return difference == 0 ? payloadLength : 0;
+}
+
+bool FleetAuth::acceptSequence(const char* id, uint32_t epoch, uint32_t sequence) {
+    Sender* free = nullptr;
+    for (Sender& sender : _senders) {
+        if (strcmp(sender.id, id) == 0) {
+            // Epochs only grow, a smaller one is a recording from an earlier boot
+            if (epoch < sender.epoch || (epoch == sender.epoch && sequence <= sender.sequence)) {
+                return false;
+            }
+            sender.epoch = epoch;
+            sender.sequence = sequence;
+            return true;
+        }
+        if (free == nullptr && sender.id[0] == '\0') {
+            free = &sender;
+        }
+    }
+
+    // A full table forgets the senders in turn, which only matters with more dryers than it holds
+    if (free == nullptr) {
+        free = &_senders[_nextEviction];
+        _nextEviction = (_nextEviction + 1) % FleetConfig::MAX_SENDERS;
+    }
+    strncpy(free->id, id, sizeof(free->id) - 1);
+    free->id[sizeof(free->id) - 1] = '\0';
+    free->epoch = epoch;
+    free->sequence = sequence;
+    return true;
+}
+
+void FleetAuth::computeMac(const char* payload, size_t length, char* hex) const {
+    static constexpr char DIGITS[] = "0123456789abcdef";
+
+    uint8_t mac[MAC_SIZE];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), _key, sizeof(_key),
+                    reinterpret_cast<const unsigned char*>(payload), length, mac);
+    for (size_t i = 0; i < sizeof(mac); i++) {
+        hex[2 * i] = DIGITS[mac[i] >> 4];
+        hex[2 * i + 1] = DIGITS[mac[i] & 0x0f];
+    }
+}
@@ -0,0 +1,454 @@
+#include "Network/fleet_manager.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "FanControl/fan_command_parser.hpp"
+#include "System/device_id.hpp"
+
+FleetNode FleetManager::_nodes[FleetConfig::MAX_NODES] = {};
+size_t FleetManager::_nodeCount = 0;
+char FleetManager::_config[FleetConfig::MAX_CONFIG_SIZE] = {};
+char FleetManager::_datagram[FleetConfig::MAX_DATAGRAM_SIZE] = {};
+
+FleetManager::FleetManager(mg_mgr& mgr, FanManager& fanManager, uint16_t httpPort)
+    : _mgr(mgr),
+      _fanManager(fanManager),
+      _httpPort(httpPort),
+      _listener(nullptr),
+      _sender(nullptr),
+      _joined(false),
+      _enabled(false),
+      _announceTimer{},
+      _coordinatorId{},
+      _appliedFrom{},
+      _appliedEpoch(0),
+      _appliedVersion(0),
+      _epoch(0),
+      _sequence(0),
+      _configVersion(0),
+      _configLength(0),
+      _stats{} {}
+
+void FleetManager::start() {
+    // Until others are heard from, this node is alone and coordinates itself
+    strcpy(_coordinatorId, DeviceId::get());
+
+    // Anyone on the network could send announcements, so the fleet only runs with a key
+    if (!_auth.load()) {
+        ESP_LOGW(FleetConfig::TAG, "No fleet key configured, fleet disabled");
+        return;
+    }
+    enable();
+}
+
+void FleetManager::enable() {
+    // The epoch orders the announcements across restarts, without it replays could not be told apart
+    _epoch = FleetAuth::nextEpoch();
+    if (_epoch == 0) {
+        ESP_LOGE(FleetConfig::TAG, "Failed to store the boot epoch, fleet disabled");
+        return;
+    }
+    _sequence = 0;
+
+    mg_timer_init(&_mgr.timers, &_announceTimer, FleetConfig::ANNOUNCE_INTERVAL_MS, MG_TIMER_REPEAT | MG_TIMER_RUN_NOW,
+                  [](void* arg) { static_cast<FleetManager*>(arg)->announce(); }, this);
+    _enabled = true;
+
+    ESP_LOGI(FleetConfig::TAG, "Node %s announcing on %s:%u", DeviceId::get(), FleetConfig::MULTICAST_GROUP, FleetConfig::PORT);
+}
+
+void FleetManager::stop() {
+    if (_enabled) {
+        mg_timer_free(&_mgr.timers, &_announceTimer);
+        _enabled = false;
+    }
+
+    // The sockets may outlive the manager while they close, so detach them
+    for (struct mg_connection* connection : {_listener, _sender}) {
+        if (connection != nullptr) {
+            connection->fn_data = nullptr;
+            connection->is_closing = 1;
+        }
+    }
+    _listener = nullptr;
+    _sender = nullptr;
+    _joined = false;
+}
+
+bool FleetManager::setKey(const uint8_t* key) {
+    if (!FleetAuth::storeKey(key)) {
+        return false;
+    }
+
+    // A changed key takes effect with the next datagram, a first one starts the fleet
+    _auth.useKey(key);
+    if (!_enabled) {
+        enable();
+    }
+    return true;
+}
+
+bool FleetManager::isEnabled() const {
+    return _enabled;
+}
+
+const char* FleetManager::getSelfId() const {
+    return DeviceId::get();
+}
+
+const char* FleetManager::getCoordinatorId() const {
+    return _coordinatorId;
+}
+
+bool FleetManager::isCoordinator() const {
+    return strcmp(_coordinatorId, DeviceId::get()) == 0;
+}
+
+size_t FleetManager::getNodeCount() const {
+    return _nodeCount;
+}
+
+const FleetNode& FleetManager::getNode(size_t index) const {
+    return _nodes[index];
+}
+
+const FleetNode* FleetManager::findNode(const char* id) const {
+    for (size_t i = 0; i < _nodeCount; i++) {
+        if (strcmp(_nodes[i].id, id) == 0) {
+            return &_nodes[i];
+        }
+    }
+    return nullptr;
+}
+
+BatchResult FleetManager::pushConfig(const FanCommandBatch& batch, struct mg_str json) {
+    if (json.len >= sizeof(_config)) {
+        return BatchResult::InvalidValue;
+    }
+
+    BatchResult result = _fanManager.submitBatch(batch);
+    if (result != BatchResult::Accepted) {
+        return result;
+    }
+
+    // The coordinator has applied its own configuration by definition
+    memcpy(_config, json.buf, json.len);
+    _config[json.len] = '\0';
+    _configLength = json.len;
+    _configVersion++;
+    strcpy(_appliedFrom, DeviceId::get());
+    _appliedEpoch = _epoch;
+    _appliedVersion = _configVersion;
+    _stats.configsPushed++;
+
+    ESP_LOGI(FleetConfig::TAG, "Distributing configuration %lu to %u nodes", static_cast<unsigned long>(_configVersion), static_cast<unsigned>(_nodeCount));
+
+    // Announce right away instead of waiting for the next interval
+    announce();
+    return result;
+}
+
+const FleetStats& FleetManager::getStats() const {
+    return _stats;
+}
+
+void FleetManager::handle_event(struct mg_connection* connection, int event, void* event_data) {
+    FleetManager* manager = static_cast<FleetManager*>(connection->fn_data);
+    if (manager == nullptr) {
+        return;
+    }
+
+    switch (event) {
+    // A datagram has arrived on the listener
+    case MG_EV_READ:
+        manager->handleAnnouncement(connection);
+        mg_iobuf_del(&connection->recv, 0, connection->recv.len);
+        break;
+
+    case MG_EV_ERROR:
+        ESP_LOGW(FleetConfig::TAG, "Socket error: %s", static_cast<const char*>(event_data));
+        break;
+
+    // A socket failed, e.g. while the network was down; the next announcement reopens it
+    case MG_EV_CLOSE:
+        if (connection == manager->_listener) {
+            manager->_listener = nullptr;
+            manager->_joined = false;
+        } else if (connection == manager->_sender) {
+            manager->_sender = nullptr;
+        }
+        break;
+    }
+}
+
+void FleetManager::announce() {
+    // A configuration pushed while the fleet is disabled only applies locally
+    if (!_enabled) {
+        return;
+    }
+
+    openSockets();
+    expireNodes();
+    electCoordinator();
+
+    // A datagram still waiting to be sent would be merged with this one
+    if (_sender == nullptr || _sender->send.len > 0) {
+        return;
+    }
+
+    _sequence++;
+    size_t length = encodeAnnouncement(isCoordinator() && isConfigPending());
+    if (length == 0) {
+        ESP_LOGE(FleetConfig::TAG, "Announcement does not fit into %u bytes", static_cast<unsigned>(sizeof(_datagram)));
+        return;
+    }
+
+    mg_send(_sender, _datagram, length);
+    _stats.announcementsSent++;
+}
+
+void FleetManager::openSockets() {
+    char url[40];
+    if (_listener == nullptr) {
+        snprintf(url, sizeof(url), "udp://0.0.0.0:%u", FleetConfig::PORT);
+        _listener = mg_listen(&_mgr, url, handle_event, this);
+    }
+    if (_sender == nullptr) {
+        snprintf(url, sizeof(url), "udp://%s:%u", FleetConfig::MULTICAST_GROUP, FleetConfig::PORT);
+        _sender = mg_connect(&_mgr, url, handle_event, this);
+    }
+
+    // Joining fails until the station has an address, so it is retried with every announcement
+    if (_listener != nullptr && !_joined) {
+        struct ip_mreq request = {};
+        request.imr_multiaddr.s_addr = inet_addr(FleetConfig::MULTICAST_GROUP);
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        int fd = static_cast<int>(reinterpret_cast<size_t>(_listener->fd));
+        _joined = setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == 0;
+        if (_joined) {
+            ESP_LOGI(FleetConfig::TAG, "Joined %s", FleetConfig::MULTICAST_GROUP);
+        }
+    }
+}
+
+size_t FleetManager::encodeAnnouncement(bool includeConfig) {
+    // The signature goes behind the announcement
+    char* out = _datagram;
+    size_t size = sizeof(_datagram) - FleetAuth::SIGNATURE_LENGTH;
+    size_t used = 0;
+
+    // Appends formatted text, the caller checks for overflow once at the end
+    auto append = [&](const char* format, auto... args) {
+        if (used < size) {
+            used += snprintf(out + used, size - used, format, args...);
+        }
+    };
+
+    append("{\"id\":\"%s\",\"epoch\":%lu,\"seq\":%lu,\"port\":%u,\"run\":%d,\"applied\":{\"from\":\"%s\",\"epoch\":%lu,\"version\":%lu},\"fans\":[",
+           DeviceId::get(), static_cast<unsigned long>(_epoch), static_cast<unsigned long>(_sequence), _httpPort,
+           _fanManager.isRunning() ? 1 : 0, _appliedFrom,
+           static_cast<unsigned long>(_appliedEpoch), static_cast<unsigned long>(_appliedVersion));
+
+    const auto& fans = _fanManager.getFans();
+    for (size_t i = 0; i < fans.size(); i++) {
+        append("%s[\"%s\",%u,%u]", i > 0 ? "," : "", fans[i]->getConfig().name, fans[i]->getLastSpeed(), fans[i]->getConfig().fanPower);
+    }
+    append("]");
+
+    if (includeConfig) {
+        append(",\"config\":{\"epoch\":%lu,\"version\":%lu,\"batch\":%.*s}", static_cast<unsigned long>(_epoch),
+               static_cast<unsigned long>(_configVersion), static_cast<int>(_configLength), _config);
+    }
+    append("}");
+
+    return used < size ? _auth.sign(_datagram, used, sizeof(_datagram)) : 0;
+}
+
+void FleetManager::handleAnnouncement(struct mg_connection* connection) {
+    // Checked before parsing, a datagram without a valid signature is not looked at any further
+    const char* datagram = reinterpret_cast<const char*>(connection->recv.buf);
+    size_t length = _auth.verify(datagram, connection->recv.len);
+    if (length == 0) {
+        _stats.announcementsRejected++;
+        return;
+    }
+
+    auto jsonDeleter = [](cJSON* json) { cJSON_Delete(json); };
+    unique_ptr<cJSON, decltype(jsonDeleter)> json(cJSON_ParseWithLength(datagram, length), jsonDeleter);
+
+    const cJSON* id = cJSON_GetObjectItemCaseSensitive(json.get(), "id");
+    if (!cJSON_IsString(id) || strlen(id->valuestring) != sizeof(FleetNode::id) - 1) {
+        return;
+    }
+
+    // The multicast loop delivers our own announcements as well
+    if (strcmp(id->valuestring, DeviceId::get()) == 0) {
+        return;
+    }
+
+    // A recorded announcement sent again would bring back an old state or configuration
+    const cJSON* epoch = cJSON_GetObjectItemCaseSensitive(json.get(), "epoch");
+    const cJSON* sequence = cJSON_GetObjectItemCaseSensitive(json.get(), "seq");
+    if (!cJSON_IsNumber(epoch) || !cJSON_IsNumber(sequence) ||
+        !_auth.acceptSequence(id->valuestring, static_cast<uint32_t>(epoch->valuedouble), static_cast<uint32_t>(sequence->valuedouble))) {
+        _stats.announcementsRejected++;
+        return;
+    }
+
+    _stats.announcementsReceived++;
+    updateNode(json.get(), id->valuestring, connection);
+    electCoordinator();
+
+    // Only the coordinator's configuration is followed
+    const cJSON* config = cJSON_GetObjectItemCaseSensitive(json.get(), "config");
+    if (config != nullptr && strcmp(id->valuestring, _coordinatorId) == 0) {
+        applyConfig(config, id->valuestring);
+    }
+}
+
+void FleetManager::updateNode(const cJSON* json, const char* id, struct mg_connection* connection) {
+    FleetNode* node = const_cast<FleetNode*>(findNode(id));
+    if (node == nullptr) {
+        if (_nodeCount == FleetConfig::MAX_NODES) {
+            ESP_LOGW(FleetConfig::TAG, "Fleet is full, ignoring node %s", id);
+            return;
+        }
+        node = &_nodes[_nodeCount++];
+        *node = {};
+        strcpy(node->id, id);
+        ESP_LOGI(FleetConfig::TAG, "Node %s joined", id);
+    }
+
+    mg_snprintf(node->address, sizeof(node->address), "%M", mg_print_ip, &connection->rem);
+    node->lastSeenUs = esp_timer_get_time();
+
+    const cJSON* port = cJSON_GetObjectItemCaseSensitive(json, "port");
+    node->port = cJSON_IsNumber(port) ? static_cast<uint16_t>(port->valueint) : 0;
+
+    const cJSON* running = cJSON_GetObjectItemCaseSensitive(json, "run");
+    node->running = cJSON_IsNumber(running) && running->valueint != 0;
+
+    const cJSON* applied = cJSON_GetObjectItemCaseSensitive(json, "applied");
+    const cJSON* from = cJSON_GetObjectItemCaseSensitive(applied, "from");
+    const cJSON* epoch = cJSON_GetObjectItemCaseSensitive(applied, "epoch");
+    const cJSON* version = cJSON_GetObjectItemCaseSensitive(applied, "version");
+    node->configFrom[0] = '\0';
+    if (cJSON_IsString(from) && strlen(from->valuestring) < sizeof(node->configFrom)) {
+        strcpy(node->configFrom, from->valuestring);
+    }
+    node->configEpoch = cJSON_IsNumber(epoch) ? static_cast<uint32_t>(epoch->valuedouble) : 0;
+    node->configVersion = cJSON_IsNumber(version) ? static_cast<uint32_t>(version->valuedouble) : 0;
+
+    // Each fan is reported as [name, rpm, power]
+    node->fanCount = 0;
+    const cJSON* fan;
+    cJSON_ArrayForEach(fan, cJSON_GetObjectItemCaseSensitive(json, "fans")) {
+        const cJSON* name = cJSON_GetArrayItem(fan, 0);
+        const cJSON* rpm = cJSON_GetArrayItem(fan, 1);
+        const cJSON* power = cJSON_GetArrayItem(fan, 2);
+        if (node->fanCount == FanConfig::MAX_FANS || !cJSON_IsString(name) || strlen(name->valuestring) >= FanConfig::MAX_NAME_LENGTH ||
+            !cJSON_IsNumber(rpm) || !cJSON_IsNumber(power)) {
+            continue;
+        }
+        FleetFan& entry = node->fans[node->fanCount++];
+        strcpy(entry.name, name->valuestring);
+        entry.rpm = static_cast<uint16_t>(rpm->valueint);
+        entry.power = static_cast<uint8_t>(power->valueint);
+    }
+}
+
+void FleetManager::applyConfig(const cJSON* config, const char* from) {
+    const cJSON* epoch = cJSON_GetObjectItemCaseSensitive(config, "epoch");
+    const cJSON* version = cJSON_GetObjectItemCaseSensitive(config, "version");
+    if (!cJSON_IsNumber(epoch) || !cJSON_IsNumber(version)) {
+        return;
+    }
+
+    // After a restart of the coordinator the version starts over, its epoch has grown instead
+    uint32_t configEpoch = static_cast<uint32_t>(epoch->valuedouble);
+    uint32_t configVersion = static_cast<uint32_t>(version->valuedouble);
+    if (strcmp(_appliedFrom, from) == 0 &&
+        (configEpoch < _appliedEpoch || (configEpoch == _appliedEpoch && configVersion <= _appliedVersion))) {
+        return;
+    }
+
+    FanCommandBatch batch;
+    const char* error = FanCommandParser::parse(cJSON_GetObjectItemCaseSensitive(config, "batch"), batch);
+
+    // Cabinets differ, so changes for fans and groups this node does not have are left out
+    BatchResult result = BatchResult::InvalidValue;
+    if (error == nullptr) {
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < batch.fanCount; i++) {
+            const FanCommandBatch::FanChange& change = batch.fans[i];
+            if (change.isGroup ? _fanManager.hasGroup(change.name) : _fanManager.getFan(change.name).has_value()) {
+                batch.fans[kept++] = change;
+            }
+        }
+        batch.fanCount = kept;
+        result = _fanManager.submitBatch(batch);
+    }
+
+    // A full queue is retried with the next announcement, anything else will not get better
+    if (result == BatchResult::QueueFull) {
+        return;
+    }
+
+    strcpy(_appliedFrom, from);
+    _appliedEpoch = configEpoch;
+    _appliedVersion = configVersion;
+    if (result == BatchResult::Accepted) {
+        _stats.configsApplied++;
+        ESP_LOGI(FleetConfig::TAG, "Applied configuration %lu from %s", static_cast<unsigned long>(configVersion), from);
+    } else if (result != BatchResult::Empty) {
+        ESP_LOGW(FleetConfig::TAG, "Ignored configuration %lu from %s: %s", static_cast<unsigned long>(configVersion), from,
+                 error != nullptr ? error : "rejected");
+    }
+}
+
+void FleetManager::expireNodes() {
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < _nodeCount;) {
+        if (now - _nodes[i].lastSeenUs > FleetConfig::NODE_TIMEOUT_MS * 1000LL) {
+            ESP_LOGI(FleetConfig::TAG, "Node %s left", _nodes[i].id);
+            _nodes[i] = _nodes[--_nodeCount];
+        } else {
+            i++;
+        }
+    }
+}
+
+void FleetManager::electCoordinator() {
+    const char* lowest = DeviceId::get();
+    for (size_t i = 0; i < _nodeCount; i++) {
+        if (strcmp(_nodes[i].id, lowest) < 0) {
+            lowest = _nodes[i].id;
+        }
+    }
+
+    if (strcmp(lowest, _coordinatorId) != 0) {
+        strcpy(_coordinatorId, lowest);
+        _stats.coordinatorChanges++;
+        ESP_LOGI(FleetConfig::TAG, "Coordinator is now %s%s", _coordinatorId, isCoordinator() ? " (this node)" : "");
+    }
+}
+
+bool FleetManager::isConfigPending() const {
+    if (_configVersion == 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < _nodeCount; i++) {
+        const FleetNode& node = _nodes[i];
+        if (strcmp(node.configFrom, DeviceId::get()) != 0 || node.configEpoch != _epoch || node.configVersion != _configVersion) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,26 @@
+#include "Network/latency_stats.hpp"
+
+void LatencyStats::record(uint32_t latencyUs) {
+    _count++;
+    _totalUs += latencyUs;
+    _lastUs = latencyUs;
+    if (latencyUs > _maxUs) {
+        _maxUs = latencyUs;
+    }
+}
+
+uint32_t LatencyStats::getCount() const {
+    return _count;
+}
+
+uint32_t LatencyStats::getAverageUs() const {
+    return _count == 0 ? 0 : static_cast<uint32_t>(_totalUs / _count);
+}
+
+uint32_t LatencyStats::getMaxUs() const {
+    return _maxUs;
+}
+
+uint32_t LatencyStats::getLastUs() const {
+    return _lastUs;
+}
@@ -0,0 +1,355 @@
+#include "Network/mqtt_client.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "FanControl/fan_command_parser.hpp"
+#include "System/device_id.hpp"
+
+TelemetrySample MqttClient::_samples[MqttConfig::QUEUE_SAMPLES] = {};
+size_t MqttClient::_head = 0;
+size_t MqttClient::_count = 0;
+char MqttClient::_frame[MqttConfig::MAX_FRAME_SIZE] = {};
+
+static constexpr const char* ONLINE = "online";
+static constexpr const char* OFFLINE = "offline";
+
+MqttClient::MqttClient(mg_mgr& mgr, FanManager& fanManager)
+    : _mgr(mgr),
+      _fanManager(fanManager),
+      _connection(nullptr),
+      _connected(false),
+      _inFlightId(0),
+      _inFlightSamples(0),
+      _inFlightSentUs(0),
+      _lastSendUs(0),
+      _stats{},
+      _sampleTimer{},
+      _drainTimer{},
+      _connectTimer{},
+      _wearTimer{} {}
+
+void MqttClient::start() {
+    // The device id tells the dryers on one broker apart
+    const char* deviceId = DeviceId::get();
+
+    snprintf(_clientId, sizeof(_clientId), "%s-%s", MqttConfig::TOPIC_PREFIX, deviceId);
+    snprintf(_statusTopic, sizeof(_statusTopic), "%s/%s/status", MqttConfig::TOPIC_PREFIX, deviceId);
+    snprintf(_telemetryTopic, sizeof(_telemetryTopic), "%s/%s/telemetry", MqttConfig::TOPIC_PREFIX, deviceId);
+    snprintf(_commandTopic, sizeof(_commandTopic), "%s/%s/cmd", MqttConfig::TOPIC_PREFIX, deviceId);
+    snprintf(_resultTopic, sizeof(_resultTopic), "%s/%s/cmd/result", MqttConfig::TOPIC_PREFIX, deviceId);
+    snprintf(_wearTopic, sizeof(_wearTopic), "%s/%s/wear", MqttConfig::TOPIC_PREFIX, deviceId);
+
+    // Sampling does not depend on the broker, samples queue up until it is reachable
+    mg_timer_init(&_mgr.timers, &_sampleTimer, MqttConfig::SAMPLE_INTERVAL_MS, MG_TIMER_REPEAT,
+                  [](void* arg) { static_cast<MqttClient*>(arg)->takeSample(); }, this);
+    mg_timer_init(&_mgr.timers, &_drainTimer, MqttConfig::DRAIN_INTERVAL_MS, MG_TIMER_REPEAT,
+                  [](void* arg) { static_cast<MqttClient*>(arg)->publishPending(); }, this);
+    mg_timer_init(&_mgr.timers, &_connectTimer, MqttConfig::RECONNECT_DELAY_MS, MG_TIMER_REPEAT | MG_TIMER_RUN_NOW,
+                  [](void* arg) { static_cast<MqttClient*>(arg)->maintainConnection(); }, this);
+    mg_timer_init(&_mgr.timers, &_wearTimer, MqttConfig::WEAR_INTERVAL_MS, MG_TIMER_REPEAT,
+                  [](void* arg) { static_cast<MqttClient*>(arg)->publishWear(); }, this);
+
+    ESP_LOGI(MqttConfig::TAG, "Publishing telemetry to %s as %s", MqttConfig::BROKER_URL, _telemetryTopic);
+}
+
+void MqttClient::stop() {
+    mg_timer_free(&_mgr.timers, &_sampleTimer);
+    mg_timer_free(&_mgr.timers, &_drainTimer);
+    mg_timer_free(&_mgr.timers, &_connectTimer);
+    mg_timer_free(&_mgr.timers, &_wearTimer);
+
+    if (_connection == nullptr) {
+        return;
+    }
+
+    // A clean disconnect suppresses the last will, so announce the shutdown explicitly
+    if (_connected) {
+        publish(_statusTopic, mg_str(OFFLINE), true);
+        struct mg_mqtt_opts opts = {};
+        mg_mqtt_disconnect(_connection, &opts);
+    }
+
+    // The connection may outlive the client while it drains, so detach it
+    _connection->fn_data = nullptr;
+    _connection->is_draining = 1;
+    _connection = nullptr;
+    _connected = false;
+}
+
+MqttStats MqttClient::getStats() const {
+    MqttStats stats = _stats;
+    stats.connected = _connected;
+    stats.queued = _count;
+    return stats;
+}
+
+void MqttClient::handle_event(struct mg_connection* connection, int event, void* event_data) {
+    MqttClient* client = static_cast<MqttClient*>(connection->fn_data);
+    if (client == nullptr) {
+        return;
+    }
+
+    switch (event) {
+    // The broker has answered the connect request
+    case MG_EV_MQTT_OPEN: {
+        int status = *static_cast<int*>(event_data);
+        if (status == 0) {
+            client->onConnected();
+        } else {
+            ESP_LOGW(MqttConfig::TAG, "Broker refused the connection (%d)", status);
+            connection->is_closing = 1;
+        }
+        break;
+    }
+
+    // A control packet has arrived, only the acknowledgements of frames are of interest
+    case MG_EV_MQTT_CMD: {
+        struct mg_mqtt_message* message = static_cast<struct mg_mqtt_message*>(event_data);
+        if (message->cmd == MQTT_CMD_PUBACK) {
+            client->onAcknowledged(message->id);
+        }
+        break;
+    }
+
+    // A message on a subscribed topic has arrived
+    case MG_EV_MQTT_MSG: {
+        struct mg_mqtt_message* message = static_cast<struct mg_mqtt_message*>(event_data);
+        if (mg_strcmp(message->topic, mg_str(client->_commandTopic)) == 0) {
+            client->handleCommand(message->data);
+        }
+        break;
+    }
+
+    case MG_EV_ERROR:
+        ESP_LOGW(MqttConfig::TAG, "Broker connection failed: %s", static_cast<const char*>(event_data));
+        break;
+
+    // The connection is gone, the next attempt is made by the connect timer
+    case MG_EV_CLOSE:
+        if (client->_connected) {
+            ESP_LOGW(MqttConfig::TAG, "Disconnected from broker, %u samples queued", static_cast<unsigned>(_count));
+        }
+        client->_connection = nullptr;
+        client->_connected = false;
+        client->_inFlightId = 0;
+        client->_inFlightSamples = 0;
+        break;
+    }
+}
+
+void MqttClient::maintainConnection() {
+    if (_connection == nullptr) {
+        struct mg_mqtt_opts opts = {};
+        opts.client_id = mg_str(_clientId);
+        opts.keepalive = MqttConfig::KEEPALIVE_S;
+        opts.clean = true;
+        opts.version = 4;
+
+        // The broker announces the dryer offline if the session is lost without a goodbye
+        opts.topic = mg_str(_statusTopic);
+        opts.message = mg_str(OFFLINE);
+        opts.qos = 1;
+        opts.retain = true;
+
+        _connection = mg_mqtt_connect(&_mgr, MqttConfig::BROKER_URL, &opts, handle_event, this);
+        _lastSendUs = esp_timer_get_time();
+        return;
+    }
+
+    if (_connected && esp_timer_get_time() - _lastSendUs > MqttConfig::KEEPALIVE_S * 500000LL) {
+        mg_mqtt_ping(_connection);
+        _lastSendUs = esp_timer_get_time();
+    }
+}
+
+void MqttClient::onConnected() {
+    _connected = true;
+    _stats.connects++;
+    ESP_LOGI(MqttConfig::TAG, "Connected to broker, %u samples queued", static_cast<unsigned>(_count));
+
+    publish(_statusTopic, mg_str(ONLINE), true);
+
+    struct mg_mqtt_opts opts = {};
+    opts.topic = mg_str(_commandTopic);
+    opts.qos = 1;
+    mg_mqtt_sub(_connection, &opts);
+
+    // New subscribers see the counters right away, not only after the next interval
+    publishWear();
+}
+
+void MqttClient::takeSample() {
+    // Drop the oldest sample to make room, a frame carrying it no longer covers it
+    if (_count == MqttConfig::QUEUE_SAMPLES) {
+        _head = (_head + 1) % MqttConfig::QUEUE_SAMPLES;
+        _count--;
+        _stats.dropped++;
+        if (_inFlightSamples > 0) {
+            _inFlightSamples--;
+        }
+    }
+
+    TelemetrySample& sample = _samples[(_head + _count) % MqttConfig::QUEUE_SAMPLES];
+    sample = {};
+    sample.uptimeS = static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+    sample.running = _fanManager.isRunning();
+
+    const auto& fans = _fanManager.getFans();
+    for (size_t i = 0; i < fans.size(); i++) {
+        sample.rpm[i] = fans[i]->getLastSpeed();
+        sample.power[i] = fans[i]->getConfig().fanPower;
+    }
+    _count++;
+}
+
+void MqttClient::publishPending() {
+    if (!_connected) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (_inFlightId != 0) {
+        if (now - _inFlightSentUs < MqttConfig::ACK_TIMEOUT_MS * 1000LL) {
+            return;
+        }
+        _stats.retransmits++;
+    } else if (_count < MqttConfig::SAMPLES_PER_FRAME) {
+        return;
+    }
+
+    size_t length;
+    size_t samples = encodeFrame(length);
+    if (samples == 0) {
+        return;
+    }
+
+    _inFlightId = publish(_telemetryTopic, mg_str_n(_frame, length), false, _inFlightId);
+    _inFlightSamples = samples;
+    _inFlightSentUs = now;
+}
+
+void MqttClient::onAcknowledged(uint16_t id) {
+    if (_inFlightId == 0 || id != _inFlightId) {
+        return;
+    }
+
+    _head = (_head + _inFlightSamples) % MqttConfig::QUEUE_SAMPLES;
+    _count -= _inFlightSamples;
+    _inFlightId = 0;
+    _inFlightSamples = 0;
+    _stats.frames++;
+}
+
+void MqttClient::publishWear() {
+    if (!_connected) {
+        return;
+    }
+
+    // The frame buffer is free to use, an unacknowledged frame is encoded again before it is resent
+    const auto& fans = _fanManager.getFans();
+    size_t used = snprintf(_frame, sizeof(_frame), "{\"fans\":[");
+    for (size_t i = 0; i < fans.size() && used < sizeof(_frame); i++) {
+        FanWear wear = fans[i]->getWear();
+        used += snprintf(_frame + used, sizeof(_frame) - used, "%s[\"%s\",%llu,%llu,%llu,%lu,%lu]", i > 0 ? "," : "",
+                         fans[i]->getConfig().name, wear.onTimeMs / 1000, wear.dutyPercentMs / 100000, wear.revolutions,
+                         static_cast<unsigned long>(wear.starts), static_cast<unsigned long>(Fan::rpmAtFullPower(wear)));
+    }
+    if (used < sizeof(_frame)) {
+        used += snprintf(_frame + used, sizeof(_frame) - used, "]}");
+    }
+    if (used >= sizeof(_frame)) {
+        ESP_LOGE(MqttConfig::TAG, "Usage counters do not fit into a frame of %u bytes", static_cast<unsigned>(sizeof(_frame)));
+        return;
+    }
+
+    publish(_wearTopic, mg_str_n(_frame, used), true);
+}
+
+size_t MqttClient::encodeFrame(size_t& length) {
+    const auto& fans = _fanManager.getFans();
+
+    // The fan names are sent once per frame, the samples only carry numbers
+    int written = snprintf(_frame, sizeof(_frame), "{\"now\":%lu,\"fans\":[", static_cast<unsigned long>(esp_timer_get_time() / 1000000));
+    size_t used = written;
+    for (size_t i = 0; i < fans.size() && used < sizeof(_frame); i++) {
+        written = snprintf(_frame + used, sizeof(_frame) - used, "%s\"%s\"", i > 0 ? "," : "", fans[i]->getConfig().name);
+        used += written;
+    }
+    if (used < sizeof(_frame)) {
+        used += snprintf(_frame + used, sizeof(_frame) - used, "],\"samples\":[");
+    }
+
+    // Add samples as long as they fit, a sample that does not fit is left for the next frame
+    size_t samples = 0;
+    size_t limit = _count < MqttConfig::SAMPLES_PER_FRAME ? _count : MqttConfig::SAMPLES_PER_FRAME;
+    while (samples < limit && used < sizeof(_frame)) {
+        const TelemetrySample& sample = _samples[(_head + samples) % MqttConfig::QUEUE_SAMPLES];
+        size_t start = used;
+
+        used += snprintf(_frame + used, sizeof(_frame) - used, "%s[%lu,%d", samples > 0 ? "," : "",
+                         static_cast<unsigned long>(sample.uptimeS), sample.running ? 1 : 0);
+        for (size_t i = 0; i < fans.size() && used < sizeof(_frame); i++) {
+            used += snprintf(_frame + used, sizeof(_frame) - used, ",%u,%u", sample.rpm[i], sample.power[i]);
+        }
+        if (used < sizeof(_frame)) {
+            used += snprintf(_frame + used, sizeof(_frame) - used, "]");
+        }
+
+        // Keep room for the closing brackets
+        if (used + 2 >= sizeof(_frame)) {
+            used = start;
+            break;
+        }
+        samples++;
+    }
+
+    if (samples == 0) {
+        ESP_LOGE(MqttConfig::TAG, "A sample does not fit into a frame of %u bytes", static_cast<unsigned>(sizeof(_frame)));
+        return 0;
+    }
+
+    used += snprintf(_frame + used, sizeof(_frame) - used, "]}");
+    length = used;
+    return samples;
+}
+
+void MqttClient::handleCommand(struct mg_str payload) {
+    static constexpr const char* RESULT_NAMES[] = {"accepted", "empty", "unknownFan", "invalidValue", "queueFull"};
+
+    _stats.commands++;
+
+    // Commands are applied exactly like a POST /fanBatch
+    FanCommandBatch batch;
+    const char* error = FanCommandParser::parse(payload.buf, payload.len, batch);
+    BatchResult result = error == nullptr ? _fanManager.submitBatch(batch) : BatchResult::InvalidValue;
+    if (result != BatchResult::Accepted) {
+        _stats.rejected++;
+    }
+
+    char response[96];
+    int length;
+    if (error != nullptr) {
+        length = snprintf(response, sizeof(response), "{\"result\":\"%s\",\"error\":\"%s\"}", RESULT_NAMES[static_cast<size_t>(result)], error);
+    } else {
+        length = snprintf(response, sizeof(response), "{\"result\":\"%s\"}", RESULT_NAMES[static_cast<size_t>(result)]);
+    }
+    ESP_LOGI(MqttConfig::TAG, "Command %s", RESULT_NAMES[static_cast<size_t>(result)]);
+
+    publish(_resultTopic, mg_str_n(response, length), false);
+}
+
+uint16_t MqttClient::publish(const char* topic, struct mg_str payload, bool retain, uint16_t retransmitId) {
+    struct mg_mqtt_opts opts = {};
+    opts.topic = mg_str(topic);
+    opts.message = payload;
+    opts.qos = 1;
+    opts.retain = retain;
+    opts.retransmit_id = retransmitId;
+
+    _lastSendUs = esp_timer_get_time();
+    return mg_mqtt_pub(_connection, &opts);
+}
@@ -0,0 +1,80 @@
+#include "Network/request_arena.hpp"
+
+#include <cstdlib>
+
+#include "cJSON.h"
+
+RequestArena* RequestArena::_jsonArena = nullptr;
+TaskHandle_t RequestArena::_activeTask = nullptr;
+
+RequestArena::Scope::Scope(RequestArena& arena) {
+    _jsonArena = &arena;
+    _activeTask = xTaskGetCurrentTaskHandle();
+}
+
+RequestArena::Scope::~Scope() {
+    _activeTask = nullptr;
+    _jsonArena->reset();
+}
+
+void RequestArena::installJSONHooks(RequestArena& arena) {
+    _jsonArena = &arena;
+
+    // Without a realloc hook cJSON grows its print buffer by allocate, copy and free
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_malloc,
+        .free_fn = json_free
+    };
+    cJSON_InitHooks(&hooks);
+}
+
+void* RequestArena::allocate(size_t size) {
+    // Keep every allocation 8-byte aligned, like malloc
+    size_t aligned = (size + 7) & ~static_cast<size_t>(7);
+    if (aligned > sizeof(_buffer) - _used) {
+        _overflows++;
+        return nullptr;
+    }
+
+    void* pointer = _buffer + _used;
+    _used += aligned;
+    return pointer;
+}
+
+bool RequestArena::owns(const void* pointer) const {
+    const uint8_t* bytes = static_cast<const uint8_t*>(pointer);
+    return bytes >= _buffer && bytes < _buffer + sizeof(_buffer);
+}
+
+void RequestArena::reset() {
+    if (_used > _peakUsed) {
+        _peakUsed = _used;
+    }
+    _used = 0;
+}
+
+size_t RequestArena::getPeakUsed() const {
+    return _peakUsed;
+}
+
+uint32_t RequestArena::getOverflowCount() const {
+    return _overflows;
+}
+
+void* RequestArena::json_malloc(size_t size) {
+    if (_activeTask != nullptr && _activeTask == xTaskGetCurrentTaskHandle()) {
+        void* pointer = _jsonArena->allocate(size);
+        if (pointer != nullptr) {
+            return pointer;
+        }
+    }
+    return malloc(size);
+}
+
+void RequestArena::json_free(void* pointer) {
+    // Arena memory is released all at once when the scope ends
+    if (_jsonArena != nullptr && _jsonArena->owns(pointer)) {
+        return;
+    }
+    free(pointer);
+}
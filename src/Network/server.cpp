@@ -1,42 +1,395 @@
 #include "Network/server.hpp"
 
+#include "esp_heap_caps.h"
 #include "esp_spiffs.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include <cstdlib>
+#include <cstring>
 #include <stdio.h>
 
-WebServer::WebServer(FanManager& fanManager, const char* port) 
+#include "FanControl/fan_command_parser.hpp"
+#include "FanControl/trace_replayer.hpp"
+#include "Network/field_descriptor.hpp"
+#include "System/boot_sequence.hpp"
+#include "System/power_manager.hpp"
+#include "System/task_monitor.hpp"
+
+RequestArena WebServer::_arena;
+
+// Fields of a fan in GET /fan, shared by the JSON and CBOR encodings
+static constexpr FieldDescriptor<Fan> FAN_FIELDS[] = {
+    {"name", [](Fan& fan) { return FieldValue::ofText(fan.getConfig().name); }},
+    {"group", [](Fan& fan) { return FieldValue::ofText(fan.getConfig().group); }},
+    {"speed", [](Fan& fan) { return FieldValue::ofUnsigned(fan.getLastSpeed()); }},
+    {"power", [](Fan& fan) { return FieldValue::ofUnsigned(fan.getConfig().fanPower); }},
+    {"onTime", [](Fan& fan) { return FieldValue::ofUnsigned(fan.getWear().onTimeMs / 1000); }},
+    {"fullPowerTime", [](Fan& fan) { return FieldValue::ofUnsigned(fan.getWear().dutyPercentMs / 100000); }},
+    {"revolutions", [](Fan& fan) { return FieldValue::ofUnsigned(fan.getWear().revolutions); }},
+    {"starts", [](Fan& fan) { return FieldValue::ofUnsigned(fan.getWear().starts); }},
+    {"fullPowerRpm", [](Fan& fan) { return FieldValue::ofUnsigned(Fan::rpmAtFullPower(fan.getWear())); }}
+};
+
+// Fields of GET /fanManager
+static constexpr FieldDescriptor<FanManager> FAN_MANAGER_FIELDS[] = {
+    {"interval", [](FanManager& manager) { return FieldValue::ofUnsigned(manager.getInterval()); }},
+    {"runtimeOfFans", [](FanManager& manager) { return FieldValue::ofUnsigned(manager.getRuntimeOfFans()); }}
+};
+
+WebServer::WebServer(FanManager& fanManager, WiFiManager& wifiManager, const char* port) 
     : _port(port), 
-      _fanManager(fanManager) {}
+      _fanManager(fanManager),
+      _wifiManager(wifiManager),
+      _running(false),
+      _workerPool([this]() { postEvent(LoopEvent::JobsCompleted); }),
+      _listenerId(0),
+      _connections{},
+      _otaUpdater(_otaBackend),
+      _otaWriter(_otaUpdater, [this]() { postEvent(LoopEvent::OtaProgress); }),
+      _uploadId(0),
+      _mqttClient(_mongooseManager.getManager(), fanManager),
+      _fleetManager(_mongooseManager.getManager(), fanManager, static_cast<uint16_t>(atoi(port))) {}
 
 void WebServer::start() {
-    MongooseManager mongooseManager;
+    mg_mgr& mgr = _mongooseManager.getManager();
 
-    // Construct the URL for the web server, including IP address and port
-    string url = "http://" + string(Network::STATIC_IP) + ":" + _port;
+    // Workers signal finished jobs through the Mongoose wakeup pipe
+    if (!mg_wakeup_init(&mgr)) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to initialize wakeup pipe!");
+        return;
+    }
+
+    // Handlers build their JSON in the request arena instead of on the heap
+    RequestArena::installJSONHooks(_arena);
 
-    const char* url_cstr = url.c_str();
-    if (url_cstr == nullptr) {
+    // Construct the URL for the web server, including IP address and port
+    char url_cstr[48];
+    if (snprintf(url_cstr, sizeof(url_cstr), "http://%s:%s", Network::BIND_ADDRESS, _port) >= static_cast<int>(sizeof(url_cstr))) {
         ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "URL construction failed!");
         return;
     }
-    struct mg_connection *connection = mg_http_listen(&mongooseManager.getManager(), url_cstr, handle_request, this);
+    struct mg_connection *connection = mg_http_listen(&mgr, url_cstr, handle_request, this);
     if (connection == nullptr) {
         ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to create listener!");
         return;
     }
     connection->fn_data = this;
+    _listenerId = connection->id;
+
+    // HTTPS is served in addition if a certificate has been installed
+    if (_tlsSessions.init()) {
+        char tls_url_cstr[48];
+        snprintf(tls_url_cstr, sizeof(tls_url_cstr), "https://%s:%u", Network::BIND_ADDRESS, ServerConfig::TLS_PORT);
+        if (mg_http_listen(&mgr, tls_url_cstr, handle_request, this) != nullptr) {
+            ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "HTTPS listening at %s", tls_url_cstr);
+        } else {
+            ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to create HTTPS listener!");
+        }
+    }
+
+    _workerPool.start();
+    _otaWriter.start();
+    _mqttClient.start();
+    _fleetManager.start();
+
+    // Fan state changes happen on the fan task and are forwarded into the event loop
+    _fanManager.setStateListener([this]() { postEvent(LoopEvent::FanStateChanged); });
 
     ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "Web server started at %s", url_cstr);
+    BootSequence::markReached(BootStage::ServerReady);
 
-    // Set the server to running and enter the event loop
+    // Set the server to running and enter the event loop. Posted events interrupt the poll,
+    // the timeout only bounds how often Mongoose timers are serviced.
     _running = true;
     while(_running) {
-        mg_mgr_poll(&mongooseManager.getManager(), 1000);
+        mg_mgr_poll(&mgr, ServerConfig::POLL_TIMEOUT_MS);
     }
+
+    shutdown();
 }
 
 void WebServer::stop() {
-    // Stop the server by setting the running flag to false
+    // Stop the server by setting the running flag to false and waking the event loop
     _running = false;
+    postEvent(LoopEvent::Shutdown);
+}
+
+void WebServer::admitConnection(struct mg_connection* connection) {
+    ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+    state->lastActivityUs = esp_timer_get_time();
+
+    _connections.active++;
+    if (_connections.active > _connections.peak) {
+        _connections.peak = _connections.active;
+    }
+
+    // A TLS client cannot read a plain error response, it is disconnected instead
+    bool isTls = _tlsSessions.isReady() && mg_ntohs(connection->loc.port) == ServerConfig::TLS_PORT;
+    if (isTls && (_connections.active > ServerConfig::MAX_CONNECTIONS || _connections.tlsActive >= ServerConfig::MAX_TLS_CONNECTIONS)) {
+        _connections.tlsRejected++;
+        ESP_LOGW(TaskConfig::WEB_SERVER_TASK.tag, "TLS connection limit reached, rejecting client");
+        connection->is_closing = 1;
+        return;
+    }
+
+    if (_connections.active > ServerConfig::MAX_CONNECTIONS) {
+        _connections.rejected++;
+        ESP_LOGW(TaskConfig::WEB_SERVER_TASK.tag, "Connection limit reached, rejecting client");
+        rejectConnection(connection, 503, "Too many connections\n");
+        return;
+    }
+
+    if (isTls) {
+        // The handshake is timed from the accept until Mongoose reports it complete
+        state->isTls = true;
+        state->requestStartUs = state->lastActivityUs;
+        _connections.tlsActive++;
+        _tlsSessions.attach(connection, &state->tlsResumed);
+    }
+}
+
+void WebServer::recordHandshake(struct mg_connection* connection) {
+    const ConnectionState* state = reinterpret_cast<const ConnectionState*>(connection->data);
+    uint32_t durationUs = static_cast<uint32_t>(esp_timer_get_time() - state->requestStartUs);
+    if (state->tlsResumed) {
+        _resumedHandshakes.record(durationUs);
+    } else {
+        _fullHandshakes.record(durationUs);
+    }
+}
+
+void WebServer::checkReceiveBuffer(struct mg_connection* connection) {
+    ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+    state->lastActivityUs = esp_timer_get_time();
+
+    // Whatever is still buffered after parsing is an incomplete request; an upload instead stops
+    // reading while its data waits for the OTA writer
+    if (connection->is_accepted && !state->isRejected && !state->isUpload && connection->recv.len > ServerConfig::MAX_RECV_BUFFER) {
+        _connections.recvOverflows++;
+        ESP_LOGW(TaskConfig::WEB_SERVER_TASK.tag, "Receive buffer limit exceeded (%u bytes)", static_cast<unsigned>(connection->recv.len));
+        rejectConnection(connection, 413, "Request too large\n");
+    }
+}
+
+bool WebServer::rejectOversizedBody(struct mg_connection* connection, struct mg_http_message* http_message) {
+    ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+    if (state->isRejected) {
+        return true;
+    }
+
+    // The body length comes from Content-Length, so this works before the body has arrived
+    if (http_message->body.len <= ServerConfig::MAX_BODY_SIZE) {
+        return false;
+    }
+
+    _connections.bodyTooLarge++;
+    ESP_LOGW(TaskConfig::WEB_SERVER_TASK.tag, "Request body too large (%u bytes)", static_cast<unsigned>(http_message->body.len));
+    rejectConnection(connection, 413, "Request body too large\n");
+    return true;
+}
+
+void WebServer::checkConnectionLimits(struct mg_connection* connection) {
+    if (!connection->is_accepted || connection->is_closing) {
+        return;
+    }
+
+    const ConnectionState* state = reinterpret_cast<const ConnectionState*>(connection->data);
+
+    // Event streams only send, so a growing send buffer means the client stopped reading
+    if (state->isEventStream) {
+        if (connection->send.len > ServerConfig::MAX_SEND_BUFFER) {
+            _connections.sendOverflows++;
+            ESP_LOGW(TaskConfig::WEB_SERVER_TASK.tag, "Event stream client too slow, closing");
+            connection->is_closing = 1;
+        }
+        return;
+    }
+
+    // Connections waiting for a worker are not idle
+    int64_t idleUs = esp_timer_get_time() - state->lastActivityUs;
+    if (!connection->is_resp && idleUs > ServerConfig::IDLE_TIMEOUT_MS * 1000LL) {
+        _connections.idleClosed++;
+        connection->is_closing = 1;
+    }
+}
+
+void WebServer::rejectConnection(struct mg_connection* connection, int status, const char* message) {
+    ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+    state->isRejected = true;
+
+    mg_http_reply(connection, status, "Connection: close\r\n", "%s", message);
+
+    // Stop reading, send the response and close
+    connection->is_draining = 1;
+}
+
+void WebServer::beginUpload(struct mg_connection* connection, struct mg_http_message* http_message) {
+    ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+    if (state->isUpload || state->isRejected) {
+        return;
+    }
+
+    if (_otaWriter.isBusy()) {
+        rejectConnection(connection, 409, "Update already in progress\n");
+        return;
+    }
+
+    if (mg_http_get_header(http_message, "Content-Length") == nullptr) {
+        rejectConnection(connection, 411, "Content-Length required\n");
+        return;
+    }
+
+    struct mg_str* sha256 = mg_http_get_header(http_message, OtaConfig::SHA256_HEADER);
+    if (sha256 == nullptr) {
+        rejectConnection(connection, 400, "Missing SHA-256 header\n");
+        return;
+    }
+
+    if (!_otaWriter.begin(http_message->body.len, sha256->buf, sha256->len)) {
+        rejectConnection(connection, 400, "Update rejected\n");
+        return;
+    }
+
+    ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "Receiving firmware image of %u bytes", static_cast<unsigned>(http_message->body.len));
+    state->isUpload = true;
+    state->route = Route::Ota;
+    state->requestStartUs = esp_timer_get_time();
+    _uploadId = connection->id;
+
+    // Dropping the headers makes Mongoose detach its HTTP handler, the body arrives as raw data
+    mg_iobuf_del(&connection->recv, 0, http_message->head.len);
+}
+
+void WebServer::handleUploadData(struct mg_connection* connection) {
+    // A failed flash write ends the update right away instead of after the whole image
+    if (_otaUpdater.getState() == OtaState::Failed) {
+        _otaWriter.abort(_otaUpdater.getError());
+    }
+
+    // The writer takes what its chunk buffers have room for, anything beyond the image is dropped
+    size_t taken = _otaWriter.write(connection->recv.buf, connection->recv.len);
+    if (_otaWriter.isComplete()) {
+        taken = connection->recv.len;
+    }
+    mg_iobuf_del(&connection->recv, 0, taken);
+
+    // Stop reading from the socket until a chunk has been written, TCP then slows the client down
+    connection->is_full = connection->recv.len > 0;
+
+    // Verification runs on the writer task, the client is answered once it reports the outcome
+    if (_otaWriter.isComplete()) {
+        _otaWriter.finish();
+    }
+}
+
+void WebServer::handleOtaProgress() {
+    struct mg_connection* connection = _mongooseManager.getManager().conns;
+    while (connection != nullptr && connection->id != _uploadId) {
+        connection = connection->next;
+    }
+
+    // Without an outcome the writer has freed a chunk buffer for the data held back
+    if (!_otaWriter.takeOutcome()) {
+        if (connection != nullptr && reinterpret_cast<ConnectionState*>(connection->data)->isUpload) {
+            handleUploadData(connection);
+        }
+        return;
+    }
+
+    // The client may have gone away, then the update has been aborted
+    if (connection == nullptr) {
+        return;
+    }
+
+    // Whatever the client still sends is not read any more
+    reinterpret_cast<ConnectionState*>(connection->data)->isUpload = false;
+    mg_iobuf_del(&connection->recv, 0, connection->recv.len);
+    connection->is_full = 1;
+    if (_otaUpdater.getState() == OtaState::Succeeded) {
+        mg_http_reply(connection, 200, "Connection: close\r\n", "Update successful, restarting\n");
+        recordLatency(connection);
+
+        // Give the response time to reach the client, the new image confirms itself after boot
+        mg_timer_add(&_mongooseManager.getManager(), OtaConfig::RESTART_DELAY_MS, MG_TIMER_ONCE, [](void*) { esp_restart(); }, nullptr);
+    } else {
+        mg_http_reply(connection, 400, "Connection: close\r\n", "Update failed: %s\n", _otaUpdater.getError());
+    }
+    connection->is_draining = 1;
+}
+
+void WebServer::handleOtaStatusRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    static constexpr const char* STATE_NAMES[] = {"idle", "receiving", "succeeded", "failed"};
+
+    // Create a JSON object
+    cJSON* jsonObject = cJSON_CreateObject();
+
+    // Add the update progress and the running firmware
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    cJSON_AddStringToObject(jsonObject, "state", STATE_NAMES[static_cast<size_t>(_otaUpdater.getState())]);
+    cJSON_AddNumberToObject(jsonObject, "received", _otaUpdater.getReceived());
+    cJSON_AddNumberToObject(jsonObject, "size", _otaUpdater.getImageSize());
+    cJSON_AddStringToObject(jsonObject, "error", _otaUpdater.getError());
+    cJSON_AddStringToObject(jsonObject, "runningPartition", running != nullptr ? running->label : "");
+
+    // Convert the JSON object to a string
+    char* jsonString = cJSON_PrintUnformatted(jsonObject);
+
+    // Send the JSON response
+    mg_http_reply(connection, 200, "Content-Type: application/json\r\n", "%s", jsonString);
+
+    // Clean up
+    cJSON_Delete(jsonObject);
+    cJSON_free(jsonString);
+}
+
+void WebServer::shutdown() {
+    mg_mgr& mgr = _mongooseManager.getManager();
+
+    // Waits for a notification in progress on the fan task, which would otherwise wake a freed manager
+    _fanManager.setStateListener(nullptr);
+    _mqttClient.stop();
+    _fleetManager.stop();
+
+    // Let every connection flush what is already queued, then close it
+    for (struct mg_connection* connection = mgr.conns; connection != nullptr; connection = connection->next) {
+        connection->is_draining = 1;
+    }
+
+    int64_t deadline = esp_timer_get_time() + ServerConfig::SHUTDOWN_TIMEOUT_MS * 1000LL;
+    while (mgr.conns != nullptr && esp_timer_get_time() < deadline) {
+        mg_mgr_poll(&mgr, 10);
+    }
+
+    _workerPool.stop();
+    _otaWriter.stop();
+
+    ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "Web server stopped");
+}
+
+void WebServer::postEvent(LoopEvent event) {
+    LoopMessage message = {
+        .event = event,
+        .postedUs = esp_timer_get_time()
+    };
+    mg_wakeup(&_mongooseManager.getManager(), _listenerId, &message, sizeof(message));
+}
+
+void WebServer::handleLoopMessage(const LoopMessage& message) {
+    switch (message.event) {
+    case LoopEvent::JobsCompleted:
+        sendCompletedResponses();
+        break;
+    case LoopEvent::FanStateChanged:
+        broadcastFanState();
+        _notifyLatency.record(static_cast<uint32_t>(esp_timer_get_time() - message.postedUs));
+        break;
+    case LoopEvent::OtaProgress:
+        handleOtaProgress();
+        break;
+    case LoopEvent::Shutdown:
+        // Nothing to do, waking the loop is enough for it to see the cleared running flag
+        break;
+    }
 }
 
 void WebServer::handle_request(struct mg_connection *connection, int event, void *event_data) {
@@ -44,13 +397,97 @@ void WebServer::handle_request(struct mg_connection *connection, int event, void
     
     switch (event)
     {
+    // A client has connected
+    case MG_EV_ACCEPT:
+        server->admitConnection(connection);
+        break;
+
+    // Data has been received and parsed as far as possible
+    case MG_EV_READ:
+        if (reinterpret_cast<ConnectionState*>(connection->data)->isUpload) {
+            server->handleUploadData(connection);
+        }
+        server->checkReceiveBuffer(connection);
+        break;
+
+    // Periodic check of every connection
+    case MG_EV_POLL:
+        server->checkConnectionLimits(connection);
+        break;
+
+    // The TLS handshake of an HTTPS connection has completed
+    case MG_EV_TLS_HS:
+        server->recordHandshake(connection);
+        break;
+
+    // A connection has been closed
+    case MG_EV_CLOSE:
+        if (connection->is_accepted) {
+            server->_connections.active--;
+        }
+        if (reinterpret_cast<ConnectionState*>(connection->data)->isTls) {
+            server->_connections.tlsActive--;
+        }
+        if (reinterpret_cast<ConnectionState*>(connection->data)->isUpload) {
+            server->_otaWriter.abort("Client disconnected");
+        }
+        break;
+
+    // The headers of a request are complete, the body may still be arriving
+    case MG_EV_HTTP_HDRS: {
+        struct mg_http_message *http_message = (struct mg_http_message *) event_data;
+        if (mg_match(http_message->uri, mg_str(OTA_ENDPOINT), nullptr) && mg_strcmp(http_message->method, mg_str("POST")) == 0) {
+            server->beginUpload(connection, http_message);
+        } else {
+            server->rejectOversizedBody(connection, http_message);
+        }
+        break;
+    }
+
+    // An event has been posted from another task
+    case MG_EV_WAKEUP: {
+        struct mg_str* data = (struct mg_str*) event_data;
+        RequestArena::Scope arenaScope(_arena);
+        if (data->len == sizeof(LoopMessage)) {
+            LoopMessage message;
+            memcpy(&message, data->buf, sizeof(message));
+            server->handleLoopMessage(message);
+        }
+        break;
+    }
+
     // Handle a new HTTP request
-    case MG_EV_HTTP_MSG:
+    case MG_EV_HTTP_MSG: {
         // Extract the HTTP message
         struct mg_http_message *http_message = (struct mg_http_message *) event_data;
+        ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+        state->requestStartUs = esp_timer_get_time();
+
+        // Every further request on a kept-alive HTTPS connection has saved a handshake
+        if (state->isTls && state->requestCount > 0) {
+            server->_connections.tlsReused++;
+        }
+        if (state->requestCount < UINT8_MAX) {
+            state->requestCount++;
+        }
+
+        // A request right after light sleep has most likely woken the chip
+        int64_t sinceWakeUs = state->requestStartUs - PowerManager::getLastWakeUs();
+        if (PowerManager::isSaving() && sinceWakeUs < PowerConfig::WAKE_WINDOW_US) {
+            server->_wakeLatency.record(static_cast<uint32_t>(sinceWakeUs));
+        }
+
+        // Everything the handler allocates through cJSON is released when the response is queued
+        RequestArena::Scope arenaScope(_arena);
+
+        // Refused connections only wait for their error response to be sent
+        if (server->rejectOversizedBody(connection, http_message)) {
+            break;
+        }
 
         // Check the URI and serve the appropriate response
         if (mg_match(http_message->uri, mg_str(FAN_ENDPOINT), nullptr)) {
+            state->route = Route::Fan;
             if (mg_strcmp(http_message->method, mg_str("GET")) == 0) {
                 server->handleFanDataRequest(connection, http_message);
             } else if (mg_strcmp(http_message->method, mg_str("POST")) == 0) {
@@ -60,6 +497,7 @@ void WebServer::handle_request(struct mg_connection *connection, int event, void
             }
         }
         else if (mg_match(http_message->uri, mg_str(FAN_MANAGER_ENDPOINT), nullptr)) {
+            state->route = Route::FanManager;
             if (mg_strcmp(http_message->method, mg_str("GET")) == 0) {
                 server->handleFanManagerDataRequest(connection, http_message);
             } else if (mg_strcmp(http_message->method, mg_str("POST")) == 0) {
@@ -68,41 +506,130 @@ void WebServer::handle_request(struct mg_connection *connection, int event, void
                 mg_http_reply(connection, 405, "", "Method not allowed\n");
             }
         }
+        else if (mg_match(http_message->uri, mg_str(FAN_BATCH_ENDPOINT), nullptr)) {
+            state->route = Route::FanBatch;
+            if (mg_strcmp(http_message->method, mg_str("POST")) == 0) {
+                server->handleFanBatchRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(FLEET_ENDPOINT), nullptr)) {
+            state->route = Route::Fleet;
+            if (mg_strcmp(http_message->method, mg_str("GET")) == 0) {
+                server->handleFleetRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(FLEET_CONFIG_ENDPOINT), nullptr)) {
+            state->route = Route::Fleet;
+            if (mg_strcmp(http_message->method, mg_str("POST")) == 0) {
+                server->handleFleetConfigRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(FLEET_KEY_ENDPOINT), nullptr)) {
+            state->route = Route::Fleet;
+            if (mg_strcmp(http_message->method, mg_str("PUT")) == 0) {
+                server->handleFleetKeyRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(TRACE_ENDPOINT), nullptr)) {
+            state->route = Route::Trace;
+            if (mg_strcmp(http_message->method, mg_str("GET")) == 0 || mg_strcmp(http_message->method, mg_str("POST")) == 0) {
+                server->handleTraceRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(TRACE_FILE_ENDPOINT), nullptr)) {
+            state->route = Route::Trace;
+            if (mg_strcmp(http_message->method, mg_str("GET")) == 0) {
+                server->handleTraceFileRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(TRACE_REPLAY_ENDPOINT), nullptr)) {
+            state->route = Route::Trace;
+            if (mg_strcmp(http_message->method, mg_str("POST")) == 0) {
+                server->handleTraceReplayRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
+        else if (mg_match(http_message->uri, mg_str(STATS_ENDPOINT), nullptr)) {
+            state->route = Route::Stats;
+            server->handleStatsRequest(connection, http_message);
+        }
+        else if (mg_match(http_message->uri, mg_str(EVENTS_ENDPOINT), nullptr)) {
+            state->route = Route::Events;
+            server->handleEventStreamRequest(connection, http_message);
+        }
+        else if (mg_match(http_message->uri, mg_str(OTA_ENDPOINT), nullptr)) {
+            // Uploads are handled before the body is buffered, only status requests get here
+            state->route = Route::Ota;
+            if (mg_strcmp(http_message->method, mg_str("GET")) == 0) {
+                server->handleOtaStatusRequest(connection, http_message);
+            } else {
+                mg_http_reply(connection, 405, "", "Method not allowed\n");
+            }
+        }
         else if (mg_match(http_message->uri, mg_str(SCRIPTS_ENDPOINT), nullptr)) {
-            string fullPath = string(SPIFFSConfig::SPIFFS_BASE_PATH) + string(SCRIPTS_ENDPOINT);
-            server->serveStaticFile(connection, http_message, fullPath);
+            state->route = Route::Static;
+            server->serveStaticFile(connection, http_message, SCRIPTS_PATH);
         }
         else if (mg_match(http_message->uri, mg_str(STYLES_ENDPOINT), nullptr)) {
-            string fullPath = string(SPIFFSConfig::SPIFFS_BASE_PATH) + string(STYLES_ENDPOINT);
-            server->serveStaticFile(connection, http_message, fullPath);
+            state->route = Route::Static;
+            server->serveStaticFile(connection, http_message, STYLES_PATH);
         }
         else {
-            server->serveStaticFile(connection, http_message, string(INDEX_PATH));
+            state->route = Route::Static;
+            server->serveStaticFile(connection, http_message, INDEX_PATH);
+        }
+
+        // Requests answered inline are complete now, offloaded ones when the worker is done
+        if (!connection->is_resp || state->isEventStream) {
+            server->recordLatency(connection);
         }
 
         break;
     }
+    }
 }
 
 void WebServer::handleFanDataUpdate(struct mg_connection* connection, struct mg_http_message* http_message) {
+    // A whole group can be set at once instead of a single fan
+    char groupName[32];
+    if (getQueryParam(http_message, "group", groupName, sizeof(groupName))) {
+        handleFanGroupUpdate(connection, http_message, groupName);
+        return;
+    }
+
     // Retrieve the fan name from the query parameters
     char fanName[32];
     if (!getQueryParam(http_message, "name", fanName, sizeof(fanName))) {
-        mg_http_reply(connection, 400, "", "Missing 'name' query parameter\n");
+        mg_http_reply(connection, 400, "", "Missing 'name' or 'group' query parameter\n");
         return;
     }
     
-    // Retrieve the fan instance using the fan name
-    auto fan = _fanManager.getFan(fanName);
-    if (!fan) {
+    // Check that the fan exists
+    if (!_fanManager.getFan(fanName)) {
         mg_http_reply(connection, 404, "", "Fan not found\n");
         return;
     }
 
     int power;
-    // If the power is provided in the request, set it for the fan
+    // If the power is provided in the request, queue it for the fan; it is persisted in the background
     if (getJSONParam(http_message, "power", power) && power >= 0 && power <= 100) {
-        fan->get()->setPower(power);
+        if (!_fanManager.setFanPower(fanName, power)) {
+            mg_http_reply(connection, 503, "", "Too many pending commands\n");
+            return;
+        }
         ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "Fan %s speed set to %d%%", fanName, power);
         mg_http_reply(connection, 200, "", "Power set successfully\n");
     } else {
@@ -111,51 +638,257 @@ void WebServer::handleFanDataUpdate(struct mg_connection* connection, struct mg_
     }
 }
 
+void WebServer::handleFanGroupUpdate(struct mg_connection* connection, struct mg_http_message* http_message, const char* groupName) {
+    int power;
+    if (!getJSONParam(http_message, "power", power) || power < 0 || power > 100) {
+        mg_http_reply(connection, 400, "", "Invalid 'power' parameter\n");
+        return;
+    }
+
+    // All members of the group change in the same control tick
+    BatchResult result = _fanManager.setGroupPower(groupName, power);
+    if (result == BatchResult::Accepted) {
+        ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "Group %s speed set to %d%%", groupName, power);
+    }
+    replyBatchResult(connection, result);
+}
+
 void WebServer::handleFanDataRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    // Binary clients get the same fields without the repeated text keys and decimal digits
+    if (negotiateFormat(http_message) == ResponseFormat::Cbor) {
+        replyCbor(connection, [this](CborWriter& writer) { writeFanDataCbor(writer); });
+        return;
+    }
+
+    // Create a JSON array with the data of all fans
+    cJSON* jsonArray = buildFanDataJSON();
+
+    // Convert the JSON array to a string
+    char* jsonString = cJSON_PrintUnformatted(jsonArray);
+
+    // Send the JSON response
+    mg_http_reply(connection, 200, "Content-Type: application/json\r\nVary: Accept\r\n", "%s", jsonString);
+
+    // Clean up
+    cJSON_Delete(jsonArray);
+    cJSON_free(jsonString);
+}
+
+cJSON* WebServer::buildFanDataJSON() {
     // Create a JSON array
     cJSON* jsonArray = cJSON_CreateArray();
 
     // Iterate through all fans and add their data to the JSON array
-    for (const auto& [name, fan] : _fanManager.getFans()) {
+    for (const auto& fan : _fanManager.getFans()) {
         cJSON* fanObject = cJSON_CreateObject();
-        
-        // Add fan data to the JSON object
-        cJSON_AddStringToObject(fanObject, "name", name.c_str());
-        cJSON_AddNumberToObject(fanObject, "speed", fan->getSpeed());
-        cJSON_AddNumberToObject(fanObject, "power", fan->getConfig().fanPower);
-        
-        // Add the fan object to the JSON array
+        addFieldsToJSON(fanObject, FAN_FIELDS, *fan);
         cJSON_AddItemToArray(jsonArray, fanObject);
     }
 
-    // Convert the JSON array to a string
-    char* jsonString = cJSON_PrintUnformatted(jsonArray);
+    return jsonArray;
+}
 
-    // Send the JSON response
-    mg_http_reply(connection, 200, "Content-Type: application/json\r\n", "%s", jsonString);
+void WebServer::writeFanDataCbor(CborWriter& writer) {
+    const auto& fans = _fanManager.getFans();
+    writer.beginArray(fans.size());
+    for (const auto& fan : fans) {
+        writeFieldsToCbor(writer, FAN_FIELDS, *fan);
+    }
+}
 
-    // Clean up
-    cJSON_Delete(jsonArray);
-    free(jsonString);
+ResponseFormat WebServer::negotiateFormat(const struct mg_http_message* http_message) {
+    const struct mg_str* accept = mg_http_get_header(const_cast<struct mg_http_message*>(http_message), "Accept");
+    if (accept == nullptr) {
+        return ResponseFormat::Json;
+    }
+
+    // The most specific range decides the quality of a format, regardless of its position
+    uint16_t cborQuality = 0;
+    uint16_t jsonQuality = 0;
+    uint8_t cborMatch = 0;
+    uint8_t jsonMatch = 0;
+    struct mg_str entries = *accept;
+    struct mg_str entry;
+    while (mg_span(entries, &entry, &entries, ',')) {
+        struct mg_str range;
+        struct mg_str params;
+        mg_span(entry, &range, &params, ';');
+        range = mg_strstrip(range);
+
+        uint16_t quality = 1000;
+        bool valid = true;
+        struct mg_str param;
+        while (mg_span(params, &param, &params, ';')) {
+            struct mg_str name;
+            struct mg_str value;
+            mg_span(param, &name, &value, '=');
+            if (mg_strcasecmp(mg_strstrip(name), mg_str("q")) == 0) {
+                valid = parseQuality(mg_strstrip(value), quality);
+            }
+        }
+        if (!valid) {
+            continue;
+        }
+
+        uint8_t match = matchMediaRange(range, CBOR_CONTENT_TYPE);
+        if (match > cborMatch) {
+            cborMatch = match;
+            cborQuality = quality;
+        }
+        match = matchMediaRange(range, JSON_CONTENT_TYPE);
+        if (match > jsonMatch) {
+            jsonMatch = match;
+            jsonQuality = quality;
+        }
+    }
+
+    // JSON is the default, on a tie CBOR needs to be asked for by name
+    if (cborQuality > jsonQuality || (cborQuality > 0 && cborQuality == jsonQuality && cborMatch == 3 && jsonMatch < 3)) {
+        return ResponseFormat::Cbor;
+    }
+    return ResponseFormat::Json;
+}
+
+uint8_t WebServer::matchMediaRange(struct mg_str range, const char* type) {
+    struct mg_str rangeType;
+    struct mg_str rangeSubtype;
+    struct mg_str typeType;
+    struct mg_str typeSubtype;
+    if (!mg_span(range, &rangeType, &rangeSubtype, '/') || !mg_span(mg_str(type), &typeType, &typeSubtype, '/')) {
+        return 0;
+    }
+
+    if (mg_strcmp(rangeType, mg_str("*")) == 0) {
+        return mg_strcmp(rangeSubtype, mg_str("*")) == 0 ? 1 : 0;
+    }
+    if (mg_strcasecmp(rangeType, typeType) != 0) {
+        return 0;
+    }
+    if (mg_strcmp(rangeSubtype, mg_str("*")) == 0) {
+        return 2;
+    }
+    return mg_strcasecmp(rangeSubtype, typeSubtype) == 0 ? 3 : 0;
+}
+
+bool WebServer::parseQuality(struct mg_str value, uint16_t& quality) {
+    // qvalue = "0" [ "." 0*3DIGIT ] / "1" [ "." 0*3"0" ]
+    if (value.len == 0 || (value.buf[0] != '0' && value.buf[0] != '1') || value.len > 5) {
+        return false;
+    }
+    if (value.len > 1 && value.buf[1] != '.') {
+        return false;
+    }
+
+    uint16_t thousandths = 0;
+    uint16_t scale = 100;
+    for (size_t i = 2; i < value.len; i++, scale /= 10) {
+        if (value.buf[i] < '0' || value.buf[i] > '9') {
+            return false;
+        }
+        thousandths += (value.buf[i] - '0') * scale;
+    }
+    if (value.buf[0] == '1' && thousandths > 0) {
+        return false;
+    }
+
+    quality = value.buf[0] == '1' ? 1000 : thousandths;
+    return true;
+}
+
+template<typename Encode>
+void WebServer::replyCbor(struct mg_connection* connection, Encode encode) {
+    // The buffer comes from the request arena, the encoder itself never allocates
+    uint8_t* buffer = static_cast<uint8_t*>(_arena.allocate(ServerConfig::MAX_CBOR_RESPONSE_SIZE));
+    if (buffer == nullptr) {
+        mg_http_reply(connection, 500, "", "Out of memory\n");
+        return;
+    }
+
+    CborWriter writer(buffer, ServerConfig::MAX_CBOR_RESPONSE_SIZE);
+    encode(writer);
+    if (writer.hasOverflowed()) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "CBOR response exceeds %u bytes", static_cast<unsigned>(ServerConfig::MAX_CBOR_RESPONSE_SIZE));
+        mg_http_reply(connection, 500, "", "Response too large\n");
+        return;
+    }
+
+    // mg_http_reply formats text, binary bodies are sent as they are
+    mg_printf(connection, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nVary: Accept\r\nContent-Length: %u\r\n\r\n",
+              CBOR_CONTENT_TYPE, static_cast<unsigned>(writer.getLength()));
+    mg_send(connection, buffer, writer.getLength());
+}
+
+void WebServer::handleEventStreamRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    ConnectionState* state = reinterpret_cast<ConnectionState*>(connection->data);
+    state->isEventStream = true;
+
+    // Keep the connection open and switch it to server-sent events
+    mg_printf(connection, "HTTP/1.1 200 OK\r\n"
+                          "Content-Type: text/event-stream\r\n"
+                          "Cache-Control: no-cache\r\n"
+                          "Connection: keep-alive\r\n\r\n");
+
+    // Send the current state right away so the client does not have to poll for it
+    char* event = buildFanStateEvent();
+    mg_printf(connection, "event: fan\ndata: %s\n\n", event);
+    cJSON_free(event);
+}
+
+void WebServer::broadcastFanState() {
+    char* event = nullptr;
+
+    for (struct mg_connection* connection = _mongooseManager.getManager().conns; connection != nullptr; connection = connection->next) {
+        const ConnectionState* state = reinterpret_cast<const ConnectionState*>(connection->data);
+        if (!state->isEventStream || connection->is_closing) {
+            continue;
+        }
+
+        // Do not queue more data for a client that stopped reading, the poll check closes it
+        if (connection->send.len > ServerConfig::MAX_SEND_BUFFER) {
+            continue;
+        }
+
+        // Serialize only once, and only if someone is listening
+        if (event == nullptr) {
+            event = buildFanStateEvent();
+        }
+        mg_printf(connection, "event: fan\ndata: %s\n\n", event);
+    }
+
+    cJSON_free(event);
+}
+
+char* WebServer::buildFanStateEvent() {
+    cJSON* jsonObject = cJSON_CreateObject();
+    cJSON_AddBoolToObject(jsonObject, "running", _fanManager.isRunning());
+    cJSON_AddItemToObject(jsonObject, "fans", buildFanDataJSON());
+
+    char* jsonString = cJSON_PrintUnformatted(jsonObject);
+    cJSON_Delete(jsonObject);
+    return jsonString;
 }
 
 void WebServer::handleFanManagerDataRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    if (negotiateFormat(http_message) == ResponseFormat::Cbor) {
+        replyCbor(connection, [this](CborWriter& writer) { writeFieldsToCbor(writer, FAN_MANAGER_FIELDS, _fanManager); });
+        return;
+    }
+
     // Create a JSON object
     cJSON* jsonObject = cJSON_CreateObject();
 
     // Add fan manager data to the JSON object
-    cJSON_AddNumberToObject(jsonObject, "interval", _fanManager.getInterval());
-    cJSON_AddNumberToObject(jsonObject, "runtimeOfFans", _fanManager.getRuntimeOfFans());
+    addFieldsToJSON(jsonObject, FAN_MANAGER_FIELDS, _fanManager);
 
     // Convert the JSON object to a string
     char* jsonString = cJSON_PrintUnformatted(jsonObject);
 
     // Send the JSON response
-    mg_http_reply(connection, 200, "Content-Type: application/json\r\n", "%s", jsonString);
+    mg_http_reply(connection, 200, "Content-Type: application/json\r\nVary: Accept\r\n", "%s", jsonString);
 
     // Clean up
     cJSON_Delete(jsonObject);
-    free(jsonString);
+    cJSON_free(jsonString);
 }
 
 void WebServer::handleFanManagerDataUpdate(struct mg_connection* connection, struct mg_http_message* http_message) {
@@ -167,43 +900,615 @@ void WebServer::handleFanManagerDataUpdate(struct mg_connection* connection, str
         return;
     }
 
-    // Update the fan manager with the new values
-    _fanManager.setInterval(static_cast<uint16_t>(interval));
-    _fanManager.setRuntimeOfFans(static_cast<uint16_t>(runtimeOfFans));
+    // Queue both values together so the fan task never sees only one of them changed
+    FanCommandBatch batch = {};
+    batch.hasInterval = true;
+    batch.interval = static_cast<uint16_t>(interval);
+    batch.hasRuntimeOfFans = true;
+    batch.runtimeOfFans = static_cast<uint16_t>(runtimeOfFans);
+
+    BatchResult result = _fanManager.submitBatch(batch);
+    if (result != BatchResult::Accepted) {
+        replyBatchResult(connection, result);
+        return;
+    }
 
     // Send a success response
     mg_http_reply(connection, 200, "", "Fan manager updated successfully\n");
 }
 
-void WebServer::serveStaticFile(struct mg_connection* connection, struct mg_http_message* http_message, const string& filePath) {
-    FILE* file = fopen(filePath.c_str(), "rb");
-    if (!file) {
-        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to open file: %s", filePath.c_str());
-        mg_http_reply(connection, 404, "Content-Type: text/plain\r\n", "File read error\n");
+void WebServer::handleFanBatchRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    FanCommandBatch batch;
+    const char* error = FanCommandParser::parse(http_message->body.buf, http_message->body.len, batch);
+    if (error != nullptr) {
+        mg_http_reply(connection, 400, "", "%s\n", error);
+        return;
+    }
+
+    BatchResult result = _fanManager.submitBatch(batch);
+    if (result == BatchResult::Accepted) {
+        ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "Queued batch with %u fan changes", batch.fanCount);
+    }
+    replyBatchResult(connection, result);
+}
+
+void WebServer::handleFleetRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    // Create a JSON object
+    cJSON* jsonObject = cJSON_CreateObject();
+    cJSON_AddBoolToObject(jsonObject, "enabled", _fleetManager.isEnabled());
+    cJSON_AddStringToObject(jsonObject, "coordinator", _fleetManager.getCoordinatorId());
+    cJSON* nodes = cJSON_AddArrayToObject(jsonObject, "nodes");
+
+    // This node comes first, with the same fan fields as GET /fan
+    cJSON* self = cJSON_CreateObject();
+    cJSON_AddItemToArray(nodes, self);
+    cJSON_AddStringToObject(self, "id", _fleetManager.getSelfId());
+    cJSON_AddStringToObject(self, "address", Network::STATIC_IP);
+    cJSON_AddNumberToObject(self, "port", atoi(_port));
+    cJSON_AddBoolToObject(self, "self", true);
+    cJSON_AddNumberToObject(self, "ageMs", 0);
+    cJSON_AddBoolToObject(self, "running", _fanManager.isRunning());
+    cJSON_AddItemToObject(self, "fans", buildFanDataJSON());
+
+    // The other nodes as of their last announcement
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < _fleetManager.getNodeCount(); i++) {
+        const FleetNode& node = _fleetManager.getNode(i);
+        cJSON* nodeObject = cJSON_CreateObject();
+        cJSON_AddItemToArray(nodes, nodeObject);
+        cJSON_AddStringToObject(nodeObject, "id", node.id);
+        cJSON_AddStringToObject(nodeObject, "address", node.address);
+        cJSON_AddNumberToObject(nodeObject, "port", node.port);
+        cJSON_AddBoolToObject(nodeObject, "self", false);
+        cJSON_AddNumberToObject(nodeObject, "ageMs", (now - node.lastSeenUs) / 1000);
+        cJSON_AddBoolToObject(nodeObject, "running", node.running);
+        cJSON_AddNumberToObject(nodeObject, "configEpoch", node.configEpoch);
+        cJSON_AddNumberToObject(nodeObject, "configVersion", node.configVersion);
+        cJSON* fans = cJSON_AddArrayToObject(nodeObject, "fans");
+        for (size_t j = 0; j < node.fanCount; j++) {
+            cJSON* fanObject = cJSON_CreateObject();
+            cJSON_AddItemToArray(fans, fanObject);
+            cJSON_AddStringToObject(fanObject, "name", node.fans[j].name);
+            cJSON_AddNumberToObject(fanObject, "speed", node.fans[j].rpm);
+            cJSON_AddNumberToObject(fanObject, "power", node.fans[j].power);
+        }
+    }
+
+    // Add the fleet traffic counters
+    const FleetStats& fleetStats = _fleetManager.getStats();
+    cJSON* stats = cJSON_AddObjectToObject(jsonObject, "stats");
+    cJSON_AddNumberToObject(stats, "announcementsSent", fleetStats.announcementsSent);
+    cJSON_AddNumberToObject(stats, "announcementsReceived", fleetStats.announcementsReceived);
+    cJSON_AddNumberToObject(stats, "announcementsRejected", fleetStats.announcementsRejected);
+    cJSON_AddNumberToObject(stats, "configsPushed", fleetStats.configsPushed);
+    cJSON_AddNumberToObject(stats, "configsApplied", fleetStats.configsApplied);
+    cJSON_AddNumberToObject(stats, "coordinatorChanges", fleetStats.coordinatorChanges);
+
+    // Convert the JSON object to a string
+    char* jsonString = cJSON_PrintUnformatted(jsonObject);
+
+    // Send the JSON response
+    mg_http_reply(connection, 200, "Content-Type: application/json\r\n", "%s", jsonString);
+
+    // Clean up
+    cJSON_Delete(jsonObject);
+    cJSON_free(jsonString);
+}
+
+void WebServer::handleFleetConfigRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    // Only the coordinator distributes configurations, point the client to it
+    if (!_fleetManager.isCoordinator()) {
+        const FleetNode* coordinator = _fleetManager.findNode(_fleetManager.getCoordinatorId());
+        if (coordinator != nullptr) {
+            mg_http_reply(connection, 409, "", "Not the coordinator, use http://%s:%u%s\n", coordinator->address, coordinator->port, FLEET_CONFIG_ENDPOINT);
+        } else {
+            mg_http_reply(connection, 409, "", "Not the coordinator\n");
+        }
+        return;
+    }
+
+    // Parse JSON body with RAII for cleanup
+    auto jsonDeleter = [](cJSON* json) { cJSON_Delete(json); };
+    unique_ptr<cJSON, decltype(jsonDeleter)> json(cJSON_ParseWithLength(http_message->body.buf, http_message->body.len), jsonDeleter);
+
+    FanCommandBatch batch;
+    const char* error = FanCommandParser::parse(json.get(), batch);
+    if (error != nullptr) {
+        mg_http_reply(connection, 400, "", "%s\n", error);
         return;
     }
 
+    // The members receive the configuration in compact form, inside the coordinator's announcements
+    char* compact = cJSON_PrintUnformatted(json.get());
+    if (compact == nullptr || strlen(compact) >= FleetConfig::MAX_CONFIG_SIZE) {
+        mg_http_reply(connection, 413, "", "Fleet configuration too large\n");
+    } else {
+        replyBatchResult(connection, _fleetManager.pushConfig(batch, mg_str(compact)));
+    }
+    cJSON_free(compact);
+}
+
+void WebServer::handleFleetKeyRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    uint8_t key[FleetConfig::KEY_SIZE];
+    struct mg_str hex = mg_strstrip(http_message->body);
+    if (!FleetAuth::parseKey(hex.buf, hex.len, key)) {
+        mg_http_reply(connection, 400, "", "Expected the key as %u hex characters\n", static_cast<unsigned>(2 * FleetConfig::KEY_SIZE));
+        return;
+    }
+
+    bool stored = _fleetManager.setKey(key);
+    memset(key, 0, sizeof(key));
+    if (!stored) {
+        mg_http_reply(connection, 500, "", "Failed to store the fleet key\n");
+        return;
+    }
+    mg_http_reply(connection, 200, "", "Fleet key stored\n");
+}
+
+void WebServer::handleTraceRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    if (mg_strcmp(http_message->method, mg_str("POST")) == 0) {
+        char action[8];
+        if (!getQueryParam(http_message, "action", action, sizeof(action))) {
+            mg_http_reply(connection, 400, "", "Missing action\n");
+        } else if (strcmp(action, "start") == 0) {
+            if (TraceRecorder::isActive()) {
+                mg_http_reply(connection, 409, "", "Recording in progress\n");
+                return;
+            }
+            _fanManager.startTrace();
+            mg_http_reply(connection, 202, "", "Recording starts with the next control tick\n");
+        } else if (strcmp(action, "stop") == 0) {
+            TraceRecorder::stop();
+            mg_http_reply(connection, 200, "", "Recording stopped\n");
+        } else {
+            mg_http_reply(connection, 400, "", "Unknown action\n");
+        }
+        return;
+    }
+
+    // Create a JSON object
+    TraceStats stats = TraceRecorder::getStats();
+    cJSON* jsonObject = cJSON_CreateObject();
+    cJSON_AddBoolToObject(jsonObject, "active", stats.active);
+    cJSON_AddNumberToObject(jsonObject, "events", stats.events);
+    cJSON_AddNumberToObject(jsonObject, "dropped", stats.dropped);
+    cJSON_AddNumberToObject(jsonObject, "bytes", stats.bytesWritten);
+
+    // Convert the JSON object to a string
+    char* jsonString = cJSON_PrintUnformatted(jsonObject);
+
+    // Send the JSON response
+    mg_http_reply(connection, 200, "Content-Type: application/json\r\n", "%s", jsonString);
+
+    // Clean up
+    cJSON_Delete(jsonObject);
+    cJSON_free(jsonString);
+}
+
+void WebServer::handleTraceFileRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    if (TraceRecorder::isActive()) {
+        mg_http_reply(connection, 409, "", "Recording in progress\n");
+        return;
+    }
+
+    // Mongoose sends the file piece by piece as the connection drains
+    struct mg_http_serve_opts options = {};
+    options.mime_types = "bin=application/octet-stream";
+    mg_http_serve_file(connection, http_message, TraceConfig::PATH, &options);
+}
+
+void WebServer::handleTraceReplayRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    if (TraceRecorder::isActive()) {
+        mg_http_reply(connection, 409, "", "Recording in progress\n");
+        return;
+    }
+
+    HttpRequest request = {
+        .connectionId = connection->id
+    };
+
+    bool queued = _workerPool.submit(request, [this](const HttpRequest&, char* buffer, size_t bufferSize) {
+        return replayTrace(buffer, bufferSize);
+    });
+
+    if (!queued) {
+        mg_http_reply(connection, 503, "Retry-After: 1\r\n", "Server busy\n");
+        return;
+    }
+
+    // Hold back pipelined requests on this connection until the worker has answered
+    connection->is_resp = 1;
+}
+
+HttpResponse WebServer::replayTrace(char* buffer, size_t bufferSize) {
+    // Too large for the worker stack
+    auto replayer = make_unique<TraceReplayer>();
+    if (!replayer->run(TraceConfig::PATH)) {
+        snprintf(buffer, bufferSize, "%s\n", replayer->getError());
+        return {404, "Content-Type: text/plain\r\n", buffer};
+    }
+    const TraceReplayResult& result = replayer->getResult();
+
+    // Create a JSON object
+    cJSON* jsonObject = cJSON_CreateObject();
+    cJSON* start = cJSON_AddObjectToObject(jsonObject, "start");
+    cJSON_AddBoolToObject(start, "running", result.start.running);
+    cJSON_AddNumberToObject(start, "elapsedMs", result.start.elapsedMs);
+    cJSON_AddNumberToObject(start, "interval", result.start.interval);
+    cJSON_AddNumberToObject(start, "runtimeOfFans", result.start.runtimeOfFans);
+
+    cJSON_AddNumberToObject(jsonObject, "events", result.events);
+    cJSON_AddNumberToObject(jsonObject, "ticks", result.ticks);
+    cJSON_AddNumberToObject(jsonObject, "durationMs", result.durationUs / 1000);
+    cJSON_AddNumberToObject(jsonObject, "cpuUs", result.cpuUs);
+    cJSON_AddNumberToObject(jsonObject, "speedup", result.cpuUs > 0 ? static_cast<double>(result.durationUs) / result.cpuUs : 0);
+    cJSON_AddNumberToObject(jsonObject, "transitions", result.transitions);
+    cJSON_AddNumberToObject(jsonObject, "mismatches", result.mismatches);
+    cJSON_AddNumberToObject(jsonObject, "maxDeviationUs", result.maxDeviationUs);
+    cJSON_AddNumberToObject(jsonObject, "dutyMismatches", result.dutyMismatches);
+
+    cJSON* fans = cJSON_AddArrayToObject(jsonObject, "fans");
+    for (uint8_t i = 0; i < result.fanCount; i++) {
+        const TraceFanSummary& fan = result.fans[i];
+        cJSON* fanObject = cJSON_CreateObject();
+        cJSON_AddItemToArray(fans, fanObject);
+        cJSON_AddStringToObject(fanObject, "name", fan.name);
+        cJSON_AddNumberToObject(fanObject, "dutyChanges", fan.dutyChanges);
+        if (!fan.hasTacho) {
+            continue;
+        }
+        cJSON_AddNumberToObject(fanObject, "edges", fan.edges);
+        cJSON_AddNumberToObject(fanObject, "minRpm", fan.rpmWindows > 0 ? fan.minRpm : 0);
+        cJSON_AddNumberToObject(fanObject, "maxRpm", fan.maxRpm);
+        cJSON_AddNumberToObject(fanObject, "avgRpm", fan.rpmWindows > 0 ? fan.rpmSum / fan.rpmWindows : 0);
+        cJSON_AddNumberToObject(fanObject, "stalls", fan.stalls);
+    }
+
+    // Print the JSON object into the worker's buffer
+    bool printed = cJSON_PrintPreallocated(jsonObject, buffer, bufferSize, false);
+    cJSON_Delete(jsonObject);
+
+    if (!printed) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Replay result does not fit into %zu bytes", bufferSize);
+        return {500, "Content-Type: text/plain\r\n", "Replay result too large\n"};
+    }
+    return {200, "Content-Type: application/json\r\n", buffer};
+}
+
+void WebServer::replyBatchResult(struct mg_connection* connection, BatchResult result) {
+    switch (result) {
+        case BatchResult::Accepted:
+            mg_http_reply(connection, 200, "", "Batch accepted\n");
+            break;
+        case BatchResult::Empty:
+            mg_http_reply(connection, 400, "", "Batch contains no changes\n");
+            break;
+        case BatchResult::UnknownFan:
+            mg_http_reply(connection, 404, "", "Fan not found\n");
+            break;
+        case BatchResult::InvalidValue:
+            mg_http_reply(connection, 400, "", "Invalid value in batch\n");
+            break;
+        case BatchResult::QueueFull:
+            mg_http_reply(connection, 503, "", "Too many pending commands\n");
+            break;
+    }
+}
+
+void WebServer::serveStaticFile(struct mg_connection* connection, struct mg_http_message* http_message, const char* filePath) {
+    HttpRequest request = {
+        .connectionId = connection->id
+    };
+
+    bool queued = _workerPool.submit(request, [this, filePath](const HttpRequest&, char* buffer, size_t bufferSize) {
+        return readStaticFile(filePath, buffer, bufferSize);
+    });
+
+    if (!queued) {
+        ESP_LOGW(TaskConfig::WEB_SERVER_TASK.tag, "Worker queue full, rejecting %s", filePath);
+        mg_http_reply(connection, 503, "Retry-After: 1\r\n", "Server busy\n");
+        return;
+    }
+
+    // Hold back pipelined requests on this connection until the worker has answered
+    connection->is_resp = 1;
+}
+
+HttpResponse WebServer::readStaticFile(const char* filePath, char* buffer, size_t bufferSize) {
+    FILE* file = fopen(filePath, "rb");
+    if (!file) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to open file: %s", filePath);
+        return {404, "Content-Type: text/plain\r\n", "File read error\n"};
+    }
+
     // Get the file size
     fseek(file, 0, SEEK_END);
     size_t size = ftell(file);
     fseek(file, 0, SEEK_SET);
 
-    // Read file contents into a buffer
-    char* buffer = new char[size + 1];  // Allocate space for null-terminator
+    if (size > bufferSize) {
+        fclose(file);
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "%s has %zu bytes, the buffer only %zu", filePath, size, bufferSize);
+        return {500, "Content-Type: text/plain\r\n", "File too large\n"};
+    }
+
+    // Read file contents into the worker's buffer
     size_t bytesRead = fread(buffer, 1, size, file);
-    buffer[bytesRead] = '\0';  // Null-terminate the buffer
+    fclose(file);
 
     if (bytesRead != size) {
         ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Read %zu bytes instead of expected %zu bytes", bytesRead, size);
-        mg_http_reply(connection, 500, "Content-Type: text/plain\r\n", "File read error\n");
-    } else {
-        string headers = "Content-Type: " + string(getMimeType(filePath.c_str())) /*+ "\r\nContent-Length: " + to_string(size)*/ + "\r\n";
-        mg_http_reply(connection, 200, headers.c_str(), buffer, bytesRead);
+        return {500, "Content-Type: text/plain\r\n", "File read error\n"};
+    }
+
+    return {200, getContentTypeHeader(filePath), string_view(buffer, size)};
+}
+
+void WebServer::sendCompletedResponses() {
+    const HttpCompletion* completion;
+    while ((completion = _workerPool.peekCompleted()) != nullptr) {
+        // Look up the connection, the client may have gone away while the job was running
+        struct mg_connection* connection = _mongooseManager.getManager().conns;
+        while (connection != nullptr && connection->id != completion->connectionId) {
+            connection = connection->next;
+        }
+
+        if (connection != nullptr) {
+            const HttpResponse& response = completion->response;
+            mg_http_reply(connection, response.status, response.headers, "%.*s", static_cast<int>(response.body.size()), response.body.data());
+            connection->is_resp = 0;
+            recordLatency(connection);
+        }
+
+        // The body has been copied into the send buffer, the worker may reuse its buffer
+        _workerPool.releaseCompleted();
+    }
+}
+
+void WebServer::recordLatency(struct mg_connection* connection) {
+    const ConnectionState* state = reinterpret_cast<const ConnectionState*>(connection->data);
+    uint32_t latencyUs = static_cast<uint32_t>(esp_timer_get_time() - state->requestStartUs);
+    _latency[static_cast<size_t>(state->route)].record(latencyUs);
+    if (state->isTls) {
+        _tlsRequests.record(latencyUs);
+    }
+    if (PowerManager::isSaving()) {
+        _powerSaveRequests.record(latencyUs);
+    }
+
+    // The first answered request completes the startup sequence
+    if (!BootSequence::isReached(BootStage::FirstHttpResponse)) {
+        BootSequence::markReached(BootStage::FirstHttpResponse);
+        BootSequence::logTimings();
+    }
+}
+
+void WebServer::handleStatsRequest(struct mg_connection* connection, struct mg_http_message* http_message) {
+    static constexpr const char* ROUTE_NAMES[] = {"fan", "fanManager", "fanBatch", "fleet", "trace", "static", "stats", "events", "ota"};
+    static_assert(sizeof(ROUTE_NAMES) / sizeof(ROUTE_NAMES[0]) == static_cast<size_t>(Route::Count));
+
+    // Create a JSON object
+    cJSON* jsonObject = cJSON_CreateObject();
+
+    // Add the latency per route
+    cJSON* latency = cJSON_AddObjectToObject(jsonObject, "latency");
+    for (size_t i = 0; i < static_cast<size_t>(Route::Count); i++) {
+        cJSON* routeObject = cJSON_AddObjectToObject(latency, ROUTE_NAMES[i]);
+        cJSON_AddNumberToObject(routeObject, "count", _latency[i].getCount());
+        cJSON_AddNumberToObject(routeObject, "avgUs", _latency[i].getAverageUs());
+        cJSON_AddNumberToObject(routeObject, "maxUs", _latency[i].getMaxUs());
+        cJSON_AddNumberToObject(routeObject, "lastUs", _latency[i].getLastUs());
+    }
+
+    // Add the delivery latency of fan state notifications
+    cJSON* notify = cJSON_AddObjectToObject(jsonObject, "notify");
+    cJSON_AddNumberToObject(notify, "count", _notifyLatency.getCount());
+    cJSON_AddNumberToObject(notify, "avgUs", _notifyLatency.getAverageUs());
+    cJSON_AddNumberToObject(notify, "maxUs", _notifyLatency.getMaxUs());
+    cJSON_AddNumberToObject(notify, "lastUs", _notifyLatency.getLastUs());
+
+    // Add the worker pool state
+    cJSON* workers = cJSON_AddObjectToObject(jsonObject, "workers");
+    cJSON_AddNumberToObject(workers, "pending", _workerPool.getPendingCount());
+    cJSON_AddNumberToObject(workers, "rejected", _workerPool.getRejectedCount());
+
+    // Add the connection limits and counters
+    cJSON* connections = cJSON_AddObjectToObject(jsonObject, "connections");
+    cJSON_AddNumberToObject(connections, "maxConnections", ServerConfig::MAX_CONNECTIONS);
+    cJSON_AddNumberToObject(connections, "maxRecvBuffer", ServerConfig::MAX_RECV_BUFFER);
+    cJSON_AddNumberToObject(connections, "maxSendBuffer", ServerConfig::MAX_SEND_BUFFER);
+    cJSON_AddNumberToObject(connections, "maxBodySize", ServerConfig::MAX_BODY_SIZE);
+    cJSON_AddNumberToObject(connections, "idleTimeoutMs", ServerConfig::IDLE_TIMEOUT_MS);
+    cJSON_AddNumberToObject(connections, "active", _connections.active);
+    cJSON_AddNumberToObject(connections, "peak", _connections.peak);
+    cJSON_AddNumberToObject(connections, "rejected", _connections.rejected);
+    cJSON_AddNumberToObject(connections, "bodyTooLarge", _connections.bodyTooLarge);
+    cJSON_AddNumberToObject(connections, "recvOverflows", _connections.recvOverflows);
+    cJSON_AddNumberToObject(connections, "sendOverflows", _connections.sendOverflows);
+    cJSON_AddNumberToObject(connections, "idleClosed", _connections.idleClosed);
+
+    // Add the HTTPS handshake costs and how often they were avoided
+    cJSON* tls = cJSON_AddObjectToObject(jsonObject, "tls");
+    cJSON_AddBoolToObject(tls, "enabled", _tlsSessions.isReady());
+    cJSON_AddNumberToObject(tls, "port", ServerConfig::TLS_PORT);
+    cJSON_AddNumberToObject(tls, "maxConnections", ServerConfig::MAX_TLS_CONNECTIONS);
+    cJSON_AddNumberToObject(tls, "active", _connections.tlsActive);
+    cJSON_AddNumberToObject(tls, "rejected", _connections.tlsRejected);
+    cJSON_AddNumberToObject(tls, "keepAliveRequests", _connections.tlsReused);
+    cJSON* fullHandshake = cJSON_AddObjectToObject(tls, "fullHandshake");
+    cJSON_AddNumberToObject(fullHandshake, "count", _fullHandshakes.getCount());
+    cJSON_AddNumberToObject(fullHandshake, "avgUs", _fullHandshakes.getAverageUs());
+    cJSON_AddNumberToObject(fullHandshake, "maxUs", _fullHandshakes.getMaxUs());
+    cJSON_AddNumberToObject(fullHandshake, "lastUs", _fullHandshakes.getLastUs());
+    cJSON* resumedHandshake = cJSON_AddObjectToObject(tls, "resumedHandshake");
+    cJSON_AddNumberToObject(resumedHandshake, "count", _resumedHandshakes.getCount());
+    cJSON_AddNumberToObject(resumedHandshake, "avgUs", _resumedHandshakes.getAverageUs());
+    cJSON_AddNumberToObject(resumedHandshake, "maxUs", _resumedHandshakes.getMaxUs());
+    cJSON_AddNumberToObject(resumedHandshake, "lastUs", _resumedHandshakes.getLastUs());
+    cJSON* tlsRequests = cJSON_AddObjectToObject(tls, "requests");
+    cJSON_AddNumberToObject(tlsRequests, "count", _tlsRequests.getCount());
+    cJSON_AddNumberToObject(tlsRequests, "avgUs", _tlsRequests.getAverageUs());
+    cJSON_AddNumberToObject(tlsRequests, "maxUs", _tlsRequests.getMaxUs());
+    cJSON_AddNumberToObject(tlsRequests, "lastUs", _tlsRequests.getLastUs());
+
+    // Add how much of the resting time the chip slept and what that costs in responsiveness
+    PowerStats powerStats = PowerManager::getStats();
+    cJSON* power = cJSON_AddObjectToObject(jsonObject, "power");
+    cJSON_AddBoolToObject(power, "enabled", powerStats.enabled);
+    cJSON_AddBoolToObject(power, "saving", PowerManager::isSaving());
+    cJSON_AddNumberToObject(power, "minFreqMhz", PowerConfig::MIN_CPU_FREQ_MHZ);
+    cJSON_AddNumberToObject(power, "maxFreqMhz", PowerConfig::MAX_CPU_FREQ_MHZ);
+    cJSON_AddNumberToObject(power, "uptimeMs", static_cast<double>(powerStats.uptimeUs / 1000));
+    cJSON_AddNumberToObject(power, "restingMs", static_cast<double>(powerStats.restingUs / 1000));
+    cJSON_AddNumberToObject(power, "sleepMs", static_cast<double>(powerStats.sleepUs / 1000));
+    cJSON_AddNumberToObject(power, "lightSleeps", powerStats.lightSleeps);
+    cJSON_AddNumberToObject(power, "sleepPercent", powerStats.restingUs > 0 ? 100.0 * powerStats.sleepUs / powerStats.restingUs : 0);
+    cJSON* wakeLatency = cJSON_AddObjectToObject(power, "wakeLatency");
+    cJSON_AddNumberToObject(wakeLatency, "count", _wakeLatency.getCount());
+    cJSON_AddNumberToObject(wakeLatency, "avgUs", _wakeLatency.getAverageUs());
+    cJSON_AddNumberToObject(wakeLatency, "maxUs", _wakeLatency.getMaxUs());
+    cJSON_AddNumberToObject(wakeLatency, "lastUs", _wakeLatency.getLastUs());
+    cJSON* powerSaveRequests = cJSON_AddObjectToObject(power, "requests");
+    cJSON_AddNumberToObject(powerSaveRequests, "count", _powerSaveRequests.getCount());
+    cJSON_AddNumberToObject(powerSaveRequests, "avgUs", _powerSaveRequests.getAverageUs());
+    cJSON_AddNumberToObject(powerSaveRequests, "maxUs", _powerSaveRequests.getMaxUs());
+    cJSON_AddNumberToObject(powerSaveRequests, "lastUs", _powerSaveRequests.getLastUs());
+
+    // Add how many setting changes have been coalesced into how many flash commits
+    cJSON* settings = cJSON_AddObjectToObject(jsonObject, "settings");
+    cJSON_AddNumberToObject(settings, "changes", _fanManager.getSettingsStore().getChangeCount());
+    cJSON_AddNumberToObject(settings, "commits", _fanManager.getSettingsStore().getCommitCount());
+    cJSON_AddNumberToObject(settings, "wearCommits", _fanManager.getWearStore().getCommitCount());
+
+    // Add the Wi-Fi connection metrics
+    WiFiStats wifiStats = _wifiManager.getStats();
+    cJSON* wifi = cJSON_AddObjectToObject(jsonObject, "wifi");
+    cJSON_AddNumberToObject(wifi, "initialConnectMs", wifiStats.initialConnectMs);
+    cJSON_AddNumberToObject(wifi, "lastReconnectMs", wifiStats.lastReconnectMs);
+    cJSON_AddNumberToObject(wifi, "maxReconnectMs", wifiStats.maxReconnectMs);
+    cJSON_AddNumberToObject(wifi, "reconnects", wifiStats.reconnects);
+    cJSON_AddNumberToObject(wifi, "failedAttempts", wifiStats.failedAttempts);
+    cJSON_AddBoolToObject(wifi, "usedCachedAccessPoint", wifiStats.usedCachedAccessPoint);
+
+    // Add the telemetry delivery, a growing queue or drop count means the broker is not keeping up
+    MqttStats mqttStats = _mqttClient.getStats();
+    cJSON* mqtt = cJSON_AddObjectToObject(jsonObject, "mqtt");
+    cJSON_AddBoolToObject(mqtt, "connected", mqttStats.connected);
+    cJSON_AddNumberToObject(mqtt, "connects", mqttStats.connects);
+    cJSON_AddNumberToObject(mqtt, "frames", mqttStats.frames);
+    cJSON_AddNumberToObject(mqtt, "retransmits", mqttStats.retransmits);
+    cJSON_AddNumberToObject(mqtt, "queued", mqttStats.queued);
+    cJSON_AddNumberToObject(mqtt, "dropped", mqttStats.dropped);
+    cJSON_AddNumberToObject(mqtt, "commands", mqttStats.commands);
+    cJSON_AddNumberToObject(mqtt, "rejectedCommands", mqttStats.rejected);
+
+    // Add the size and encoding time of both formats for the current payloads
+    cJSON* encoding = cJSON_AddObjectToObject(jsonObject, "encoding");
+    addEncodingComparison(encoding, "fan",
+        [this]() { return buildFanDataJSON(); },
+        [this](CborWriter& writer) { writeFanDataCbor(writer); });
+    addEncodingComparison(encoding, "fanManager",
+        [this]() { cJSON* object = cJSON_CreateObject(); addFieldsToJSON(object, FAN_MANAGER_FIELDS, _fanManager); return object; },
+        [this](CborWriter& writer) { writeFieldsToCbor(writer, FAN_MANAGER_FIELDS, _fanManager); });
+
+    // Add the time each startup stage was reached, in milliseconds since boot
+    cJSON* boot = cJSON_AddObjectToObject(jsonObject, "boot");
+    for (size_t i = 0; i < static_cast<size_t>(BootStage::Count); i++) {
+        BootStage stage = static_cast<BootStage>(i);
+        cJSON_AddNumberToObject(boot, BootSequence::getStageName(stage), BootSequence::getStageTimeMs(stage));
+    }
+
+    // Add the heap usage, the minimum shows whether the limits keep memory bounded under load
+    // and a shrinking largest block compared to the free size shows fragmentation
+    cJSON* heap = cJSON_AddObjectToObject(jsonObject, "heap");
+    cJSON_AddNumberToObject(heap, "free", esp_get_free_heap_size());
+    cJSON_AddNumberToObject(heap, "minFree", esp_get_minimum_free_heap_size());
+    cJSON_AddNumberToObject(heap, "largestFreeBlock", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    // Add the use of the request arena, overflows went to the heap
+    cJSON* arena = cJSON_AddObjectToObject(jsonObject, "arena");
+    cJSON_AddNumberToObject(arena, "size", ServerConfig::REQUEST_ARENA_SIZE);
+    cJSON_AddNumberToObject(arena, "peakUsed", _arena.getPeakUsed());
+    cJSON_AddNumberToObject(arena, "overflows", _arena.getOverflowCount());
+
+    // Add the stack usage of the long-lived tasks, names repeat for the workers
+    cJSON* tasks = cJSON_AddArrayToObject(jsonObject, "tasks");
+    TaskStackInfo taskInfo;
+    for (size_t i = 0; TaskMonitor::getInfo(i, taskInfo); i++) {
+        cJSON* taskObject = cJSON_CreateObject();
+        cJSON_AddItemToArray(tasks, taskObject);
+        cJSON_AddStringToObject(taskObject, "name", taskInfo.name);
+        cJSON_AddNumberToObject(taskObject, "stackSize", taskInfo.stackSize);
+        cJSON_AddNumberToObject(taskObject, "minFree", taskInfo.minFree);
+        cJSON_AddNumberToObject(taskObject, "peak", taskInfo.stackSize - taskInfo.minFree);
+        cJSON_AddNumberToObject(taskObject, "core", taskInfo.core);
+    }
+
+    // Add the cost of a control tick, which grows with the number of fans
+    const LatencyStats& tickCost = _fanManager.getTickCost();
+    cJSON* control = cJSON_AddObjectToObject(jsonObject, "control");
+    cJSON_AddNumberToObject(control, "fans", _fanManager.getFans().size());
+    cJSON_AddNumberToObject(control, "ticks", tickCost.getCount());
+    cJSON_AddNumberToObject(control, "avgUs", tickCost.getAverageUs());
+    cJSON_AddNumberToObject(control, "maxUs", tickCost.getMaxUs());
+    cJSON_AddNumberToObject(control, "resetReason", esp_reset_reason());
+    cJSON_AddBoolToObject(control, "resumed", _fanManager.wasResumed());
+
+    // Add how late the fan control ticks ran, this must not change with network load
+    const JitterHistogram& jitter = _fanManager.getTickJitter();
+    cJSON* controlJitter = cJSON_AddObjectToObject(jsonObject, "controlJitter");
+    cJSON_AddNumberToObject(controlJitter, "periodMs", FanConfig::CONTROL_TICK_MS);
+    cJSON_AddNumberToObject(controlJitter, "count", jitter.getCount());
+    cJSON_AddNumberToObject(controlJitter, "maxUs", jitter.getMaxUs());
+    cJSON* buckets = cJSON_AddArrayToObject(controlJitter, "buckets");
+    for (size_t i = 0; i < JitterHistogram::BUCKET_COUNT; i++) {
+        cJSON* bucket = cJSON_CreateObject();
+        cJSON_AddItemToArray(buckets, bucket);
+        // The last bucket has no upper bound
+        if (i < JitterHistogram::BUCKET_COUNT - 1) {
+            cJSON_AddNumberToObject(bucket, "leUs", JitterHistogram::BUCKET_LIMITS_US[i]);
+        } else {
+            cJSON_AddNullToObject(bucket, "leUs");
+        }
+        cJSON_AddNumberToObject(bucket, "count", jitter.getBucket(i));
     }
 
+    // Convert the JSON object to a string
+    char* jsonString = cJSON_PrintUnformatted(jsonObject);
+
+    // Send the JSON response
+    mg_http_reply(connection, 200, "Content-Type: application/json\r\n", "%s", jsonString);
+
     // Clean up
-    delete[] buffer;
-    fclose(file);
+    cJSON_Delete(jsonObject);
+    cJSON_free(jsonString);
+}
+
+template<typename BuildJSON, typename WriteCbor>
+void WebServer::addEncodingComparison(cJSON* parent, const char* name, BuildJSON buildJSON, WriteCbor writeCbor) {
+    // Encode exactly what the endpoint would send, JSON including building the tree
+    int64_t startUs = esp_timer_get_time();
+    cJSON* json = buildJSON();
+    char* jsonString = cJSON_PrintUnformatted(json);
+    int64_t jsonUs = esp_timer_get_time() - startUs;
+    size_t jsonBytes = jsonString != nullptr ? strlen(jsonString) : 0;
+    cJSON_Delete(json);
+    cJSON_free(jsonString);
+
+    uint8_t* buffer = static_cast<uint8_t*>(_arena.allocate(ServerConfig::MAX_CBOR_RESPONSE_SIZE));
+    if (buffer == nullptr) {
+        return;
+    }
+    startUs = esp_timer_get_time();
+    CborWriter writer(buffer, ServerConfig::MAX_CBOR_RESPONSE_SIZE);
+    writeCbor(writer);
+    int64_t cborUs = esp_timer_get_time() - startUs;
+
+    cJSON* object = cJSON_AddObjectToObject(parent, name);
+    cJSON_AddNumberToObject(object, "jsonBytes", jsonBytes);
+    cJSON_AddNumberToObject(object, "jsonUs", jsonUs);
+    cJSON_AddNumberToObject(object, "cborBytes", writer.hasOverflowed() ? 0 : writer.getLength());
+    cJSON_AddNumberToObject(object, "cborUs", cborUs);
 }
 
 bool WebServer::getQueryParam(const struct mg_http_message* http_message, const char* key, char* value, size_t valueSize) {
@@ -256,11 +1561,11 @@ bool WebServer::getJSONParam(const struct mg_http_message* http_message, const c
     return true;
 }
 
-const char* WebServer::getMimeType(string_view path) {
+const char* WebServer::getContentTypeHeader(string_view path) {
     // Determine the MIME type based on the file extension
-    if (path.ends_with(".js")) return "application/javascript";
-    if (path.ends_with(".css")) return "text/css";
-    if (path.ends_with(".html")) return "text/html";
-    return "text/plain";
+    if (path.ends_with(".js")) return "Content-Type: application/javascript\r\n";
+    if (path.ends_with(".css")) return "Content-Type: text/css\r\n";
+    if (path.ends_with(".html")) return "Content-Type: text/html\r\n";
+    return "Content-Type: text/plain\r\n";
 }
 
@@ -0,0 +1,152 @@
+#include "Network/tls_session_manager.hpp"
+
+#include <cstdio>
+
+#include "esp_log.h"
+#include "esp_random.h"
+
+mbedtls_x509_crt TlsSessionManager::_cert;
+mbedtls_pk_context TlsSessionManager::_key;
+mbedtls_ssl_ticket_context TlsSessionManager::_tickets;
+#ifdef MBEDTLS_SSL_CACHE_C
+mbedtls_ssl_cache_context TlsSessionManager::_cache;
+#endif
+
+bool TlsSessionManager::init() {
+    // HTTPS is optional, without credentials only plain HTTP is served
+    string cert;
+    string key;
+    if (!readPem(ServerConfig::TLS_CERT_PATH, cert) || !readPem(ServerConfig::TLS_KEY_PATH, key)) {
+        ESP_LOGI(TaskConfig::WEB_SERVER_TASK.tag, "No TLS certificate on SPIFFS, HTTPS disabled");
+        return false;
+    }
+
+    // The PEM text is only needed for parsing and is released when init() returns
+    if (!parseCredentials(cert, key)) {
+        return false;
+    }
+
+    mbedtls_ssl_ticket_init(&_tickets);
+    int result = mbedtls_ssl_ticket_setup(&_tickets, random_bytes, nullptr, MBEDTLS_CIPHER_AES_128_GCM,
+                                          ServerConfig::TLS_SESSION_LIFETIME_S);
+    if (result != 0) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to set up session tickets: -0x%04x", -result);
+        return false;
+    }
+
+#ifdef MBEDTLS_SSL_CACHE_C
+    mbedtls_ssl_cache_init(&_cache);
+    mbedtls_ssl_cache_set_max_entries(&_cache, ServerConfig::TLS_SESSION_CACHE_SIZE);
+    mbedtls_ssl_cache_set_timeout(&_cache, ServerConfig::TLS_SESSION_LIFETIME_S);
+#endif
+
+    _ready = true;
+    return true;
+}
+
+bool TlsSessionManager::isReady() const {
+    return _ready;
+}
+
+void TlsSessionManager::attach(struct mg_connection* connection, bool* resumed) {
+    // Without credentials in the options Mongoose parses nothing and leaves its own certificate
+    // and key empty, so freeing the connection never touches the shared ones
+    struct mg_tls_opts options = {};
+    mg_tls_init(connection, &options);
+    if (connection->tls == nullptr) {
+        return;
+    }
+
+    // The handshake has not started yet, so the changed configuration is still picked up.
+    // Mongoose sets up its own ticket handling, ours also tells which handshakes were resumed.
+    mbedtls_ssl_config* config = &static_cast<struct mg_tls*>(connection->tls)->conf;
+    int result = mbedtls_ssl_conf_own_cert(config, &_cert, &_key);
+    if (result != 0) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Failed to set the certificate: -0x%04x", -result);
+        mg_error(connection, "TLS setup failed");
+        return;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(config, ticket_write, ticket_parse, resumed);
+#ifdef MBEDTLS_SSL_CACHE_C
+    mbedtls_ssl_conf_session_cache(config, resumed, cache_get, cache_set);
+#endif
+}
+
+bool TlsSessionManager::readPem(const char* path, string& pem) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0 || size > static_cast<long>(ServerConfig::MAX_PEM_SIZE)) {
+        fclose(file);
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "%s has an invalid size of %ld bytes", path, size);
+        return false;
+    }
+
+    pem.resize(size);
+    size_t bytesRead = fread(pem.data(), 1, size, file);
+    fclose(file);
+    return bytesRead == static_cast<size_t>(size);
+}
+
+bool TlsSessionManager::parseCredentials(const string& cert, const string& key) {
+    mbedtls_x509_crt_init(&_cert);
+    mbedtls_pk_init(&_key);
+
+    // PEM input is parsed including its terminating null character
+    int result = mbedtls_x509_crt_parse(&_cert, reinterpret_cast<const unsigned char*>(cert.c_str()), cert.size() + 1);
+    if (result != 0) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Invalid TLS certificate: -0x%04x", -result);
+        mbedtls_x509_crt_free(&_cert);
+        return false;
+    }
+
+    result = mbedtls_pk_parse_key(&_key, reinterpret_cast<const unsigned char*>(key.c_str()), key.size() + 1, nullptr, 0,
+                                  random_bytes, nullptr);
+    if (result == 0) {
+        result = mbedtls_pk_check_pair(&_cert.pk, &_key, random_bytes, nullptr);
+    }
+    if (result != 0) {
+        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Invalid TLS key: -0x%04x", -result);
+        mbedtls_x509_crt_free(&_cert);
+        mbedtls_pk_free(&_key);
+        return false;
+    }
+    return true;
+}
+
+int TlsSessionManager::random_bytes(void* context, unsigned char* output, size_t length) {
+    esp_fill_random(output, length);
+    return 0;
+}
+
+int TlsSessionManager::ticket_write(void* resumed, const mbedtls_ssl_session* session, unsigned char* start,
+                                    const unsigned char* end, size_t* length, uint32_t* lifetime) {
+    return mbedtls_ssl_ticket_write(&_tickets, session, start, end, length, lifetime);
+}
+
+int TlsSessionManager::ticket_parse(void* resumed, mbedtls_ssl_session* session, unsigned char* buffer, size_t length) {
+    int result = mbedtls_ssl_ticket_parse(&_tickets, session, buffer, length);
+    if (result == 0) {
+        *static_cast<bool*>(resumed) = true;
+    }
+    return result;
+}
+
+#ifdef MBEDTLS_SSL_CACHE_C
+int TlsSessionManager::cache_get(void* resumed, const unsigned char* id, size_t idLength, mbedtls_ssl_session* session) {
+    int result = mbedtls_ssl_cache_get(&_cache, id, idLength, session);
+    if (result == 0) {
+        *static_cast<bool*>(resumed) = true;
+    }
+    return result;
+}
+
+int TlsSessionManager::cache_set(void* resumed, const unsigned char* id, size_t idLength, const mbedtls_ssl_session* session) {
+    return mbedtls_ssl_cache_set(&_cache, id, idLength, session);
+}
+#endif
@@ -1,8 +1,15 @@
 #include "Network/wifi_manager.hpp"
 
-int WiFiManager::retry_count = 0;
+#include <algorithm>
+
+#include "esp_random.h"
+#include "nvs.h"
+
+#include "System/boot_sequence.hpp"
 
 void WiFiManager::init() {
+    _initUs = esp_timer_get_time();
+
     // Initialize network interface
     esp_netif_init();
     esp_event_loop_create_default();
@@ -14,24 +21,43 @@ void WiFiManager::init() {
     wifi_init_config_t wifiConfig = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&wifiConfig));
 
+    // Reconnect attempts are scheduled by a timer instead of blocking the event loop
+    esp_timer_create_args_t timerArgs = {
+        .callback = retry_timer_callback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_retry",
+        .skip_unhandled_events = true
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &_retryTimer));
+
+    // NVS is written on the timer task as well, never on the event loop
+    esp_timer_create_args_t cacheTimerArgs = {
+        .callback = cache_timer_callback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_cache",
+        .skip_unhandled_events = true
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&cacheTimerArgs, &_cacheTimer));
+
     // Register event handlers for WiFi and IP events
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, this, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, this, NULL));
 
-    wifi_config_t wifi_config = {};
-    // Copy SSID and Password from the configuration
-    strncpy((char*)wifi_config.sta.ssid, Network::WIFI_SSID, sizeof(wifi_config.sta.ssid) - 1);
-    strncpy((char*)wifi_config.sta.password, Network::WIFI_PASS, sizeof(wifi_config.sta.password) - 1);
-    // Ensure the strings are null-terminated
-    wifi_config.sta.ssid[sizeof(wifi_config.sta.ssid) - 1] = '\0';
-    wifi_config.sta.password[sizeof(wifi_config.sta.password) - 1] = '\0';
+    // Connect straight to the last known access point if there is one
+    _useCachedAccessPoint = loadCachedAccessPoint();
 
     // Set WiFi mode to station (STA) and configure WiFi
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    applyStationConfig();
     ESP_ERROR_CHECK(esp_wifi_start());
 
+    // The radio sleeps between beacons and wakes for every DTIM to fetch what the access point buffered
+    ESP_ERROR_CHECK(esp_wifi_set_ps(PowerConfig::ENABLED ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE));
+
     // Connect to the WiFi network
+    _state = WiFiState::Connecting;
     ESP_ERROR_CHECK(esp_wifi_connect());
 
     // Setup static IP configuration
@@ -45,24 +71,218 @@ void WiFiManager::init() {
     ESP_ERROR_CHECK(esp_netif_set_ip_info(wifi_sta_netif, &static_ip_info));
 }
 
+WiFiState WiFiManager::getState() const {
+    return _state;
+}
+
+WiFiStats WiFiManager::getStats() const {
+    return _stats;
+}
+
+void WiFiManager::applyStationConfig() {
+    portENTER_CRITICAL(&_cacheLock);
+    bool useCachedAccessPoint = _useCachedAccessPoint;
+    CachedAccessPoint accessPoint = _cachedAccessPoint;
+    portEXIT_CRITICAL(&_cacheLock);
+
+    // The driver stores its configuration in flash, so an unchanged one is not written again
+    if (_configApplied && useCachedAccessPoint == _configUsesCachedAccessPoint &&
+        (!useCachedAccessPoint || memcmp(&accessPoint, &_configAccessPoint, sizeof(accessPoint)) == 0)) {
+        return;
+    }
+
+    wifi_config_t wifi_config = {};
+    // Copy SSID and Password from the configuration
+    strncpy((char*)wifi_config.sta.ssid, Network::WIFI_SSID, sizeof(wifi_config.sta.ssid) - 1);
+    strncpy((char*)wifi_config.sta.password, Network::WIFI_PASS, sizeof(wifi_config.sta.password) - 1);
+    // Ensure the strings are null-terminated
+    wifi_config.sta.ssid[sizeof(wifi_config.sta.ssid) - 1] = '\0';
+    wifi_config.sta.password[sizeof(wifi_config.sta.password) - 1] = '\0';
+
+    if (useCachedAccessPoint) {
+        // Only probe the cached channel and lock onto the cached BSSID
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, accessPoint.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = accessPoint.channel;
+    } else {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TaskConfig::WIFI_TASK.tag, "Failed to apply the station configuration: %s", esp_err_to_name(err));
+        return;
+    }
+    _configApplied = true;
+    _configUsesCachedAccessPoint = useCachedAccessPoint;
+    _configAccessPoint = accessPoint;
+}
+
 void WiFiManager::wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    WiFiManager* manager = static_cast<WiFiManager*>(arg);
+
     // Handle different WiFi and IP events
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Connecting...");
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
-        // Reset retry count
-        retry_count = 0;
-        ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Connected");
+        manager->onConnected(static_cast<wifi_event_sta_connected_t*>(event_data));
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        manager->onGotIP();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        retry_count++;
-        int delay_time = (1 << retry_count) * 1000;
-        delay_time = delay_time > 30000 ? 30000 : delay_time; // Max. 30s
-        
-        ESP_LOGW(TaskConfig::WIFI_TASK.tag, "Disconnected. Retrying...");
-        vTaskDelay(delay_time / portTICK_PERIOD_MS);
-        esp_wifi_connect();
+        manager->onDisconnected();
     }
 }
+
+void WiFiManager::retry_timer_callback(void* arg) {
+    WiFiManager* manager = static_cast<WiFiManager*>(arg);
+    manager->_state = WiFiState::Connecting;
+
+    // A dropped or newly learned access point takes effect with this attempt
+    manager->applyStationConfig();
+    esp_wifi_connect();
+}
+
+void WiFiManager::cache_timer_callback(void* arg) {
+    static_cast<WiFiManager*>(arg)->storeCachedAccessPoint();
+}
+
+void WiFiManager::onConnected(const wifi_event_sta_connected_t* event) {
+    // Reset retry count
+    _retryCount = 0;
+    _stats.usedCachedAccessPoint = _configUsesCachedAccessPoint;
+    ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Connected (channel %d)", event->channel);
+
+    // Remember the access point so the next connect can skip the scan, also after a full scan
+    portENTER_CRITICAL(&_cacheLock);
+    bool changed = memcmp(_cachedAccessPoint.bssid, event->bssid, sizeof(_cachedAccessPoint.bssid)) != 0
+                || _cachedAccessPoint.channel != event->channel;
+    memcpy(_cachedAccessPoint.bssid, event->bssid, sizeof(_cachedAccessPoint.bssid));
+    _cachedAccessPoint.channel = event->channel;
+    _useCachedAccessPoint = true;
+    portEXIT_CRITICAL(&_cacheLock);
+
+    if (changed) {
+        requestCacheWrite();
+    }
+}
+
+void WiFiManager::onGotIP() {
+    _state = WiFiState::Connected;
+    BootSequence::markReached(BootStage::IpReady);
+    int64_t now = esp_timer_get_time();
+
+    if (_stats.initialConnectMs == 0) {
+        _stats.initialConnectMs = static_cast<uint32_t>((now - _initUs) / 1000);
+        ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Initial connect took %lu ms", static_cast<unsigned long>(_stats.initialConnectMs));
+    }
+
+    if (_disconnectedUs != 0) {
+        _stats.lastReconnectMs = static_cast<uint32_t>((now - _disconnectedUs) / 1000);
+        if (_stats.lastReconnectMs > _stats.maxReconnectMs) {
+            _stats.maxReconnectMs = _stats.lastReconnectMs;
+        }
+        _stats.reconnects++;
+        _disconnectedUs = 0;
+        ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Reconnect took %lu ms", static_cast<unsigned long>(_stats.lastReconnectMs));
+    }
+}
+
+void WiFiManager::onDisconnected() {
+    if (_disconnectedUs == 0) {
+        _disconnectedUs = esp_timer_get_time();
+    }
+    _stats.failedAttempts++;
+
+    if (_retryCount < UINT8_MAX) {
+        _retryCount++;
+    }
+
+    // The access point may have moved to another channel or been replaced, scan again
+    if (_useCachedAccessPoint && _retryCount >= Network::CACHED_AP_MAX_FAILURES) {
+        ESP_LOGW(TaskConfig::WIFI_TASK.tag, "Cached access point unreachable, falling back to full scan");
+        dropCachedAccessPoint();
+    }
+
+    uint32_t delayMs = nextRetryDelayMs();
+    ESP_LOGW(TaskConfig::WIFI_TASK.tag, "Disconnected. Retrying in %lu ms...", static_cast<unsigned long>(delayMs));
+
+    _state = WiFiState::WaitingToRetry;
+    esp_timer_stop(_retryTimer);
+    esp_timer_start_once(_retryTimer, static_cast<uint64_t>(delayMs) * 1000);
+}
+
+uint32_t WiFiManager::nextRetryDelayMs() const {
+    // Cap the exponent so the shift can never overflow, however long the outage lasts
+    uint8_t exponent = _retryCount > 0 ? _retryCount - 1 : 0;
+    uint32_t delayMs = Network::RECONNECT_MAX_DELAY_MS;
+    if (exponent < 16) {
+        delayMs = min<uint32_t>(Network::RECONNECT_BASE_DELAY_MS << exponent, Network::RECONNECT_MAX_DELAY_MS);
+    }
+
+    // Spread the delay by +/- RECONNECT_JITTER_PERCENT
+    uint32_t jitterRange = delayMs * Network::RECONNECT_JITTER_PERCENT / 100;
+    if (jitterRange > 0) {
+        delayMs = delayMs - jitterRange + esp_random() % (2 * jitterRange + 1);
+    }
+
+    return delayMs;
+}
+
+bool WiFiManager::loadCachedAccessPoint() {
+    nvs_handle_t handle;
+    if (nvs_open(Network::WIFI_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t size = sizeof(_cachedAccessPoint);
+    esp_err_t err = nvs_get_blob(handle, Network::WIFI_NVS_AP_KEY, &_cachedAccessPoint, &size);
+    nvs_close(handle);
+
+    if (err != ESP_OK || size != sizeof(_cachedAccessPoint)) {
+        _cachedAccessPoint = {};
+        return false;
+    }
+
+    ESP_LOGI(TaskConfig::WIFI_TASK.tag, "Using cached access point on channel %d", _cachedAccessPoint.channel);
+    return true;
+}
+
+void WiFiManager::storeCachedAccessPoint() {
+    portENTER_CRITICAL(&_cacheLock);
+    bool valid = _useCachedAccessPoint;
+    CachedAccessPoint accessPoint = _cachedAccessPoint;
+    portEXIT_CRITICAL(&_cacheLock);
+
+    nvs_handle_t handle;
+    if (nvs_open(Network::WIFI_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGE(TaskConfig::WIFI_TASK.tag, "Failed to open NVS for the access point cache");
+        return;
+    }
+
+    esp_err_t err = valid ? nvs_set_blob(handle, Network::WIFI_NVS_AP_KEY, &accessPoint, sizeof(accessPoint))
+                          : nvs_erase_key(handle, Network::WIFI_NVS_AP_KEY);
+    if ((err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) || nvs_commit(handle) != ESP_OK) {
+        ESP_LOGE(TaskConfig::WIFI_TASK.tag, "Failed to store the access point cache");
+    }
+    nvs_close(handle);
+}
+
+void WiFiManager::requestCacheWrite() {
+    // A write that is already pending picks up the latest state as well
+    esp_timer_stop(_cacheTimer);
+    esp_timer_start_once(_cacheTimer, 0);
+}
+
+void WiFiManager::dropCachedAccessPoint() {
+    // The retry timer applies the scanning configuration before the next attempt
+    portENTER_CRITICAL(&_cacheLock);
+    _useCachedAccessPoint = false;
+    _cachedAccessPoint = {};
+    portEXIT_CRITICAL(&_cacheLock);
+
+    requestCacheWrite();
+}
@@ -0,0 +1,144 @@
+#include "Network/worker_pool.hpp"
+
+#include "esp_log.h"
+
+WorkerPool::Worker WorkerPool::_workers[ServerConfig::WORKER_COUNT] = {};
+
+WorkerPool::WorkerPool(function<void()> notify)
+    : _notify(notify),
+      _completedMutex(nullptr),
+      _exited(nullptr),
+      _completedHead(0),
+      _completedCount(0),
+      _rejected(0),
+      _pending(0) {}
+
+void WorkerPool::start() {
+    _completedMutex = xSemaphoreCreateMutexStatic(&_completedMutexBuffer);
+    _exited = xSemaphoreCreateCountingStatic(ServerConfig::WORKER_COUNT, 0, &_exitedBuffer);
+
+    for (auto& worker : _workers) {
+        worker.pool = this;
+        worker.nextJob = 0;
+        worker.queue = worker.queueStorage.create();
+        worker.bufferFree = xSemaphoreCreateBinaryStatic(&worker.bufferFreeStorage);
+        xSemaphoreGive(worker.bufferFree);
+        worker.task.create(workerTask, TaskConfig::HTTP_WORKER_TASK, &worker);
+    }
+}
+
+void WorkerPool::stop() {
+    // A null job tells a worker to exit once everything queued before it is done
+    for (auto& worker : _workers) {
+        Job* stopJob = nullptr;
+        xQueueSend(worker.queue, &stopJob, portMAX_DELAY);
+    }
+
+    // Nothing is sent any more, but a worker only runs its next job once its last response is
+    // released, so keep discarding completions until every worker has exited
+    size_t exited = 0;
+    while (exited < ServerConfig::WORKER_COUNT) {
+        while (peekCompleted() != nullptr) {
+            releaseCompleted();
+        }
+        if (xSemaphoreTake(_exited, 1) == pdTRUE) {
+            exited++;
+        }
+    }
+
+    // Let the idle task clean up the deleted workers before their storage can be reused
+    vTaskDelay(1);
+
+    for (auto& worker : _workers) {
+        vQueueDelete(worker.queue);
+        vSemaphoreDelete(worker.bufferFree);
+        worker.queue = nullptr;
+        worker.bufferFree = nullptr;
+    }
+
+    _completedHead = 0;
+    _completedCount = 0;
+    _pending = 0;
+}
+
+bool WorkerPool::submit(const HttpRequest& request, HttpJob job) {
+    // Jobs of the same connection always go to the same worker to keep their order
+    Worker& worker = _workers[request.connectionId % ServerConfig::WORKER_COUNT];
+
+    // Only the event loop submits, so a free queue entry cannot be taken before the send below
+    if (uxQueueSpacesAvailable(worker.queue) == 0) {
+        _rejected++;
+        return false;
+    }
+
+    Job* queued = &worker.jobs[worker.nextJob++ % JOB_SLOTS];
+    *queued = Job{request, move(job)};
+    xQueueSend(worker.queue, &queued, 0);
+
+    _pending++;
+    return true;
+}
+
+const HttpCompletion* WorkerPool::peekCompleted() {
+    // Workers only append, so the oldest entry stays in place until it is released
+    xSemaphoreTake(_completedMutex, portMAX_DELAY);
+    const HttpCompletion* completion = _completedCount > 0 ? &_completed[_completedHead] : nullptr;
+    xSemaphoreGive(_completedMutex);
+    return completion;
+}
+
+void WorkerPool::releaseCompleted() {
+    xSemaphoreTake(_completedMutex, portMAX_DELAY);
+    size_t worker = _completed[_completedHead].worker;
+    _completedHead = (_completedHead + 1) % COMPLETION_SLOTS;
+    _completedCount--;
+    _pending--;
+    xSemaphoreGive(_completedMutex);
+
+    xSemaphoreGive(_workers[worker].bufferFree);
+}
+
+uint32_t WorkerPool::getRejectedCount() const {
+    return _rejected;
+}
+
+uint32_t WorkerPool::getPendingCount() const {
+    return _pending;
+}
+
+void WorkerPool::workerTask(void* arg) {
+    Worker* worker = static_cast<Worker*>(arg);
+    WorkerPool* pool = worker->pool;
+
+    while (true) {
+        Job* job = nullptr;
+        if (xQueueReceive(worker->queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        if (job == nullptr) {
+            TaskMonitor::remove(xTaskGetCurrentTaskHandle());
+            xSemaphoreGive(pool->_exited);
+            vTaskDelete(nullptr);
+        }
+
+        // The buffer holds the previous response until the event loop has sent it
+        xSemaphoreTake(worker->bufferFree, portMAX_DELAY);
+
+        HttpCompletion completion = {
+            .connectionId = job->request.connectionId,
+            .worker = static_cast<size_t>(worker - _workers),
+            .response = job->handler(job->request, worker->buffer, sizeof(worker->buffer))
+        };
+
+        // Release what the handler captured, the slot itself is reused later
+        job->handler = nullptr;
+
+        xSemaphoreTake(pool->_completedMutex, portMAX_DELAY);
+        pool->_completed[(pool->_completedHead + pool->_completedCount) % COMPLETION_SLOTS] = completion;
+        pool->_completedCount++;
+        xSemaphoreGive(pool->_completedMutex);
+
+        pool->_notify();
+    }
+}
@@ -0,0 +1,63 @@
+#include "Ota/esp_ota_backend.hpp"
+
+#include "esp_log.h"
+
+#include "config.hpp"
+
+bool EspOtaBackend::begin(size_t imageSize) {
+    _partition = esp_ota_get_next_update_partition(nullptr);
+    if (_partition == nullptr) {
+        ESP_LOGE(OtaConfig::TAG, "No OTA partition available");
+        return false;
+    }
+
+    if (imageSize > _partition->size) {
+        ESP_LOGE(OtaConfig::TAG, "Image of %u bytes does not fit into partition %s", static_cast<unsigned>(imageSize), _partition->label);
+        return false;
+    }
+
+    // Erase sectors as they are written instead of erasing the whole partition up front
+    esp_err_t err = esp_ota_begin(_partition, OTA_WITH_SEQUENTIAL_WRITES, &_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(OtaConfig::TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    ESP_LOGI(OtaConfig::TAG, "Writing %u bytes to partition %s", static_cast<unsigned>(imageSize), _partition->label);
+    return true;
+}
+
+bool EspOtaBackend::write(const uint8_t* data, size_t length) {
+    esp_err_t err = esp_ota_write(_handle, data, length);
+    if (err != ESP_OK) {
+        ESP_LOGE(OtaConfig::TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool EspOtaBackend::finish() {
+    esp_err_t err = esp_ota_end(_handle);
+    _handle = 0;
+    if (err != ESP_OK) {
+        ESP_LOGE(OtaConfig::TAG, "Image validation failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool EspOtaBackend::activate() {
+    esp_err_t err = esp_ota_set_boot_partition(_partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(OtaConfig::TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void EspOtaBackend::abort() {
+    if (_handle != 0) {
+        esp_ota_abort(_handle);
+        _handle = 0;
+    }
+}
@@ -0,0 +1,45 @@
+#include "Ota/ota_health_check.hpp"
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+#include "System/boot_sequence.hpp"
+#include "config.hpp"
+
+void OtaHealthCheck::start() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return;
+    }
+
+    ESP_LOGW(OtaConfig::TAG, "Firmware in %s is pending verification", running->label);
+    xTaskCreatePinnedToCore(healthCheckTask, TaskConfig::OTA_HEALTH_TASK.tag, TaskConfig::OTA_HEALTH_TASK.stackSize, nullptr, TaskConfig::OTA_HEALTH_TASK.priority, nullptr, TaskConfig::OTA_HEALTH_TASK.core);
+}
+
+void OtaHealthCheck::healthCheckTask(void* pvParameters) {
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(OtaConfig::HEALTH_CHECK_TIMEOUT_MS);
+
+    // Only what the image controls itself is checked: the fan cycle runs and the web server task
+    // has opened its listener. The IP depends on the access point, which may be down at the time.
+    bool healthy = true;
+    for (BootStage stage : {BootStage::FirstAirflow, BootStage::ServerReady}) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t remaining = deadline > now ? deadline - now : 0;
+        if (!BootSequence::waitFor(stage, remaining)) {
+            ESP_LOGE(OtaConfig::TAG, "Health check failed: %s not reached", BootSequence::getStageName(stage));
+            healthy = false;
+            break;
+        }
+    }
+
+    if (healthy) {
+        ESP_LOGI(OtaConfig::TAG, "Health check passed, firmware confirmed");
+        esp_ota_mark_app_valid_cancel_rollback();
+    } else {
+        ESP_LOGE(OtaConfig::TAG, "Rolling back to the previous firmware");
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+
+    vTaskDelete(nullptr);
+}
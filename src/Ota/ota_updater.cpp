@@ -0,0 +1,160 @@
+#include "Ota/ota_updater.hpp"
+
+#include <cstring>
+
+#include "esp_log.h"
+
+#include "config.hpp"
+
+OtaUpdater::OtaUpdater(IOtaBackend& backend)
+    : _backend(backend) {
+    mbedtls_sha256_init(&_sha256);
+}
+
+OtaUpdater::~OtaUpdater() {
+    mbedtls_sha256_free(&_sha256);
+}
+
+bool OtaUpdater::begin(size_t imageSize, const char* expectedSha256, size_t expectedSha256Length) {
+    if (_state == OtaState::Receiving) {
+        ESP_LOGE(OtaConfig::TAG, "Update already in progress");
+        return false;
+    }
+
+    _imageSize = imageSize;
+    _received = 0;
+    _error = "";
+
+    if (imageSize == 0) {
+        fail("Empty image");
+        return false;
+    }
+
+    if (!parseSha256(expectedSha256, expectedSha256Length, _expectedSha256)) {
+        fail("Invalid SHA-256 digest");
+        return false;
+    }
+
+    if (!_backend.begin(imageSize)) {
+        _state = OtaState::Failed;
+        _error = "Backend rejected the update";
+        return false;
+    }
+
+    mbedtls_sha256_starts(&_sha256, 0);
+    _state = OtaState::Receiving;
+    return true;
+}
+
+bool OtaUpdater::write(const uint8_t* data, size_t length) {
+    if (_state != OtaState::Receiving) {
+        return false;
+    }
+
+    if (length > _imageSize - _received) {
+        fail("More data than announced");
+        return false;
+    }
+
+    mbedtls_sha256_update(&_sha256, data, length);
+    if (!_backend.write(data, length)) {
+        fail("Flash write failed");
+        return false;
+    }
+
+    _received += length;
+    return true;
+}
+
+bool OtaUpdater::finish() {
+    if (_state != OtaState::Receiving) {
+        return false;
+    }
+
+    if (!isComplete()) {
+        fail("Image truncated");
+        return false;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&_sha256, digest);
+    if (memcmp(digest, _expectedSha256, sizeof(digest)) != 0) {
+        fail("SHA-256 mismatch");
+        return false;
+    }
+
+    // The backend has already been closed if validation fails, nothing left to abort
+    if (!_backend.finish()) {
+        _state = OtaState::Failed;
+        _error = "Image validation failed";
+        return false;
+    }
+
+    if (!_backend.activate()) {
+        _state = OtaState::Failed;
+        _error = "Could not select boot partition";
+        return false;
+    }
+
+    _state = OtaState::Succeeded;
+    ESP_LOGI(OtaConfig::TAG, "Update of %u bytes verified", static_cast<unsigned>(_received));
+    return true;
+}
+
+void OtaUpdater::abort(const char* reason) {
+    if (_state == OtaState::Receiving) {
+        fail(reason);
+    }
+}
+
+bool OtaUpdater::isComplete() const {
+    return _received == _imageSize;
+}
+
+OtaState OtaUpdater::getState() const {
+    return _state;
+}
+
+size_t OtaUpdater::getReceived() const {
+    return _received;
+}
+
+size_t OtaUpdater::getImageSize() const {
+    return _imageSize;
+}
+
+const char* OtaUpdater::getError() const {
+    return _error;
+}
+
+void OtaUpdater::fail(const char* reason) {
+    ESP_LOGE(OtaConfig::TAG, "Update failed after %u of %u bytes: %s", static_cast<unsigned>(_received), static_cast<unsigned>(_imageSize), reason);
+    if (_state == OtaState::Receiving) {
+        _backend.abort();
+    }
+    _state = OtaState::Failed;
+    _error = reason;
+}
+
+bool OtaUpdater::parseSha256(const char* hex, size_t length, uint8_t* digest) {
+    if (hex == nullptr || length != 64) {
+        return false;
+    }
+
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    for (size_t i = 0; i < 32; i++) {
+        int high = nibble(hex[2 * i]);
+        int low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        digest[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
@@ -0,0 +1,174 @@
+#include "Ota/ota_writer.hpp"
+
+#include <cstring>
+
+StaticTask<TaskConfig::OTA_WRITER_TASK.stackSize> OtaWriter::_task;
+uint8_t OtaWriter::_chunks[OtaConfig::QUEUE_CHUNKS][OtaConfig::CHUNK_SIZE];
+
+static_assert(OtaConfig::CHUNK_SIZE <= UINT16_MAX, "Chunk lengths are queued as 16 bit values");
+
+OtaWriter::OtaWriter(OtaUpdater& updater, function<void()> notify)
+    : _updater(updater),
+      _notify(notify) {}
+
+void OtaWriter::start() {
+    _queue = _queueStorage.create();
+    _exited = xSemaphoreCreateBinaryStatic(&_exitedBuffer);
+    _task.create(writerTask, TaskConfig::OTA_WRITER_TASK, this);
+}
+
+void OtaWriter::stop() {
+    if (_queue == nullptr) {
+        return;
+    }
+
+    if (_busy && !_ending) {
+        abort("Server stopped");
+    }
+
+    // The stop command may have to wait for the task to take a chunk
+    Command command = {CommandType::Stop, 0, nullptr, nullptr};
+    xQueueSend(_queue, &command, portMAX_DELAY);
+    xSemaphoreTake(_exited, portMAX_DELAY);
+
+    // Let the idle task clean up the deleted task before its storage can be reused
+    vTaskDelay(1);
+
+    vQueueDelete(_queue);
+    _queue = nullptr;
+}
+
+bool OtaWriter::begin(size_t imageSize, const char* expectedSha256, size_t expectedSha256Length) {
+    if (_busy || !_updater.begin(imageSize, expectedSha256, expectedSha256Length)) {
+        return false;
+    }
+
+    _imageSize = imageSize;
+    _taken = 0;
+    _fill = 0;
+    _ending = false;
+    _ended = false;
+    _abortRequested = false;
+    _busy = true;
+    return true;
+}
+
+size_t OtaWriter::write(const uint8_t* data, size_t length) {
+    if (!_busy || _ending) {
+        return 0;
+    }
+
+    // Anything beyond the announced size is not part of the image
+    size_t remaining = _imageSize - _taken;
+    length = length < remaining ? length : remaining;
+
+    size_t taken = 0;
+    while (taken < length && hasFreeChunk()) {
+        size_t copy = OtaConfig::CHUNK_SIZE - _fill;
+        copy = copy < length - taken ? copy : length - taken;
+        memcpy(currentChunk() + _fill, data + taken, copy);
+        _fill += copy;
+        taken += copy;
+
+        if (_fill == OtaConfig::CHUNK_SIZE) {
+            queueChunk();
+        }
+    }
+
+    _taken += taken;
+    return taken;
+}
+
+void OtaWriter::finish() {
+    if (!_busy || _ending) {
+        return;
+    }
+
+    // The last chunk is usually partial; its buffer was free when filling began, so it fits the queue
+    if (_fill > 0) {
+        queueChunk();
+    }
+
+    Command command = {CommandType::Finish, 0, nullptr, nullptr};
+    xQueueSend(_queue, &command, 0);
+    _ending = true;
+}
+
+void OtaWriter::abort(const char* reason) {
+    if (!_busy || _ending) {
+        return;
+    }
+
+    // The queue always keeps room for the command that ends the update
+    _abortRequested = true;
+    Command command = {CommandType::Abort, 0, nullptr, reason};
+    xQueueSend(_queue, &command, 0);
+    _ending = true;
+}
+
+bool OtaWriter::isBusy() const {
+    return _busy;
+}
+
+bool OtaWriter::isComplete() const {
+    return _taken == _imageSize;
+}
+
+bool OtaWriter::takeOutcome() {
+    if (!_busy || !_ended) {
+        return false;
+    }
+    _busy = false;
+    return true;
+}
+
+uint8_t* OtaWriter::currentChunk() const {
+    return _chunks[_chunksQueued % OtaConfig::QUEUE_CHUNKS];
+}
+
+bool OtaWriter::hasFreeChunk() const {
+    return _chunksQueued - _chunksWritten < OtaConfig::QUEUE_CHUNKS;
+}
+
+void OtaWriter::queueChunk() {
+    Command command = {CommandType::Write, static_cast<uint16_t>(_fill), currentChunk(), nullptr};
+    xQueueSend(_queue, &command, 0);
+    _chunksQueued++;
+    _fill = 0;
+}
+
+void OtaWriter::writerTask(void* arg) {
+    OtaWriter* writer = static_cast<OtaWriter*>(arg);
+
+    while (true) {
+        Command command;
+        if (xQueueReceive(writer->_queue, &command, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        switch (command.type) {
+        case CommandType::Write:
+            // Chunks queued before an abort are skipped, after a failed write the updater rejects them itself
+            if (!writer->_abortRequested) {
+                writer->_updater.write(command.data, command.length);
+            }
+            writer->_chunksWritten++;
+            break;
+        case CommandType::Finish:
+            writer->_updater.finish();
+            writer->_ended = true;
+            break;
+        case CommandType::Abort:
+            writer->_updater.abort(command.reason);
+            writer->_ended = true;
+            break;
+        case CommandType::Stop:
+            TaskMonitor::remove(xTaskGetCurrentTaskHandle());
+            xSemaphoreGive(writer->_exited);
+            vTaskDelete(nullptr);
+            break;
+        }
+
+        writer->_notify();
+    }
+}
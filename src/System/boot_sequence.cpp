@@ -0,0 +1,70 @@
+#include "System/boot_sequence.hpp"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "config.hpp"
+
+EventGroupHandle_t BootSequence::_stages = nullptr;
+StaticEventGroup_t BootSequence::_stagesBuffer;
+int64_t BootSequence::_stageTimesUs[static_cast<size_t>(BootStage::Count)] = {};
+
+static_assert(static_cast<size_t>(BootStage::Count) <= 24, "Event groups only provide 24 usable bits");
+
+void BootSequence::init() {
+    _stages = xEventGroupCreateStatic(&_stagesBuffer);
+}
+
+void BootSequence::markReached(BootStage stage) {
+    // Record the timestamp before publishing the bit so waiters always see it
+    int64_t now = esp_timer_get_time();
+    if (!isReached(stage)) {
+        _stageTimesUs[static_cast<size_t>(stage)] = now;
+        xEventGroupSetBits(_stages, bit(stage));
+        ESP_LOGI(TaskConfig::BOOT_TAG, "%s after %lu ms", getStageName(stage), static_cast<unsigned long>(now / 1000));
+    }
+}
+
+bool BootSequence::isReached(BootStage stage) {
+    return (xEventGroupGetBits(_stages) & bit(stage)) != 0;
+}
+
+bool BootSequence::waitFor(BootStage stage, TickType_t timeout) {
+    EventBits_t bits = xEventGroupWaitBits(_stages, bit(stage), pdFALSE, pdTRUE, timeout);
+    return (bits & bit(stage)) != 0;
+}
+
+uint32_t BootSequence::getStageTimeMs(BootStage stage) {
+    return static_cast<uint32_t>(_stageTimesUs[static_cast<size_t>(stage)] / 1000);
+}
+
+const char* BootSequence::getStageName(BootStage stage) {
+    static constexpr const char* STAGE_NAMES[] = {
+        "nvsReady",
+        "spiffsReady",
+        "fansReady",
+        "firstAirflow",
+        "wifiStarted",
+        "ipReady",
+        "serverReady",
+        "firstHttpResponse"
+    };
+    static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == static_cast<size_t>(BootStage::Count));
+
+    return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+void BootSequence::logTimings() {
+    for (size_t i = 0; i < static_cast<size_t>(BootStage::Count); i++) {
+        BootStage stage = static_cast<BootStage>(i);
+        if (isReached(stage)) {
+            ESP_LOGI(TaskConfig::BOOT_TAG, "%-18s %6lu ms", getStageName(stage), static_cast<unsigned long>(getStageTimeMs(stage)));
+        } else {
+            ESP_LOGI(TaskConfig::BOOT_TAG, "%-18s pending", getStageName(stage));
+        }
+    }
+}
+
+EventBits_t BootSequence::bit(BootStage stage) {
+    return static_cast<EventBits_t>(1) << static_cast<uint8_t>(stage);
+}
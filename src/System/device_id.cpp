@@ -0,0 +1,18 @@
+#include "System/device_id.hpp"
+
+#include <cstdint>
+#include <cstdio>
+
+#include "esp_mac.h"
+
+char DeviceId::_id[7] = {};
+
+const char* DeviceId::get() {
+    // The MAC is fixed, so it is read once
+    if (_id[0] == '\0') {
+        uint8_t mac[6];
+        esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        snprintf(_id, sizeof(_id), "%02x%02x%02x", mac[3], mac[4], mac[5]);
+    }
+    return _id;
+}
@@ -0,0 +1,26 @@
+#include "System/jitter_histogram.hpp"
+
+void JitterHistogram::record(uint32_t latenessUs) {
+    size_t bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && latenessUs > BUCKET_LIMITS_US[bucket]) {
+        bucket++;
+    }
+
+    _buckets[bucket]++;
+    _count++;
+    if (latenessUs > _maxUs) {
+        _maxUs = latenessUs;
+    }
+}
+
+uint32_t JitterHistogram::getCount() const {
+    return _count;
+}
+
+uint32_t JitterHistogram::getMaxUs() const {
+    return _maxUs;
+}
+
+uint32_t JitterHistogram::getBucket(size_t bucket) const {
+    return bucket < BUCKET_COUNT ? _buckets[bucket] : 0;
+}
@@ -0,0 +1,113 @@
+#include "System/power_manager.hpp"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+esp_pm_lock_handle_t PowerManager::_cpuLock = nullptr;
+esp_pm_lock_handle_t PowerManager::_sleepLock = nullptr;
+bool PowerManager::_enabled = false;
+bool PowerManager::_fansRunning = true;
+int64_t PowerManager::_initUs = 0;
+int64_t PowerManager::_restingSinceUs = 0;
+uint64_t PowerManager::_restingUs = 0;
+uint32_t PowerManager::_lightSleeps = 0;
+uint64_t PowerManager::_sleepUs = 0;
+int64_t PowerManager::_lastWakeUs = 0;
+portMUX_TYPE PowerManager::_lock = portMUX_INITIALIZER_UNLOCKED;
+
+bool PowerManager::init() {
+    _initUs = esp_timer_get_time();
+    if (!PowerConfig::ENABLED) {
+        return false;
+    }
+
+    // Boot and the first fan phase run at full speed, the locks are taken before scaling is allowed
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "fans", &_cpuLock) != ESP_OK
+        || esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "fans", &_sleepLock) != ESP_OK) {
+        ESP_LOGW(PowerConfig::TAG, "Power management not available, running at full speed");
+        return false;
+    }
+    esp_pm_lock_acquire(_cpuLock);
+    esp_pm_lock_acquire(_sleepLock);
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t callbacks = {};
+    callbacks.exit_cb = on_sleep_exit;
+    esp_pm_light_sleep_register_cbs(&callbacks);
+#endif
+
+    esp_pm_config_t config = {
+        .max_freq_mhz = PowerConfig::MAX_CPU_FREQ_MHZ,
+        .min_freq_mhz = PowerConfig::MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = true
+    };
+    esp_err_t result = esp_pm_configure(&config);
+    if (result != ESP_OK) {
+        ESP_LOGW(PowerConfig::TAG, "Failed to configure power management: %s", esp_err_to_name(result));
+        return false;
+    }
+
+    _enabled = true;
+    ESP_LOGI(PowerConfig::TAG, "CPU scales between %d and %d MHz while the fans rest",
+             PowerConfig::MIN_CPU_FREQ_MHZ, PowerConfig::MAX_CPU_FREQ_MHZ);
+    return true;
+}
+
+void PowerManager::setFansRunning(bool running) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&_lock);
+    bool changed = running != _fansRunning;
+    if (changed && running) {
+        _restingUs += now - _restingSinceUs;
+    } else if (changed) {
+        _restingSinceUs = now;
+    }
+    _fansRunning = running;
+    portEXIT_CRITICAL(&_lock);
+
+    if (!changed || !_enabled) {
+        return;
+    }
+    if (running) {
+        esp_pm_lock_acquire(_cpuLock);
+        esp_pm_lock_acquire(_sleepLock);
+    } else {
+        esp_pm_lock_release(_sleepLock);
+        esp_pm_lock_release(_cpuLock);
+    }
+}
+
+bool PowerManager::isSaving() {
+    return _enabled && !_fansRunning;
+}
+
+int64_t PowerManager::getLastWakeUs() {
+    portENTER_CRITICAL(&_lock);
+    int64_t lastWakeUs = _lastWakeUs;
+    portEXIT_CRITICAL(&_lock);
+    return lastWakeUs;
+}
+
+PowerStats PowerManager::getStats() {
+    int64_t now = esp_timer_get_time();
+    PowerStats stats = {};
+    portENTER_CRITICAL(&_lock);
+    stats.enabled = _enabled;
+    stats.fansRunning = _fansRunning;
+    stats.lightSleeps = _lightSleeps;
+    stats.sleepUs = _sleepUs;
+    stats.restingUs = _restingUs + (_fansRunning ? 0 : now - _restingSinceUs);
+    portEXIT_CRITICAL(&_lock);
+    stats.uptimeUs = now - _initUs;
+    return stats;
+}
+
+esp_err_t IRAM_ATTR PowerManager::on_sleep_exit(int64_t sleepTimeUs, void* arg) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&_lock);
+    _lightSleeps++;
+    _sleepUs += sleepTimeUs;
+    _lastWakeUs = now;
+    portEXIT_CRITICAL_ISR(&_lock);
+    return ESP_OK;
+}
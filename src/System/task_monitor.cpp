@@ -0,0 +1,59 @@
+#include "System/task_monitor.hpp"
+
+#include "esp_log.h"
+
+TaskMonitor::Entry TaskMonitor::_entries[TaskConfig::MAX_MONITORED_TASKS] = {};
+size_t TaskMonitor::_count = 0;
+portMUX_TYPE TaskMonitor::_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void TaskMonitor::add(TaskHandle_t handle, const char* name, uint32_t stackSize) {
+    if (handle == nullptr) {
+        return;
+    }
+
+    bool added = false;
+    portENTER_CRITICAL(&_lock);
+    if (_count < TaskConfig::MAX_MONITORED_TASKS) {
+        _entries[_count++] = {handle, name, stackSize};
+        added = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+
+    if (!added) {
+        ESP_LOGW(TaskConfig::BOOT_TAG, "Too many tasks, stack of %s is not monitored", name);
+    }
+}
+
+void TaskMonitor::remove(TaskHandle_t handle) {
+    portENTER_CRITICAL(&_lock);
+    for (size_t i = 0; i < _count; i++) {
+        if (_entries[i].handle == handle) {
+            _entries[i] = _entries[--_count];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+size_t TaskMonitor::getCount() {
+    return _count;
+}
+
+bool TaskMonitor::getInfo(size_t index, TaskStackInfo& info) {
+    // Hold the lock while reading the watermark so the task cannot be removed and deleted meanwhile
+    bool found = false;
+    portENTER_CRITICAL(&_lock);
+    if (index < _count) {
+        const Entry& entry = _entries[index];
+        BaseType_t core = xTaskGetCoreID(entry.handle);
+        info = {
+            entry.name,
+            entry.stackSize,
+            static_cast<uint32_t>(uxTaskGetStackHighWaterMark(entry.handle)),
+            core == tskNO_AFFINITY ? -1 : static_cast<int>(core)
+        };
+        found = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return found;
+}
@@ -2,50 +2,78 @@
 #include "nvs_flash.h"
 
 #include "FanControl/fan_manager.hpp"
+#include "FanControl/fan_topology.hpp"
 #include "Network/server.hpp"
 #include "Network/wifi_manager.hpp"
+#include "Ota/ota_health_check.hpp"
+#include "System/boot_sequence.hpp"
+#include "System/power_manager.hpp"
+#include "System/static_task.hpp"
 #include "config.hpp"
 
 FanManager fanManager;
+WiFiManager wifiManager;
+
+// Long-lived tasks live in static memory, their stacks never come from the heap
+StaticTask<TaskConfig::FAN_TASK.stackSize> fanTaskStorage;
+StaticTask<TaskConfig::WEB_SERVER_TASK.stackSize> webServerTaskStorage;
 
 void fanTask(void* pvParameters) {
-    fanManager.createFan(FanConfig::FAN_FRONT);
-    fanManager.createFan(FanConfig::FAN_BACK);
+    // Interrupts are allocated on the core that installs the service, keep the tacho ISRs next to
+    // the control loop. IRAM keeps them counting while flash is written (NVS commits, OTA).
+    ESP_ERROR_CHECK(gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
+
+    // Fans are defined by the topology file, the built-in pair keeps a device without one running
+    FanTopology topology;
+    if (!BootSequence::isReached(BootStage::SpiffsReady) || !topology.loadFromFile(FanConfig::TOPOLOGY_PATH)) {
+        ESP_LOGW(TaskConfig::FAN_TASK.tag, "Using built-in fans: %s", topology.getError().c_str());
+        topology.loadDefaults();
+    }
+    for (const auto& config : topology.getFans()) {
+        fanManager.createFan(config);
+    }
+    ESP_LOGI(TaskConfig::FAN_TASK.tag, "Created %u fans", static_cast<unsigned>(topology.getFans().size()));
+
     fanManager.setInterval(FanConfig::INTERVAL);
     fanManager.setRuntimeOfFans(FanConfig::RUNTIME_OF_FANS);
+    fanManager.loadSettings();
+    fanManager.loadWear();
+
+    // After a watchdog reset or brownout the cycle continues where it was instead of starting over
+    fanManager.restoreCheckpoint();
     fanManager.initializeAllFans();
     fanManager.runTask();
 }
 
-void wifiManagerTask(void* pvParameters) {
-    WiFiManager wifiManager;
-    wifiManager.init();
-    while (true) {
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+void webServerTask(void* pvParameters) {
+    // The listeners bind to any address and open right away; clients reach them once the IP is assigned
+    {
+        WebServer server(fanManager, wifiManager);
+        server.start();
     }
+
+    // start() only returns after the server has been stopped and shut down
+    TaskMonitor::remove(xTaskGetCurrentTaskHandle());
+    vTaskDelete(nullptr);
 }
 
-void webServerTask(void* pvParameters) {
-    // Initialize SPIFFS
+void mountSPIFFS() {
     esp_vfs_spiffs_conf_t conf = {
-        .base_path = "/spiffs",
+        .base_path = SPIFFSConfig::SPIFFS_BASE_PATH,
         .partition_label = nullptr,
         .max_files = 5,
         .format_if_mount_failed = false
     };
     
     if (esp_vfs_spiffs_register(&conf) != ESP_OK) {
-        ESP_LOGE(TaskConfig::WEB_SERVER_TASK.tag, "Error mounting SPIFFS filesystem");
+        ESP_LOGE(TaskConfig::BOOT_TAG, "Error mounting SPIFFS filesystem");
         return;
     }
-
-    WebServer server(fanManager);
-    server.start();
+    BootSequence::markReached(BootStage::SpiffsReady);
 }
 
 void setup() {
-    // Install ISR-Service
-    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    BootSequence::init();
 
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -53,12 +81,27 @@ void setup() {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
-    
-    xTaskCreate(wifiManagerTask, TaskConfig::WIFI_TASK.tag, TaskConfig::WIFI_TASK.stackSize, nullptr, TaskConfig::WIFI_TASK.priority, nullptr);
-    xTaskCreate(fanTask, TaskConfig::FAN_TASK.tag, TaskConfig::FAN_TASK.stackSize, nullptr, TaskConfig::FAN_TASK.priority, nullptr);
-    xTaskCreate(webServerTask, TaskConfig::WEB_SERVER_TASK.tag, TaskConfig::WEB_SERVER_TASK.stackSize, nullptr, TaskConfig::WEB_SERVER_TASK.priority, nullptr);
+    BootSequence::markReached(BootStage::NvsReady);
+
+    // The PM locks have to exist before the fan cycle takes or releases them
+    PowerManager::init();
+
+    // Fans only need their topology from SPIFFS, mounting it is quick; bring them up first
+    mountSPIFFS();
+    fanTaskStorage.create(fanTask, TaskConfig::FAN_TASK);
+
+    // A freshly updated firmware has to prove itself before it is kept
+    OtaHealthCheck::start();
+
+    // Connecting takes longest, start it before anything else so it runs in the background.
+    // Wi-Fi is event driven and needs no task of its own once the driver is started.
+    wifiManager.init();
+    BootSequence::markReached(BootStage::WifiStarted);
+
+    // The web server does not wait for the IP, MQTT and the fleet retry until it is assigned
+    webServerTaskStorage.create(webServerTask, TaskConfig::WEB_SERVER_TASK);
 }
 
 extern "C" void app_main() {
     setup();
-}
\ No newline at end of file
+}
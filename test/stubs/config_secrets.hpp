@@ -0,0 +1,6 @@
+#pragma once
+
+// Used by the host tests when include/config_secrets.hpp does not exist
+
+#define WIFI_SSID_SECRET  "HostTest"
+#define WIFI_PASS_SECRET  "HostTest"
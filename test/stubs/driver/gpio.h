@@ -0,0 +1,47 @@
+#pragma once
+
+// Host stand-in for the GPIO driver; configuration succeeds and no interrupt ever fires
+
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_14 = 14,
+    GPIO_NUM_27 = 27,
+    GPIO_NUM_32 = 32,
+    GPIO_NUM_33 = 33,
+    GPIO_NUM_MAX = 40
+} gpio_num_t;
+
+typedef enum { GPIO_INTR_DISABLE, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE } gpio_int_type_t;
+typedef enum { GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
+typedef enum { GPIO_PULLUP_DISABLE, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE, GPIO_PULLDOWN_ENABLE } gpio_pulldown_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+
+inline esp_err_t gpio_config(const gpio_config_t*) {
+    return ESP_OK;
+}
+
+inline esp_err_t gpio_isr_handler_add(gpio_num_t, gpio_isr_t, void*) {
+    return ESP_OK;
+}
+
+inline esp_err_t gpio_intr_disable(gpio_num_t) {
+    return ESP_OK;
+}
+
+inline esp_err_t gpio_intr_enable(gpio_num_t) {
+    return ESP_OK;
+}
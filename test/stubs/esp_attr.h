@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF placement attributes, everything lives in ordinary memory
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
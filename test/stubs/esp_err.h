@@ -0,0 +1,19 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF error codes
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+#define ESP_ERROR_CHECK(x) ((void)(x))
+
+inline const char* esp_err_to_name(esp_err_t) {
+    return "ESP_ERR";
+}
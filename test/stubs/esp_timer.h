@@ -0,0 +1,49 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF high resolution timer; the clock is the host's steady clock and
+// timers never fire, so nothing scheduled by the code under test runs behind its back
+
+#include <chrono>
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum { ESP_TIMER_TASK, ESP_TIMER_ISR } esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+};
+
+typedef struct esp_timer* esp_timer_handle_t;
+
+inline int64_t esp_timer_get_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    *handle = new esp_timer{*args};
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t, uint64_t) {
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t, uint64_t) {
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t) {
+    return ESP_OK;
+}
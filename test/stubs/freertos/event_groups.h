@@ -0,0 +1,31 @@
+#pragma once
+
+// Host stand-in for the static FreeRTOS event groups; waiting returns the bits set so far
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+
+typedef struct {
+    EventBits_t bits;
+} StaticEventGroup_t;
+
+typedef StaticEventGroup_t* EventGroupHandle_t;
+
+inline EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t* group) {
+    *group = {};
+    return group;
+}
+
+inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    return group->bits;
+}
+
+inline EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t, BaseType_t, BaseType_t, TickType_t) {
+    return group->bits;
+}
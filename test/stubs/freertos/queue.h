@@ -0,0 +1,57 @@
+#pragma once
+
+// Host stand-in for the static FreeRTOS queues; a call that would block fails right away, since
+// no other task could ever complete it
+
+#include <cstring>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+    uint8_t* storage;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+} StaticQueue_t;
+
+typedef StaticQueue_t* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t* storage, StaticQueue_t* queue) {
+    *queue = {storage, length, itemSize, 0, 0};
+    return queue;
+}
+
+inline void vQueueDelete(QueueHandle_t) {}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t) {
+    if (queue->count == queue->length) {
+        return pdFALSE;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->storage + tail * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    return pdTRUE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t) {
+    if (queue->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+inline BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t) {
+    if (queue->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+    return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
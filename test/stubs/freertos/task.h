@@ -0,0 +1,28 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS task API; no task is ever created and delays return at once
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint8_t StackType_t;
+typedef void (*TaskFunction_t)(void* arg);
+typedef struct tskTaskControlBlock* TaskHandle_t;
+
+typedef struct {
+    uint8_t unused;
+} StaticTask_t;
+
+#define configMINIMAL_STACK_SIZE 768
+#define tskNO_AFFINITY 0x7fffffff
+
+inline TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, StackType_t*, StaticTask_t*, BaseType_t) {
+    return nullptr;
+}
+
+inline TickType_t xTaskGetTickCount() {
+    return 0;
+}
+
+inline void vTaskDelay(TickType_t) {}
+
+inline void vTaskDelayUntil(TickType_t*, TickType_t) {}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Host stand-in for mbedTLS' message digest layer, HMAC (RFC 2104) over the SHA-256 stand-in
+
+#include <cstddef>
+#include <cstring>
+
+#include "mbedtls/sha256.h"
+
+typedef enum { MBEDTLS_MD_NONE, MBEDTLS_MD_SHA256 } mbedtls_md_type_t;
+
+typedef struct {
+    mbedtls_md_type_t type;
+} mbedtls_md_info_t;
+
+inline const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type) {
+    static constexpr mbedtls_md_info_t SHA256 = {MBEDTLS_MD_SHA256};
+    return type == MBEDTLS_MD_SHA256 ? &SHA256 : nullptr;
+}
+
+inline int mbedtls_md_hmac(const mbedtls_md_info_t* info, const unsigned char* key, size_t keyLength,
+                           const unsigned char* input, size_t inputLength, unsigned char* output) {
+    if (info == nullptr) {
+        return -1;
+    }
+
+    // Longer keys are hashed first, shorter ones padded with zeros to the block size
+    unsigned char block[64] = {};
+    mbedtls_sha256_context ctx;
+    if (keyLength > sizeof(block)) {
+        mbedtls_sha256_init(&ctx);
+        mbedtls_sha256_starts(&ctx, 0);
+        mbedtls_sha256_update(&ctx, key, keyLength);
+        mbedtls_sha256_finish(&ctx, block);
+    } else {
+        memcpy(block, key, keyLength);
+    }
+
+    unsigned char pad[64];
+    unsigned char inner[32];
+    for (size_t i = 0; i < sizeof(pad); i++) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+    mbedtls_sha256_update(&ctx, input, inputLength);
+    mbedtls_sha256_finish(&ctx, inner);
+
+    for (size_t i = 0; i < sizeof(pad); i++) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+    mbedtls_sha256_update(&ctx, inner, sizeof(inner));
+    mbedtls_sha256_finish(&ctx, output);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Host stand-in for the NVS API, the storage is always empty and rejects writes
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+
+inline esp_err_t nvs_open(const char*, nvs_open_mode_t, nvs_handle_t*) {
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+inline void nvs_close(nvs_handle_t) {}
+
+inline esp_err_t nvs_get_blob(nvs_handle_t, const char*, void*, size_t*) {
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+inline esp_err_t nvs_set_blob(nvs_handle_t, const char*, const void*, size_t) {
+    return ESP_FAIL;
+}
+
+inline esp_err_t nvs_get_u32(nvs_handle_t, const char*, uint32_t*) {
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+inline esp_err_t nvs_set_u32(nvs_handle_t, const char*, uint32_t) {
+    return ESP_FAIL;
+}
+
+inline esp_err_t nvs_commit(nvs_handle_t) {
+    return ESP_FAIL;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the generated configuration, values from sdkconfig.CannaDryer
+
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#define CONFIG_FREERTOS_HZ 100
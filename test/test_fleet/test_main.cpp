@@ -0,0 +1,109 @@
+#include <unity.h>
+
+#include <cstring>
+#include <string>
+
+#include "Network/fleet_auth.hpp"
+
+using namespace std;
+
+static constexpr const char* KEY_HEX = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f";
+static constexpr const char* OTHER_KEY_HEX = "ffeeddccbbaa99887766554433221100ffeeddccbbaa99887766554433221100";
+static constexpr const char* ANNOUNCEMENT = "{\"id\":\"a1b2c3\",\"epoch\":7,\"seq\":1}";
+
+// HMAC-SHA256 of ANNOUNCEMENT under KEY_HEX, computed with Python's hmac module
+static constexpr const char* ANNOUNCEMENT_MAC = "836aceafcb38a08478e00510713611f7e78d367ce596105a9e38eb6cf4b37647";
+
+static FleetAuth makeAuth(const char* keyHex) {
+    uint8_t key[FleetConfig::KEY_SIZE];
+    FleetAuth auth;
+    if (FleetAuth::parseKey(keyHex, strlen(keyHex), key)) {
+        auth.useKey(key);
+    }
+    return auth;
+}
+
+static string signWith(const FleetAuth& auth, const char* announcement) {
+    char datagram[FleetConfig::MAX_DATAGRAM_SIZE];
+    size_t length = strlen(announcement);
+    memcpy(datagram, announcement, length);
+    length = auth.sign(datagram, length, sizeof(datagram));
+    return string(datagram, length);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_signature_is_hmac_sha256_in_hex() {
+    string datagram = signWith(makeAuth(KEY_HEX), ANNOUNCEMENT);
+    TEST_ASSERT_EQUAL_STRING((string(ANNOUNCEMENT) + "\n" + ANNOUNCEMENT_MAC).c_str(), datagram.c_str());
+}
+
+void test_signed_announcement_is_accepted() {
+    FleetAuth auth = makeAuth(KEY_HEX);
+    string datagram = signWith(auth, ANNOUNCEMENT);
+    TEST_ASSERT_EQUAL(strlen(ANNOUNCEMENT), auth.verify(datagram.data(), datagram.size()));
+}
+
+void test_forged_announcement_is_rejected() {
+    FleetAuth auth = makeAuth(KEY_HEX);
+
+    // Signed by a host that does not know the fleet key
+    string forged = signWith(makeAuth(OTHER_KEY_HEX), "{\"id\":\"000000\",\"epoch\":1,\"seq\":1,\"config\":{}}");
+    TEST_ASSERT_EQUAL(0, auth.verify(forged.data(), forged.size()));
+
+    // A valid announcement whose sender was changed to win the election
+    string tampered = signWith(auth, ANNOUNCEMENT);
+    memcpy(&tampered[7], "000000", 6);
+    TEST_ASSERT_EQUAL(0, auth.verify(tampered.data(), tampered.size()));
+
+    // No signature at all
+    TEST_ASSERT_EQUAL(0, auth.verify(ANNOUNCEMENT, strlen(ANNOUNCEMENT)));
+}
+
+void test_nothing_is_signed_or_accepted_without_key() {
+    FleetAuth withKey = makeAuth(KEY_HEX);
+    FleetAuth withoutKey;
+    string datagram = signWith(withKey, ANNOUNCEMENT);
+
+    TEST_ASSERT_FALSE(withoutKey.hasKey());
+    TEST_ASSERT_EQUAL(0, withoutKey.verify(datagram.data(), datagram.size()));
+    TEST_ASSERT_EQUAL(0, signWith(withoutKey, ANNOUNCEMENT).size());
+}
+
+void test_replayed_announcement_is_rejected() {
+    FleetAuth auth = makeAuth(KEY_HEX);
+    TEST_ASSERT_TRUE(auth.acceptSequence("a1b2c3", 7, 5));
+
+    // The same announcement again, an older one and one from an earlier boot
+    TEST_ASSERT_FALSE(auth.acceptSequence("a1b2c3", 7, 5));
+    TEST_ASSERT_FALSE(auth.acceptSequence("a1b2c3", 7, 4));
+    TEST_ASSERT_FALSE(auth.acceptSequence("a1b2c3", 6, 100));
+
+    // The next announcement, and the first after the sender restarted
+    TEST_ASSERT_TRUE(auth.acceptSequence("a1b2c3", 7, 6));
+    TEST_ASSERT_TRUE(auth.acceptSequence("a1b2c3", 8, 1));
+
+    // Other senders are tracked on their own
+    TEST_ASSERT_TRUE(auth.acceptSequence("d4e5f6", 1, 1));
+}
+
+void test_invalid_keys_are_rejected() {
+    uint8_t key[FleetConfig::KEY_SIZE];
+    TEST_ASSERT_TRUE(FleetAuth::parseKey(KEY_HEX, strlen(KEY_HEX), key));
+    TEST_ASSERT_EQUAL_HEX8(0x1f, key[31]);
+    TEST_ASSERT_FALSE(FleetAuth::parseKey(KEY_HEX, strlen(KEY_HEX) - 2, key));
+    TEST_ASSERT_FALSE(FleetAuth::parseKey("zz0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f", 64, key));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_signature_is_hmac_sha256_in_hex);
+    RUN_TEST(test_signed_announcement_is_accepted);
+    RUN_TEST(test_forged_announcement_is_rejected);
+    RUN_TEST(test_nothing_is_signed_or_accepted_without_key);
+    RUN_TEST(test_replayed_announcement_is_rejected);
+    RUN_TEST(test_invalid_keys_are_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Ota/iota_backend.hpp"
+
+using namespace std;
+
+/**
+ * @class FakeOtaBackend
+ * @brief Keeps the image in RAM and records what the updater asked of it.
+ *
+ * Every step can be made to fail, so the error paths of the OtaUpdater run without flash.
+ */
+class FakeOtaBackend : public IOtaBackend {
+    public:
+        vector<uint8_t> image;          ///< Bytes written since the last `begin()`.
+        size_t announcedSize = 0;       ///< Size passed to the last `begin()`.
+        uint32_t writes = 0;            ///< Number of `write()` calls.
+        bool begun = false;             ///< True between `begin()` and `finish()` or `abort()`.
+        bool finished = false;          ///< True if `finish()` succeeded.
+        bool activated = false;         ///< True if `activate()` succeeded.
+        bool aborted = false;           ///< True if `abort()` was called.
+
+        bool failBegin = false;         ///< Makes `begin()` fail.
+        uint32_t failWriteAt = 0;       ///< Makes the n-th `write()` fail, 0 for never.
+        bool failFinish = false;        ///< Makes `finish()` fail, like an image with a broken header.
+        bool failActivate = false;      ///< Makes `activate()` fail.
+
+        bool begin(size_t imageSize) override {
+            if (failBegin) {
+                return false;
+            }
+            image.clear();
+            announcedSize = imageSize;
+            begun = true;
+            return true;
+        }
+
+        bool write(const uint8_t* data, size_t length) override {
+            writes++;
+            if (writes == failWriteAt) {
+                return false;
+            }
+            image.insert(image.end(), data, data + length);
+            return true;
+        }
+
+        bool finish() override {
+            begun = false;
+            finished = !failFinish;
+            return finished;
+        }
+
+        bool activate() override {
+            activated = !failActivate;
+            return activated;
+        }
+
+        void abort() override {
+            begun = false;
+            aborted = true;
+        }
+};
@@ -0,0 +1,181 @@
+#include <unity.h>
+
+#include <cstring>
+#include <vector>
+
+#include "Ota/ota_updater.hpp"
+#include "fake_ota_backend.hpp"
+
+using namespace std;
+
+// SHA-256 of the image built by `makeImage()`, computed with sha256sum
+static constexpr const char* IMAGE_SHA256 = "f541874101876255b4baf3a739778d04cb9cba25ffa38b30bc1fb8b0701f2a45";
+static constexpr size_t IMAGE_SIZE = 3000;
+
+// Uploads arrive in pieces of the TCP receive size
+static constexpr size_t CHUNK_SIZE = 1460;
+
+static vector<uint8_t> makeImage() {
+    vector<uint8_t> image(IMAGE_SIZE);
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    return image;
+}
+
+static bool upload(OtaUpdater& updater, const vector<uint8_t>& data) {
+    for (size_t offset = 0; offset < data.size(); offset += CHUNK_SIZE) {
+        size_t length = data.size() - offset < CHUNK_SIZE ? data.size() - offset : CHUNK_SIZE;
+        if (!updater.write(data.data() + offset, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_valid_image_is_activated() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    vector<uint8_t> image = makeImage();
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_TRUE(upload(updater, image));
+    TEST_ASSERT_TRUE(updater.isComplete());
+    TEST_ASSERT_TRUE(updater.finish());
+
+    TEST_ASSERT_EQUAL(OtaState::Succeeded, updater.getState());
+    TEST_ASSERT_TRUE(backend.activated);
+    TEST_ASSERT_FALSE(backend.aborted);
+    TEST_ASSERT_EQUAL(3, backend.writes);
+    TEST_ASSERT_TRUE(backend.image == image);
+}
+
+void test_truncated_image_is_rejected() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    vector<uint8_t> image = makeImage();
+    image.resize(IMAGE_SIZE - 100);
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_TRUE(upload(updater, image));
+    TEST_ASSERT_FALSE(updater.isComplete());
+    TEST_ASSERT_FALSE(updater.finish());
+
+    TEST_ASSERT_EQUAL(OtaState::Failed, updater.getState());
+    TEST_ASSERT_EQUAL_STRING("Image truncated", updater.getError());
+    TEST_ASSERT_TRUE(backend.aborted);
+    TEST_ASSERT_FALSE(backend.activated);
+}
+
+void test_disconnect_discards_partial_image() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    vector<uint8_t> image = makeImage();
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_TRUE(updater.write(image.data(), CHUNK_SIZE));
+    updater.abort("Client disconnected");
+
+    TEST_ASSERT_EQUAL(OtaState::Failed, updater.getState());
+    TEST_ASSERT_EQUAL(CHUNK_SIZE, updater.getReceived());
+    TEST_ASSERT_TRUE(backend.aborted);
+    TEST_ASSERT_FALSE(backend.activated);
+}
+
+void test_corrupt_image_is_rejected() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    vector<uint8_t> image = makeImage();
+    image[IMAGE_SIZE / 2] ^= 0x01;
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_TRUE(upload(updater, image));
+    TEST_ASSERT_FALSE(updater.finish());
+
+    TEST_ASSERT_EQUAL_STRING("SHA-256 mismatch", updater.getError());
+    TEST_ASSERT_TRUE(backend.aborted);
+    TEST_ASSERT_FALSE(backend.finished);
+    TEST_ASSERT_FALSE(backend.activated);
+}
+
+void test_excess_data_is_rejected() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    vector<uint8_t> image = makeImage();
+    image.push_back(0);
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_FALSE(upload(updater, image));
+
+    TEST_ASSERT_EQUAL_STRING("More data than announced", updater.getError());
+    TEST_ASSERT_TRUE(backend.aborted);
+    TEST_ASSERT_FALSE(updater.finish());
+}
+
+void test_invalid_digest_is_rejected_before_writing() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    const char* digest = "f541874101876255b4baf3a739778d04cb9cba25ffa38b30bc1fb8b0701f2a4g";
+
+    TEST_ASSERT_FALSE(updater.begin(IMAGE_SIZE, digest, strlen(digest)));
+    TEST_ASSERT_FALSE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, 63));
+    TEST_ASSERT_FALSE(updater.begin(0, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+
+    TEST_ASSERT_EQUAL(OtaState::Failed, updater.getState());
+    TEST_ASSERT_FALSE(backend.begun);
+}
+
+void test_backend_failures_abort_the_update() {
+    vector<uint8_t> image = makeImage();
+
+    FakeOtaBackend writeBackend;
+    writeBackend.failWriteAt = 2;
+    OtaUpdater writeUpdater(writeBackend);
+    TEST_ASSERT_TRUE(writeUpdater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_FALSE(upload(writeUpdater, image));
+    TEST_ASSERT_EQUAL_STRING("Flash write failed", writeUpdater.getError());
+    TEST_ASSERT_TRUE(writeBackend.aborted);
+
+    FakeOtaBackend finishBackend;
+    finishBackend.failFinish = true;
+    OtaUpdater finishUpdater(finishBackend);
+    TEST_ASSERT_TRUE(finishUpdater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_TRUE(upload(finishUpdater, image));
+    TEST_ASSERT_FALSE(finishUpdater.finish());
+    TEST_ASSERT_EQUAL_STRING("Image validation failed", finishUpdater.getError());
+    TEST_ASSERT_FALSE(finishBackend.activated);
+}
+
+void test_new_update_after_failure() {
+    FakeOtaBackend backend;
+    OtaUpdater updater(backend);
+    vector<uint8_t> image = makeImage();
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_TRUE(updater.write(image.data(), 100));
+    TEST_ASSERT_FALSE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    updater.abort("Client disconnected");
+
+    TEST_ASSERT_TRUE(updater.begin(IMAGE_SIZE, IMAGE_SHA256, strlen(IMAGE_SHA256)));
+    TEST_ASSERT_EQUAL(0, updater.getReceived());
+    TEST_ASSERT_TRUE(upload(updater, image));
+    TEST_ASSERT_TRUE(updater.finish());
+    TEST_ASSERT_TRUE(backend.image == image);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_image_is_activated);
+    RUN_TEST(test_truncated_image_is_rejected);
+    RUN_TEST(test_disconnect_discards_partial_image);
+    RUN_TEST(test_corrupt_image_is_rejected);
+    RUN_TEST(test_excess_data_is_rejected);
+    RUN_TEST(test_invalid_digest_is_rejected_before_writing);
+    RUN_TEST(test_backend_failures_abort_the_update);
+    RUN_TEST(test_new_update_after_failure);
+    return UNITY_END();
+}
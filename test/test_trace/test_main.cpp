@@ -0,0 +1,206 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "esp_rom_crc.h"
+
+#include "FanControl/trace_replayer.hpp"
+
+using namespace std;
+
+static constexpr const char* TRACE_PATH = "test_trace.bin";
+
+// Recorded events of a tick are stamped a little after the tick itself
+static constexpr uint32_t TICK_LATENESS_US = 300;
+
+// Front turns at 1500 rpm, one tacho edge every 20 ms; Back has a tacho but never gives a pulse
+static constexpr uint32_t EDGE_PERIOD_US = 20000;
+
+/**
+ * @brief Builds a trace file the way `TraceRecorder` writes it.
+ */
+struct TraceFile {
+    TraceHeader header = {};
+    vector<TraceEvent> events;
+
+    TraceFile() {
+        // Two fans that have been running for 400 ms of a 2 s runtime when the recording began
+        header.magic = TraceRecorder::FILE_MAGIC;
+        header.version = TraceRecorder::FILE_VERSION;
+        header.controlTickMs = FanConfig::CONTROL_TICK_MS;
+        header.tachoMask = 0b11;
+        header.state.running = true;
+        header.state.elapsedMs = 400;
+        header.state.interval = 2;
+        header.state.runtimeOfFans = 2;
+        header.state.fanCount = 2;
+        header.state.power[0] = 60;
+        header.state.power[1] = 40;
+        strcpy(header.names[0], "Front");
+        strcpy(header.names[1], "Back");
+
+        // The same hash the fan task puts into its checkpoint
+        for (uint8_t i = 0; i < header.state.fanCount; i++) {
+            header.state.topologyHash = esp_rom_crc32_le(header.state.topologyHash, reinterpret_cast<const uint8_t*>(header.names[i]),
+                                                         strlen(header.names[i]) + 1);
+        }
+    }
+
+    void add(uint32_t timeMs, TraceEventType type, uint8_t fan, uint16_t value) {
+        events.push_back({timeMs * 1000 + TICK_LATENESS_US, type, fan, value});
+    }
+
+    void edges(uint32_t fromMs, uint32_t toMs) {
+        for (uint32_t timeUs = fromMs * 1000 + 5000; timeUs < toMs * 1000; timeUs += EDGE_PERIOD_US) {
+            events.push_back({timeUs, TraceEventType::TachoEdge, 0, 0});
+        }
+    }
+
+    void stop(uint32_t timeMs) {
+        add(timeMs, TraceEventType::Duty, 0, 0);
+        add(timeMs, TraceEventType::Duty, 1, 0);
+        add(timeMs, TraceEventType::Phase, 0, 0);
+    }
+
+    void start(uint32_t timeMs, uint16_t frontPower) {
+        add(timeMs, TraceEventType::Duty, 0, frontPower);
+        add(timeMs, TraceEventType::Duty, 1, 40);
+        add(timeMs, TraceEventType::Phase, 0, 1);
+    }
+
+    void write() {
+        stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.timeUs < b.timeUs; });
+        FILE* file = fopen(TRACE_PATH, "wb");
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(events.data(), sizeof(TraceEvent), events.size(), file);
+        fclose(file);
+    }
+};
+
+/**
+ * @brief A recording of the current firmware: a power change while running, an interval change while resting.
+ */
+static TraceFile makeRecording(uint32_t firstStopMs = 1600) {
+    TraceFile trace;
+    trace.edges(0, firstStopMs);
+    trace.stop(firstStopMs);
+    trace.start(3600, 60);
+    trace.edges(3600, 5600);
+    trace.add(4000, TraceEventType::Power, 0, 80);
+    trace.add(4000, TraceEventType::Duty, 0, 80);
+    trace.stop(5600);
+
+    // A shorter interval ends the resting phase that has already lasted 400 ms after another 600 ms
+    trace.add(6000, TraceEventType::Interval, 0, 1);
+    trace.start(6600, 80);
+    trace.edges(6600, 7000);
+    return trace;
+}
+
+void setUp() {}
+
+void tearDown() {
+    remove(TRACE_PATH);
+}
+
+void test_recording_of_current_logic_replays_without_mismatches() {
+    makeRecording().write();
+    TraceReplayer replayer;
+
+    TEST_ASSERT_TRUE(replayer.run(TRACE_PATH));
+    const TraceReplayResult& result = replayer.getResult();
+    TEST_ASSERT_EQUAL(4, result.transitions);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+    TEST_ASSERT_EQUAL(TICK_LATENESS_US, result.maxDeviationUs);
+    TEST_ASSERT_EQUAL(0, result.dutyMismatches);
+    TEST_ASSERT_EQUAL(70, result.ticks);
+    TEST_ASSERT_EQUAL(2, result.fanCount);
+}
+
+void test_tacho_edges_give_speed_and_stalls() {
+    makeRecording().write();
+    TraceReplayer replayer;
+
+    TEST_ASSERT_TRUE(replayer.run(TRACE_PATH));
+    const TraceFanSummary& front = replayer.getResult().fans[0];
+    TEST_ASSERT_EQUAL_STRING("Front", front.name);
+    TEST_ASSERT_EQUAL(200, front.edges);
+    TEST_ASSERT_EQUAL(1500, front.maxRpm);
+    TEST_ASSERT_EQUAL(600, front.minRpm);
+    TEST_ASSERT_EQUAL(5, front.rpmWindows);
+    TEST_ASSERT_EQUAL(0, front.stalls);
+
+    // Only the windows spent entirely in a running phase count as stalled
+    const TraceFanSummary& back = replayer.getResult().fans[1];
+    TEST_ASSERT_EQUAL(0, back.edges);
+    TEST_ASSERT_EQUAL(2, back.stalls);
+}
+
+void test_changed_logic_is_reported_as_mismatch() {
+    // A firmware that ran the fans 300 ms longer than their runtime
+    makeRecording(1900).write();
+    TraceReplayer replayer;
+
+    TEST_ASSERT_TRUE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_GREATER_THAN(0, replayer.getResult().mismatches);
+}
+
+void test_ignored_command_is_reported_as_mismatch() {
+    // Without the interval change the replay starts the fans 1 s after the recording
+    TraceFile trace = makeRecording();
+    trace.events.erase(remove_if(trace.events.begin(), trace.events.end(), [](const TraceEvent& event) {
+        return event.type == TraceEventType::Interval;
+    }), trace.events.end());
+    trace.write();
+    TraceReplayer replayer;
+
+    TEST_ASSERT_TRUE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_GREATER_THAN(0, replayer.getResult().mismatches);
+}
+
+void test_replay_drives_no_hardware() {
+    makeRecording().write();
+    TraceReplayer replayer;
+    uint32_t calls = ledcStubCalls;
+
+    TEST_ASSERT_TRUE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_EQUAL(calls, ledcStubCalls);
+}
+
+void test_invalid_traces_are_rejected() {
+    TraceReplayer replayer;
+    TEST_ASSERT_FALSE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_EQUAL_STRING("No trace recorded", replayer.getError());
+
+    TraceFile otherFans = makeRecording();
+    strcpy(otherFans.header.names[1], "Side");
+    otherFans.write();
+    TEST_ASSERT_FALSE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_EQUAL_STRING("Trace does not match its fans", replayer.getError());
+
+    TraceFile badPower = makeRecording();
+    badPower.add(4100, TraceEventType::Power, 1, 150);
+    badPower.write();
+    TEST_ASSERT_FALSE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_EQUAL_STRING("Corrupt trace", replayer.getError());
+
+    TraceFile unknownFan = makeRecording();
+    unknownFan.add(4100, TraceEventType::Duty, 2, 50);
+    unknownFan.write();
+    TEST_ASSERT_FALSE(replayer.run(TRACE_PATH));
+    TEST_ASSERT_EQUAL_STRING("Corrupt trace", replayer.getError());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_recording_of_current_logic_replays_without_mismatches);
+    RUN_TEST(test_tacho_edges_give_speed_and_stalls);
+    RUN_TEST(test_changed_logic_is_reported_as_mismatch);
+    RUN_TEST(test_ignored_command_is_reported_as_mismatch);
+    RUN_TEST(test_replay_drives_no_hardware);
+    RUN_TEST(test_invalid_traces_are_rejected);
+    return UNITY_END();
+}